@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+// Memory hooks used by the parser and deserializer. Every callback receives
+// ctx as its first argument so per-request pools, arenas or per-thread slabs
+// can be plugged in without global state. A NULL allocator anywhere in the
+// API means json_default_allocator().
+typedef struct {
+        void *(*alloc)(void *ctx, size_t size);
+        void *(*realloc)(void *ctx, void *ptr, size_t size);
+        void (*free)(void *ctx, void *ptr);
+        void *ctx;
+} JsonAllocator;
+
+const JsonAllocator *json_default_allocator(void);
+char *json_allocator_strndup(const JsonAllocator *allocator, const char *string,
+                             size_t length);
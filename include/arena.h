@@ -0,0 +1,28 @@
+#pragma once
+
+#include "allocator.h"
+#include <stddef.h>
+
+typedef struct JsonArenaChunk JsonArenaChunk;
+
+// Bump allocator over a list of chunks obtained from a backing allocator.
+// Individual frees are no-ops; json_arena_reset rewinds every chunk while
+// keeping them, so a workload that fits the retained capacity performs no
+// backing allocator calls at all. The arena embeds the JsonAllocator it
+// hands out, so it must not be moved after json_arena_init.
+typedef struct {
+        JsonArenaChunk *head;
+        JsonArenaChunk *current;
+        void *last;
+        size_t chunk_size;
+        const JsonAllocator *backing;
+        JsonAllocator allocator;
+} JsonArena;
+
+void json_arena_init(JsonArena *arena, const JsonAllocator *backing,
+                     size_t chunk_size);
+void *json_arena_alloc(JsonArena *arena, size_t size);
+void json_arena_reset(JsonArena *arena);
+void json_arena_destroy(JsonArena *arena);
+size_t json_arena_capacity(const JsonArena *arena);
+const JsonAllocator *json_arena_allocator(JsonArena *arena);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "parser.h"
+#include <stddef.h>
+
+typedef struct JsonCache JsonCache;
+typedef struct JsonCacheHandle JsonCacheHandle;
+
+typedef struct {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t entries;
+        size_t bytes;
+} JsonCacheStats;
+
+// Parsed documents keyed by the input bytes: lookups go by a 64-bit hash of
+// them, and each entry keeps a copy of the input so a hit is only taken when
+// the bytes match exactly. Documents are shared and must not be modified.
+// Each lives in its own arena, together with its input copy, and the arena's
+// size counts against max_bytes; least recently used documents are evicted
+// once the total is exceeded.
+//
+// The cache is thread-safe. json_cache_parse returns a handle holding one
+// reference; the document stays valid until every handle is released, even
+// after eviction or json_cache_destroy. options->allocator backs the cache
+// and its arenas; options->stats is ignored.
+JsonCache *json_cache_create(size_t max_bytes,
+                             const JsonParseOptions *options);
+JsonCacheHandle *json_cache_parse(JsonCache *cache, const char *input,
+                                  size_t input_length);
+const JsonObject *json_cache_root(const JsonCacheHandle *handle);
+JsonCacheHandle *json_cache_retain(JsonCacheHandle *handle);
+void json_cache_release(JsonCacheHandle *handle);
+void json_cache_stats(JsonCache *cache, JsonCacheStats *stats);
+void json_cache_destroy(JsonCache *cache);
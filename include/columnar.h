@@ -0,0 +1,59 @@
+#pragma once
+
+#include "allocator.h"
+#include "deserializer.h"
+#include "parser.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    JSON_COLUMN_DOUBLE,
+    JSON_COLUMN_INT64,
+    JSON_COLUMN_BOOL,
+    JSON_COLUMN_STRING,
+} JsonColumnType;
+
+typedef struct {
+        const char *key;
+        JsonColumnType type;
+} JsonColumnSpec;
+
+// One column per spec entry. Bitmaps hold one bit per row, least significant
+// bit first; a set validity bit means the row has a value, a clear one that
+// the key was missing or null. String rows are data[offsets[i]] up to
+// data[offsets[i + 1]], kept exactly as written in the input.
+typedef struct {
+        JsonColumnType type;
+        union {
+                double *doubles;
+                int64_t *int64s;
+                uint8_t *bools;
+                struct {
+                        size_t *offsets;
+                        char *data;
+                };
+        };
+        uint8_t *validity;
+        size_t null_count;
+} JsonColumn;
+
+typedef struct {
+        JsonColumn *columns;
+        size_t column_count;
+        size_t row_count;
+        const JsonAllocator *allocator;
+} JsonColumns;
+
+// Reads a top-level array of objects straight from the token stream into
+// columns, without building JsonValue nodes. Keys not in the spec are
+// skipped; a value of the wrong type fails the whole extraction.
+bool json_to_columns(const char *input, size_t input_length,
+                     const JsonColumnSpec *spec, size_t num_columns,
+                     JsonColumns *columns, JsonError *error,
+                     const JsonParseOptions *options);
+
+static inline bool json_column_bit(const uint8_t *bitmap, size_t row) {
+    return (bitmap[row / 8] >> (row % 8)) & 1;
+}
+
+void json_free_columns(JsonColumns *columns);
@@ -24,6 +24,11 @@ typedef struct {
 bool json_to_struct(void *struct_ptr, const JsonObject *json,
                     const FieldDescriptor *fields, size_t num_fields,
                     JsonError *error);
+bool json_to_struct_ex(void *struct_ptr, const JsonObject *json,
+                       const FieldDescriptor *fields, size_t num_fields,
+                       JsonError *error, const JsonParseOptions *options);
 
 void json_free_struct(void *struct_ptr, const FieldDescriptor *fields,
                       size_t num_fields);
+void json_free_struct_ex(void *struct_ptr, const FieldDescriptor *fields,
+                         size_t num_fields, const JsonAllocator *allocator);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "allocator.h"
+#include "parser.h"
+
+// Returns an RFC 6902 patch (an array of operation objects, ready for
+// json_patch_compile) that turns a into b, or NULL when out of memory. The
+// patch is allocated from allocator and freed with free_json_value_ex.
+//
+// Objects are compared key by key, pairwise when both sides list the same
+// keys in the same order. Arrays are aligned on element hashes: a common
+// prefix and suffix are skipped, and the rest is matched by longest common
+// subsequence when it is small enough, position by position otherwise. An
+// element removed and another inserted at the same place become a replace,
+// or a nested diff when both are containers of the same type.
+JsonValue *json_diff(const JsonValue *a, const JsonValue *b,
+                     const JsonAllocator *allocator);
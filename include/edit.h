@@ -0,0 +1,55 @@
+#pragma once
+
+#include "allocator.h"
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// In-place editing of parsed documents. Containers are passed as their
+// JsonValue (cast a root JsonObject * to JsonValue *, as for
+// free_json_value) together with the allocator the document was parsed
+// with; NULL means json_default_allocator(). For a JsonParser document that
+// is json_parser_allocator(parser).
+//
+// The first edit of a container moves its children into storage with
+// power-of-two capacity and sets JSON_VALUE_GROWABLE, so further inserts are
+// amortized O(1) at the end and a memmove elsewhere. Editing an object also
+// drops its shape and, if its keys were interned, gives it its own copies
+// of them (clearing JSON_VALUE_INTERNED_KEYS). Number arrays stay unboxed
+// while only numbers are added; any other edit boxes a typed array.
+//
+// Inserted values are moved into the container, which takes ownership of
+// what they point to: their strings and children must come from the same
+// allocator. On failure nothing changes and the value still belongs to the
+// caller. Removed and replaced values are released.
+bool json_value_init_string(JsonValue *value, const char *string,
+                            size_t length, const JsonAllocator *allocator);
+
+bool json_object_set(JsonValue *object, const char *key, size_t key_length,
+                     const JsonValue *value, const JsonAllocator *allocator);
+bool json_object_remove(JsonValue *object, const char *key,
+                        size_t key_length, const JsonAllocator *allocator);
+
+bool json_array_push(JsonValue *array, const JsonValue *value,
+                     const JsonAllocator *allocator);
+bool json_array_insert(JsonValue *array, size_t index, const JsonValue *value,
+                       const JsonAllocator *allocator);
+bool json_array_set(JsonValue *array, size_t index, const JsonValue *value,
+                    const JsonAllocator *allocator);
+bool json_array_erase(JsonValue *array, size_t index,
+                      const JsonAllocator *allocator);
+
+// Deep copy into allocator with exactly sized, owned storage; copy may be
+// value itself.
+bool json_value_copy(JsonValue *copy, const JsonValue *value,
+                     const JsonAllocator *allocator);
+// Deep copy into allocator as a single allocation, sized by a counting walk
+// of value, for copying one subtree into many documents or arenas. The clone
+// is released like any other value and can be moved into a container of a
+// document using the same allocator. Edits work too, though the first insert
+// or removal on the clone's root may copy the whole subtree out of the
+// block (see JSON_VALUE_CLONE).
+bool json_clone(JsonValue *clone, const JsonValue *value,
+                const JsonAllocator *allocator);
+void json_value_replace(JsonValue *target, const JsonValue *value,
+                        const JsonAllocator *allocator);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// JSON_FILE_HUGE_PAGES asks the kernel to back the mapping with huge pages
+// where the filesystem supports it. JSON_FILE_COPY_STRINGS turns off the
+// default zero-copy string views, so every string owns a terminated copy.
+typedef enum {
+    JSON_FILE_HUGE_PAGES = 1 << 0,
+    JSON_FILE_COPY_STRINGS = 1 << 1,
+} JsonFileFlags;
+
+// A parsed file. Unless JSON_FILE_COPY_STRINGS was given, string values are
+// borrowed views into data, so root must not outlive the JsonFile.
+typedef struct {
+        JsonObject *root;
+        const char *data;
+        size_t length;
+        const JsonAllocator *allocator;
+        bool mapped;
+} JsonFile;
+
+JsonFile *json_parse_file(const char *path, const JsonParseOptions *options,
+                          unsigned flags);
+void json_free_file(JsonFile *file);
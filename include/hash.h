@@ -0,0 +1,38 @@
+#pragma once
+
+#include "allocator.h"
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Remembers container hashes by the address of their children storage, so
+// shallow copies such as json_array_get results share entries. Entries go
+// stale when a container is edited in place; clear the cache after editing.
+typedef struct {
+        struct JsonHashEntry *entries;
+        size_t capacity;
+        size_t count;
+        const JsonAllocator *allocator;
+} JsonHashCache;
+
+void json_hash_cache_init(JsonHashCache *cache,
+                          const JsonAllocator *allocator);
+void json_hash_cache_clear(JsonHashCache *cache);
+void json_hash_cache_destroy(JsonHashCache *cache);
+
+// json_hash fingerprints a value from its content alone: it does not depend
+// on object member order, on how strings or arrays are stored, or on the
+// process, so hashes can be persisted and compared across runs. Equal values
+// hash equally (0 and -0 included).
+//
+// json_equal compares by value, ignoring object member order; duplicate keys
+// count as separate members, so objects are equal when they hold the same
+// multiset of key/value pairs, as json_hash sees them. With a cache,
+// containers whose hashes differ are rejected without being walked, and
+// every container is hashed at most once for as long as the cache lives.
+uint64_t json_hash(const JsonValue *value);
+uint64_t json_hash_ex(const JsonValue *value, JsonHashCache *cache);
+bool json_equal(const JsonValue *a, const JsonValue *b);
+bool json_equal_ex(const JsonValue *a, const JsonValue *b,
+                   JsonHashCache *cache);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "allocator.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// An interned key: hash and length are computed once, chars is
+// NUL-terminated. Object keys produced by interning point at chars.
+typedef struct {
+        uint64_t hash;
+        uint32_t length;
+        char chars[];
+} JsonKey;
+
+// Open-addressing table of interned keys. The table array comes from
+// allocator and survives json_key_table_clear; the keys themselves come from
+// the key_allocator passed to json_key_table_intern (typically an arena that
+// is reset together with the table).
+typedef struct {
+        JsonKey **entries;
+        size_t capacity;
+        size_t count;
+        const JsonAllocator *allocator;
+} JsonKeyTable;
+
+void json_key_table_init(JsonKeyTable *table, const JsonAllocator *allocator);
+const char *json_key_table_intern(JsonKeyTable *table,
+                                  const JsonAllocator *key_allocator,
+                                  const char *key, size_t length);
+void json_key_table_clear(JsonKeyTable *table);
+void json_key_table_destroy(JsonKeyTable *table);
+
+uint64_t json_hash_bytes(const char *data, size_t length);
+
+static inline const JsonKey *json_key_of(const char *interned_key) {
+    return (const JsonKey *)(interned_key - offsetof(JsonKey, chars));
+}
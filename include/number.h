@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Converts a number token that the tokenizer has already validated. Returns
+// false when the value cannot be produced exactly without a full conversion
+// (more than 19 significant digits or a large exponent); callers then fall
+// back to strtod.
+bool json_number_parse_fast(const char *input, size_t length, double *number);
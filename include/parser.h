@@ -1,8 +1,12 @@
 #pragma once
 
+#include "../include/allocator.h"
+#include "../include/intern.h"
+#include "../include/stats.h"
 #include "../include/tokenizer.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     JSON_STRING,
@@ -14,29 +18,209 @@ typedef enum {
 } JsonType;
 
 typedef struct JsonValue JsonValue;
+typedef struct JsonMember JsonMember;
+typedef struct JsonParser JsonParser;
 
+// Children are stored by value: an object's members interleave each key with
+// its value node and an array's elements are one array of nodes, so a scan
+// over a container walks a single allocation. Objects parsed with interned
+// keys also get a shape, shared by sibling records with the same key
+// sequence (NULL otherwise): objects with the same non-NULL shape have the
+// same keys in the same order, which json_equal and json_diff use to pair
+// members without comparing keys. Copies and edited objects have none.
+//
+// Shaped records still keep a key pointer beside each value rather than
+// being stored as values plus one shared key array: that costs 8 bytes per
+// member (about 16% of a parsed array of small records) but lets every
+// object be read through the same members array. The shape pointer itself
+// is free, as JsonArray already makes the value union 24 bytes.
 typedef struct {
-        char **keys;
-        JsonValue **values;
+        JsonMember *members;
         size_t size;
+        const JsonMember *shape;
 } JsonObject;
 
+// Arrays whose elements are all numbers or all booleans are stored without
+// per-element nodes: numbers as a contiguous double buffer, booleans as bits
+// (least significant first). json_array_get reads any kind.
+typedef enum {
+    JSON_ARRAY_VALUES,
+    JSON_ARRAY_NUMBERS,
+    JSON_ARRAY_BOOLS,
+} JsonArrayKind;
+
 typedef struct {
-        JsonValue **values;
+        union {
+                JsonValue *values;
+                double *numbers;
+                uint8_t *bools;
+        };
         size_t size;
+        JsonArrayKind kind;
 } JsonArray;
 
+// JSON_VALUE_BORROWED marks a value whose storage it does not own: a
+// borrowed string points into the parsed input, is not NUL-terminated and
+// must be read through string_length. JSON_VALUE_INTERNED_KEYS marks an
+// object whose keys are shared JsonKey entries (see intern.h): equal keys are
+// the same pointer and json_key_of gives their hash and length.
+// JSON_VALUE_INLINE marks a string of at most JSON_SHORT_STRING_MAX bytes
+// stored in the node itself; json_string reads either representation.
+// JSON_VALUE_GROWABLE marks a container edited through edit.h, whose storage
+// has spare capacity.
+// JSON_VALUE_CLONE marks the root of a json_clone copy: its storage is one
+// block holding the whole subtree, whose containers and strings are marked
+// JSON_VALUE_BORROWED, so releasing the root frees a single allocation.
+//
+// free_json_value trusts these flags, so a JsonValue built by hand must have
+// flags zeroed (with calloc or a designated initializer, which also zeroes
+// an array's kind) unless it really is inline, borrowed or interned;
+// json_value_init_string and the edit.h functions set them for you.
+typedef enum {
+    JSON_VALUE_BORROWED = 1 << 0,
+    JSON_VALUE_INTERNED_KEYS = 1 << 1,
+    JSON_VALUE_INLINE = 1 << 2,
+    JSON_VALUE_GROWABLE = 1 << 3,
+    JSON_VALUE_CLONE = 1 << 4,
+} JsonValueFlags;
+
+#define JSON_SHORT_STRING_MAX 22
+
+// The union comes first so a JsonObject returned by json_parse shares its
+// address with the JsonValue that owns it.
 struct JsonValue {
-        JsonType type;
         union {
-                char *string;
+                struct {
+                        char *string;
+                        size_t string_length;
+                };
+                struct {
+                        char short_string[JSON_SHORT_STRING_MAX + 1];
+                        uint8_t short_string_length;
+                };
                 double number;
                 bool boolean;
                 JsonArray array;
                 JsonObject object;
                 void *null;
         };
+        JsonType type;
+        unsigned flags;
 };
 
+struct JsonMember {
+        char *key;
+        JsonValue value;
+};
+
+typedef struct {
+        const JsonArray *array;
+        size_t index;
+} JsonArrayIterator;
+
+// Containers nested deeper than max_depth fail the parse; 0 means
+// JSON_DEFAULT_MAX_DEPTH and larger values are clamped to JSON_MAX_DEPTH.
+// The parser keeps open containers on a heap stack, but releasing, copying,
+// hashing, comparing and diffing a value recurse once per level; at
+// JSON_MAX_DEPTH they need under 1 MiB of C stack in an optimized build
+// (2 MiB unoptimized). Documents built by hand through edit.h should stay
+// within it too.
+#define JSON_DEFAULT_MAX_DEPTH 1024
+#define JSON_MAX_DEPTH 4096
+
+typedef struct {
+        const JsonAllocator *allocator;
+        JsonParseStats *stats;
+        size_t max_depth;
+        bool validate_utf8;
+        bool borrow_strings;
+} JsonParseOptions;
+
+// Parses a document whose top level is an object.
 JsonObject *json_parse(const char *input, size_t input_length);
+JsonObject *json_parse_ex(const char *input, size_t input_length,
+                          const JsonParseOptions *options);
+// Like json_parse, but the document may be any JSON value, not only an
+// object.
+JsonValue *json_parse_value(const char *input, size_t input_length);
+JsonValue *json_parse_value_ex(const char *input, size_t input_length,
+                               const JsonParseOptions *options);
+// The nesting limit options give, after defaulting and clamping.
+size_t json_parse_max_depth(const JsonParseOptions *options);
+
+// A JsonParser keeps its node arena, scratch stacks and number buffer between
+// documents. Values it returns live in the parser's arena until
+// json_parser_reset, which recycles that memory without releasing it, so
+// steady-state parsing of similarly sized documents makes no allocator calls.
+// options->allocator backs the arena; options->stats is filled per parse.
+// Object keys are interned per parser until json_parser_reset, and
+// json_parser_intern returns the same pointer for a key the documents use,
+// so lookups can compare keys by address.
+JsonParser *json_parser_create(const JsonParseOptions *options);
+JsonObject *json_parser_parse(JsonParser *parser, const char *input,
+                              size_t input_length);
+void json_parser_reset(JsonParser *parser);
+const char *json_parser_intern(JsonParser *parser, const char *key,
+                               size_t length);
+const JsonAllocator *json_parser_allocator(JsonParser *parser);
+void json_parser_destroy(JsonParser *parser);
+
+// A JsonPushParser builds one document from input that arrives in pieces,
+// keeping its open containers on the same explicit stack as the other parse
+// functions, so an event loop can hand over each buffer as it is read and
+// never block on or hold the whole body. A token split between two pieces is
+// the only input copied: its bytes so far are kept until the rest arrives.
+//
+// json_push_parser_feed works through input until it runs out, returning
+// JSON_PUSH_NEED_MORE, or until budget tokens (0 for no limit) have been
+// handled, returning JSON_PUSH_SUSPENDED; *consumed says how much of input
+// was used, and the rest is fed again later. input need not outlive the call.
+// After the last piece, json_push_parser_finish checks that exactly one value
+// was given and returns JSON_PUSH_DONE, then json_push_parser_take hands the
+// document over (free it with free_json_value_ex and options->allocator) and
+// readies the parser for the next one. Any syntax error or allocation failure
+// returns JSON_PUSH_ERROR from then on, until json_push_parser_reset drops the
+// partial document. Any value is accepted at the top level, as with
+// json_parse_value; strings are always copied, so borrow_strings and stats
+// are ignored.
+typedef struct JsonPushParser JsonPushParser;
+
+typedef enum {
+    JSON_PUSH_NEED_MORE,
+    JSON_PUSH_SUSPENDED,
+    JSON_PUSH_DONE,
+    JSON_PUSH_ERROR,
+} JsonPushStatus;
+
+JsonPushParser *json_push_parser_create(const JsonParseOptions *options);
+JsonPushStatus json_push_parser_feed(JsonPushParser *parser, const char *input,
+                                     size_t input_length, size_t budget,
+                                     size_t *consumed);
+JsonPushStatus json_push_parser_finish(JsonPushParser *parser);
+JsonValue *json_push_parser_take(JsonPushParser *parser);
+void json_push_parser_reset(JsonPushParser *parser);
+void json_push_parser_destroy(JsonPushParser *parser);
+
+// json_string returns a string value's bytes and length, whether inline,
+// owned or borrowed. json_array_get returns elements by value; for
+// JSON_ARRAY_VALUES it is a shallow copy of the element node.
+// json_array_numbers is NULL unless the array is JSON_ARRAY_NUMBERS.
+// json_array_next walks any array kind:
+//
+//     JsonArrayIterator it = {&array, 0};
+//     JsonValue element;
+//     while (json_array_next(&it, &element)) { ... }
+//
+// Objects are walked directly over members[0..size).
+const char *json_string(const JsonValue *value, size_t *length);
+size_t json_array_size(const JsonArray *array);
+JsonValue json_array_get(const JsonArray *array, size_t index);
+const double *json_array_numbers(const JsonArray *array);
+bool json_array_next(JsonArrayIterator *iterator, JsonValue *element);
+JsonValue *json_object_get(const JsonObject *object, const char *key);
+
 void free_json_value(JsonValue *value);
+void free_json_value_ex(JsonValue *value, const JsonAllocator *allocator);
+// Frees what a value owns but not the node itself, for nodes embedded in a
+// parent's children or on the stack.
+void json_value_release(JsonValue *value, const JsonAllocator *allocator);
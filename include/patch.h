@@ -0,0 +1,34 @@
+#pragma once
+
+#include "allocator.h"
+#include "deserializer.h"
+#include "parser.h"
+#include <stdbool.h>
+
+typedef struct JsonPatch JsonPatch;
+
+// RFC 6902 JSON Patch, compiled once from the parsed operations array (see
+// json_parse_value) and applied to any number of documents. Compiling splits
+// and unescapes every path, parses array indices and copies operation
+// values; each operation also records how many leading path segments it
+// shares with the previous one, so a batch of edits to the same region walks
+// the common prefix once.
+//
+// json_patch_apply edits the document in place through edit.h, allocating
+// from the document's allocator (NULL for the default). It stops at the
+// first failing operation and reports that operation's path in error->key;
+// operations before it stay applied, so callers that need the RFC's
+// all-or-nothing behaviour apply to a copy.
+JsonPatch *json_patch_compile(const JsonValue *operations,
+                              const JsonAllocator *allocator,
+                              JsonError *error);
+bool json_patch_apply(const JsonPatch *patch, JsonValue *document,
+                      const JsonAllocator *allocator, JsonError *error);
+void json_patch_free(JsonPatch *patch);
+
+// RFC 7386 JSON Merge Patch: members of an object patch are merged
+// recursively, null members remove keys and any other patch replaces the
+// target. The patch is only read, so one patch can be merged into many
+// documents.
+bool json_merge_patch_apply(JsonValue *document, const JsonValue *patch,
+                            const JsonAllocator *allocator);
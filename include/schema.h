@@ -0,0 +1,36 @@
+#pragma once
+
+#include "allocator.h"
+#include "deserializer.h"
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct JsonSchema JsonSchema;
+
+// A subset of JSON Schema, compiled once from the parsed schema document and
+// checked against raw input in a single pass over the token stream, without
+// building JsonValue nodes. Supported keywords are type (including
+// "integer"), properties, required, additionalProperties, items (a single
+// schema), enum and const (scalar values), minimum, maximum,
+// exclusiveMinimum, exclusiveMaximum, minLength, maxLength, minItems and
+// maxItems; true and false are accepted as schemas. Annotations such as
+// title and description are ignored and any other keyword fails the
+// compile, so a schema is never silently weaker than written.
+//
+// Strings are compared as written, like the parser keeps them: an enum
+// string only matches input spelled with the same escapes. Lengths count
+// code points, an escape sequence counting as one.
+//
+// Validation recurses only as deep as the schema; values the schema does
+// not constrain are checked as json_skip_value checks them, up to
+// JSON_SCHEMA_MAX_DEPTH levels. error->key is the property whose value
+// failed (NULL at the top level) and the message gives the line and column.
+#define JSON_SCHEMA_MAX_DEPTH JSON_MAX_DEPTH
+
+JsonSchema *json_schema_compile(const JsonValue *schema,
+                                const JsonAllocator *allocator,
+                                JsonError *error);
+bool json_schema_validate(const JsonSchema *schema, const char *input,
+                          size_t input_length, JsonError *error);
+void json_schema_free(JsonSchema *schema);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "allocator.h"
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A snapshot is a parsed document written out as position-independent
+// nodes: children are referenced by node index and strings by offset into a
+// NUL-terminated string pool, so a loaded file is read in place with no
+// parsing step and the mapping can be shared read-only between processes.
+// Snapshots use the byte order of the machine that wrote them.
+//
+// JSON_SNAPSHOT_KEY_INDEX (save) adds a sorted key index to larger objects
+// so json_snapshot_get can binary search them. JSON_SNAPSHOT_VERIFY (load)
+// checks every node reference once, for files that may not come from
+// json_document_save; without it only the header is checked.
+typedef enum {
+    JSON_SNAPSHOT_KEY_INDEX = 1 << 0,
+    JSON_SNAPSHOT_VERIFY = 1 << 1,
+} JsonSnapshotFlags;
+
+// size is the string length, or the element or member count. An array's
+// elements are nodes first..first+size; an object's member i is the key node
+// first+2i followed by its value node.
+typedef struct {
+        uint32_t type;
+        uint32_t size;
+        union {
+                double number;
+                uint64_t boolean;
+                uint64_t string;
+                struct {
+                        uint32_t first;
+                        uint32_t index;
+                };
+        };
+} JsonSnapshotNode;
+
+typedef struct JsonSnapshot JsonSnapshot;
+
+bool json_document_save(const JsonObject *root, const char *path,
+                        unsigned flags);
+JsonSnapshot *json_document_load(const char *path,
+                                 const JsonAllocator *allocator,
+                                 unsigned flags);
+void json_snapshot_close(JsonSnapshot *snapshot);
+
+const JsonSnapshotNode *json_snapshot_root(const JsonSnapshot *snapshot);
+const char *json_snapshot_string(const JsonSnapshot *snapshot,
+                                 const JsonSnapshotNode *node,
+                                 size_t *length);
+const JsonSnapshotNode *json_snapshot_element(const JsonSnapshot *snapshot,
+                                              const JsonSnapshotNode *array,
+                                              size_t index);
+const JsonSnapshotNode *json_snapshot_member(const JsonSnapshot *snapshot,
+                                             const JsonSnapshotNode *object,
+                                             size_t index, const char **key,
+                                             size_t *key_length);
+const JsonSnapshotNode *json_snapshot_get(const JsonSnapshot *snapshot,
+                                          const JsonSnapshotNode *object,
+                                          const char *key, size_t length);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "tokenizer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Parse statistics are only collected when the library is built with
+// -DJSONIC_STATS. Without it every JSON_STATS_* macro expands to nothing and
+// the hot paths carry no instrumentation at all; a JsonParseStats passed to
+// the API is simply zeroed.
+//
+// json_parse_ex resets the struct before parsing, json_to_struct_ex adds to
+// it, so one JsonParseStats can cover a parse followed by deserialization.
+
+typedef enum {
+    JSON_PHASE_TOKENIZE,
+    JSON_PHASE_BUILD,
+    JSON_PHASE_DESERIALIZE,
+    JSON_PHASE_COUNT
+} JsonPhase;
+
+typedef struct {
+        size_t bytes_consumed;
+        size_t token_counts[TOKEN_INVALID + 1];
+        size_t max_depth;
+        size_t allocations;
+        size_t bytes_allocated;
+        size_t strings_copied;
+        size_t strings_borrowed;
+        uint64_t phase_cycles[JSON_PHASE_COUNT];
+} JsonParseStats;
+
+bool json_stats_enabled(void);
+
+#ifdef JSONIC_STATS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t json_stats_cycles(void) { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t json_stats_cycles(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#define JSON_STATS_ADD(stats, field, n)                                        \
+    do {                                                                       \
+        if (stats) {                                                           \
+            (stats)->field += (n);                                             \
+        }                                                                      \
+    } while (0)
+
+#define JSON_STATS_MAX(stats, field, n)                                        \
+    do {                                                                       \
+        if ((stats) && (stats)->field < (n)) {                                 \
+            (stats)->field = (n);                                              \
+        }                                                                      \
+    } while (0)
+
+#define JSON_STATS_ALLOC(stats, size)                                          \
+    do {                                                                       \
+        if (stats) {                                                           \
+            (stats)->allocations++;                                            \
+            (stats)->bytes_allocated += (size);                                \
+        }                                                                      \
+    } while (0)
+
+#define JSON_STATS_TIMER_START(name) uint64_t name = json_stats_cycles()
+
+#define JSON_STATS_TIMER_STOP(stats, phase, name)                              \
+    JSON_STATS_ADD(stats, phase_cycles[phase], json_stats_cycles() - (name))
+
+#else
+
+#define JSON_STATS_ADD(stats, field, n) ((void)0)
+#define JSON_STATS_MAX(stats, field, n) ((void)0)
+#define JSON_STATS_ALLOC(stats, size) ((void)0)
+#define JSON_STATS_TIMER_START(name) ((void)0)
+#define JSON_STATS_TIMER_STOP(stats, phase, name) ((void)0)
+
+#endif
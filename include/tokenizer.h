@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     TOKEN_LEFT_BRACE,
@@ -19,12 +20,22 @@ typedef enum {
     TOKEN_INVALID
 } JsonTokenType;
 
+// JSON_TOKENIZER_LAZY_POSITIONS tracks only the byte offset while scanning.
+// Tokens then report line and column 0; json_tokenizer_position recovers
+// them for an offset when a diagnostic actually needs them.
+// JSON_TOKENIZER_VALIDATE_UTF8 rejects strings that are not valid UTF-8.
+typedef enum {
+    JSON_TOKENIZER_LAZY_POSITIONS = 1 << 0,
+    JSON_TOKENIZER_VALIDATE_UTF8 = 1 << 1,
+} JsonTokenizerFlags;
+
 typedef struct {
         const char *input;
         size_t input_length;
         size_t pos;
         size_t line;
         size_t column;
+        unsigned flags;
 } JsonTokenizerCtx;
 
 typedef struct {
@@ -35,5 +46,26 @@ typedef struct {
         size_t column;
 } JsonToken;
 
+#define JSON_COMPACT_TOKEN_MAX_LENGTH ((1u << 28) - 1)
+
+// 8-byte token produced by json_tokenizer_next_batch. offset is relative to
+// ctx->pos at the time of the batch call.
+typedef struct {
+        uint32_t offset;
+        uint32_t type : 4;
+        uint32_t length : 28;
+} JsonCompactToken;
+
 JsonTokenizerCtx json_tokenizer_init(const char *json_input, size_t length);
+JsonTokenizerCtx json_tokenizer_init_ex(const char *json_input, size_t length,
+                                        unsigned flags);
 JsonToken json_tokenizer_next(JsonTokenizerCtx *ctx);
+// Fills tokens up to capacity, stopping after EOF or an invalid token. A
+// token that does not fit a JsonCompactToken (longer than
+// JSON_COMPACT_TOKEN_MAX_LENGTH, or too far past ctx->pos) ends the batch
+// without being consumed; when it is the first token the batch is empty and
+// the caller reads it with json_tokenizer_next.
+size_t json_tokenizer_next_batch(JsonTokenizerCtx *ctx,
+                                 JsonCompactToken *tokens, size_t capacity);
+void json_tokenizer_position(const JsonTokenizerCtx *ctx, size_t offset,
+                             size_t *line, size_t *column);
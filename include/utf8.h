@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Returns true when data[0, length) is well-formed UTF-8 (no overlong forms,
+// surrogates or code points above U+10FFFF). Uses the Keiser-Lemire range
+// lookup algorithm on CPUs with SSSE3 and a scalar decoder elsewhere.
+bool json_utf8_validate(const char *data, size_t length);
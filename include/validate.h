@@ -0,0 +1,35 @@
+#pragma once
+
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Where and why validation stopped. offset is in bytes from the start of the
+// input; line and column count from 1. message is a static string.
+typedef struct {
+        size_t offset;
+        size_t line;
+        size_t column;
+        const char *message;
+} JsonSyntaxError;
+
+// Checks that input is exactly one JSON value, accepting what
+// json_parse_value_ex would with the same options, without building nodes:
+// tokens are scanned in batches and open containers are tracked as one bit
+// each. Of the options only max_depth, validate_utf8 and allocator apply; the
+// allocator is only used for a number of 512 bytes or more that ends the
+// input, which strtod needs terminated. Numbers outside the range of a double
+// are rejected as the parser rejects them. Line and column are only worked
+// out once an error is found.
+bool json_validate(const char *input, size_t input_length,
+                   JsonSyntaxError *error);
+bool json_validate_ex(const char *input, size_t input_length,
+                      const JsonParseOptions *options, JsonSyntaxError *error);
+
+// Checks the rest of the value that starts at token, which has just been
+// read from tokenizer, the same way, and leaves the tokenizer right after
+// it. This is how the token-stream readers step over values they do not
+// keep. UTF-8 checking follows the tokenizer's own flags rather than
+// options, and offset in error counts from the start of its input.
+bool json_skip_value(JsonTokenizerCtx *tokenizer, const JsonToken *token,
+                     const JsonParseOptions *options, JsonSyntaxError *error);
@@ -0,0 +1,47 @@
+#include "../include/allocator.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void *default_alloc(void *ctx, size_t size);
+static void *default_realloc(void *ctx, void *ptr, size_t size);
+static void default_free(void *ctx, void *ptr);
+
+static const JsonAllocator default_allocator = {
+    .alloc = default_alloc,
+    .realloc = default_realloc,
+    .free = default_free,
+    .ctx = NULL,
+};
+
+const JsonAllocator *json_default_allocator(void) { return &default_allocator; }
+
+char *json_allocator_strndup(const JsonAllocator *allocator, const char *string,
+                             size_t length) {
+    if (!allocator) {
+        allocator = &default_allocator;
+    }
+
+    char *copy = allocator->alloc(allocator->ctx, length + 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+static void *default_alloc(void *ctx, size_t size) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void *default_realloc(void *ctx, void *ptr, size_t size) {
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+static void default_free(void *ctx, void *ptr) {
+    (void)ctx;
+    free(ptr);
+}
@@ -0,0 +1,176 @@
+#include "../include/arena.h"
+#include "../include/allocator.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT sizeof(void *)
+#define ARENA_DEFAULT_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_GROWTH 64
+
+struct JsonArenaChunk {
+        JsonArenaChunk *next;
+        size_t capacity;
+        size_t used;
+        max_align_t data[];
+};
+
+static void *arena_alloc(void *ctx, size_t size);
+static void *arena_realloc(void *ctx, void *ptr, size_t size);
+static void arena_free(void *ctx, void *ptr);
+static JsonArenaChunk *arena_find_chunk(JsonArena *arena, const void *ptr);
+static size_t align_size(size_t size);
+
+void json_arena_init(JsonArena *arena, const JsonAllocator *backing,
+                     size_t chunk_size) {
+    *arena = (JsonArena){
+        .head = NULL,
+        .current = NULL,
+        .last = NULL,
+        .chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE,
+        .backing = backing ? backing : json_default_allocator(),
+        .allocator =
+            {
+                .alloc = arena_alloc,
+                .realloc = arena_realloc,
+                .free = arena_free,
+                .ctx = arena,
+            },
+    };
+}
+
+void *json_arena_alloc(JsonArena *arena, size_t size) {
+    size = align_size(size);
+
+    // Walk forward through chunks retained by a previous reset before asking
+    // the backing allocator for more memory.
+    JsonArenaChunk *chunk = arena->current;
+    while (chunk && chunk->capacity - chunk->used < size) {
+        chunk = chunk->next;
+    }
+
+    if (!chunk) {
+        size_t capacity = arena->chunk_size;
+        if (capacity < size) {
+            capacity = size;
+        }
+
+        chunk = arena->backing->alloc(arena->backing->ctx,
+                                      sizeof(JsonArenaChunk) + capacity);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->capacity = capacity;
+        chunk->used = 0;
+
+        if (arena->current) {
+            chunk->next = arena->current->next;
+            arena->current->next = chunk;
+        } else {
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+
+        size_t max_chunk_size = ARENA_DEFAULT_CHUNK_SIZE * ARENA_MAX_CHUNK_GROWTH;
+        if (arena->chunk_size < max_chunk_size) {
+            arena->chunk_size *= 2;
+        }
+    }
+
+    arena->current = chunk;
+    arena->last = (char *)chunk->data + chunk->used;
+    chunk->used += size;
+
+    return arena->last;
+}
+
+void json_arena_reset(JsonArena *arena) {
+    for (JsonArenaChunk *chunk = arena->head; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->head;
+    arena->last = NULL;
+}
+
+void json_arena_destroy(JsonArena *arena) {
+    JsonArenaChunk *chunk = arena->head;
+    while (chunk) {
+        JsonArenaChunk *next = chunk->next;
+        arena->backing->free(arena->backing->ctx, chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->last = NULL;
+}
+
+size_t json_arena_capacity(const JsonArena *arena) {
+    size_t capacity = 0;
+    for (JsonArenaChunk *chunk = arena->head; chunk; chunk = chunk->next) {
+        capacity += chunk->capacity;
+    }
+    return capacity;
+}
+
+const JsonAllocator *json_arena_allocator(JsonArena *arena) {
+    return &arena->allocator;
+}
+
+static void *arena_alloc(void *ctx, size_t size) {
+    return json_arena_alloc(ctx, size);
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t size) {
+    JsonArena *arena = ctx;
+    if (!ptr) {
+        return json_arena_alloc(arena, size);
+    }
+
+    JsonArenaChunk *chunk = arena_find_chunk(arena, ptr);
+    if (!chunk) {
+        return NULL;
+    }
+
+    // Allocations carry no size header. Everything between ptr and the end
+    // of the chunk's used region belongs to ptr or to later allocations, so
+    // it bounds the old size well enough to copy. The most recent allocation
+    // can simply be extended in place.
+    size_t offset = (size_t)((char *)ptr - (char *)chunk->data);
+    size_t available = chunk->used - offset;
+    size = align_size(size);
+
+    if (ptr == arena->last && offset + size <= chunk->capacity) {
+        chunk->used = offset + size;
+        return ptr;
+    }
+
+    void *new_ptr = json_arena_alloc(arena, size);
+    if (!new_ptr) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, available < size ? available : size);
+
+    return new_ptr;
+}
+
+static void arena_free(void *ctx, void *ptr) {
+    (void)ctx;
+    (void)ptr;
+}
+
+static JsonArenaChunk *arena_find_chunk(JsonArena *arena, const void *ptr) {
+    for (JsonArenaChunk *chunk = arena->head; chunk; chunk = chunk->next) {
+        const char *data = (const char *)chunk->data;
+        if ((const char *)ptr >= data && (const char *)ptr < data + chunk->used) {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+static size_t align_size(size_t size) {
+    if (size == 0) {
+        return ARENA_ALIGNMENT;
+    }
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
@@ -0,0 +1,351 @@
+#include "../include/cache.h"
+#include "../include/allocator.h"
+#include "../include/arena.h"
+#include "../include/parser.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CACHE_ARENA_CHUNK_SIZE 16384
+#define CACHE_INITIAL_BUCKETS 64
+
+// input is a copy of the parsed bytes, kept in the arena, so that a hit is
+// confirmed byte for byte rather than trusted to the hash.
+struct JsonCacheHandle {
+        uint64_t hash;
+        size_t length;
+        const char *input;
+        JsonObject *root;
+        JsonArena arena;
+        size_t bytes;
+        atomic_size_t refs;
+        const JsonAllocator *allocator;
+        JsonCacheHandle *bucket_next;
+        JsonCacheHandle *lru_prev;
+        JsonCacheHandle *lru_next;
+};
+
+// Entries are linked into a hash bucket and into the LRU list, most
+// recently used first. The cache itself holds one reference per entry.
+struct JsonCache {
+        pthread_mutex_t mutex;
+        JsonCacheHandle **buckets;
+        size_t bucket_count;
+        JsonCacheHandle *lru_head;
+        JsonCacheHandle *lru_tail;
+        size_t max_bytes;
+        JsonCacheStats stats;
+        JsonParseOptions options;
+        const JsonAllocator *allocator;
+};
+
+static uint64_t hash_input(const char *input, size_t length);
+static JsonCacheHandle *cache_lookup(JsonCache *cache, uint64_t hash,
+                                     const char *input, size_t length);
+static bool cache_insert(JsonCache *cache, JsonCacheHandle *entry);
+static void cache_unlink(JsonCache *cache, JsonCacheHandle *entry);
+static void lru_push_front(JsonCache *cache, JsonCacheHandle *entry);
+static void lru_remove(JsonCache *cache, JsonCacheHandle *entry);
+static JsonCacheHandle *entry_create(JsonCache *cache, const char *input,
+                                     size_t input_length, uint64_t hash);
+static void entry_destroy(JsonCacheHandle *entry);
+
+JsonCache *json_cache_create(size_t max_bytes,
+                             const JsonParseOptions *options) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+
+    JsonCache *cache = allocator->alloc(allocator->ctx, sizeof(JsonCache));
+    if (!cache) {
+        return NULL;
+    }
+    *cache = (JsonCache){
+        .bucket_count = CACHE_INITIAL_BUCKETS,
+        .max_bytes = max_bytes,
+        .options = options ? *options : (JsonParseOptions){0},
+        .allocator = allocator,
+    };
+    // Documents are shared between threads, so they must own their strings
+    // and nobody may collect stats into a shared struct.
+    cache->options.stats = NULL;
+    cache->options.borrow_strings = false;
+
+    cache->buckets = allocator->alloc(
+        allocator->ctx, sizeof(JsonCacheHandle *) * cache->bucket_count);
+    if (!cache->buckets || pthread_mutex_init(&cache->mutex, NULL) != 0) {
+        allocator->free(allocator->ctx, cache->buckets);
+        allocator->free(allocator->ctx, cache);
+        return NULL;
+    }
+    memset(cache->buckets, 0,
+           sizeof(JsonCacheHandle *) * cache->bucket_count);
+
+    return cache;
+}
+
+JsonCacheHandle *json_cache_parse(JsonCache *cache, const char *input,
+                                  size_t input_length) {
+    uint64_t hash = hash_input(input, input_length);
+
+    pthread_mutex_lock(&cache->mutex);
+    JsonCacheHandle *entry = cache_lookup(cache, hash, input, input_length);
+    if (entry) {
+        atomic_fetch_add(&entry->refs, 1);
+        lru_remove(cache, entry);
+        lru_push_front(cache, entry);
+        cache->stats.hits++;
+    } else {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    if (entry) {
+        return entry;
+    }
+
+    // Parse outside the lock so misses on different documents proceed in
+    // parallel.
+    JsonCacheHandle *created = entry_create(cache, input, input_length, hash);
+    if (!created) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = cache_lookup(cache, hash, input, input_length);
+    if (entry) {
+        // Another thread parsed the same document in the meantime.
+        atomic_fetch_add(&entry->refs, 1);
+    } else if (created->bytes <= cache->max_bytes &&
+               cache_insert(cache, created)) {
+        entry = created;
+        created = NULL;
+        while (cache->stats.bytes > cache->max_bytes &&
+               cache->lru_tail != entry) {
+            JsonCacheHandle *victim = cache->lru_tail;
+            cache_unlink(cache, victim);
+            cache->stats.evictions++;
+            json_cache_release(victim);
+        }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    // Documents too large to cache are handed out uncached.
+    if (!entry) {
+        return created;
+    }
+    if (created) {
+        json_cache_release(created);
+    }
+    return entry;
+}
+
+const JsonObject *json_cache_root(const JsonCacheHandle *handle) {
+    return handle->root;
+}
+
+JsonCacheHandle *json_cache_retain(JsonCacheHandle *handle) {
+    atomic_fetch_add(&handle->refs, 1);
+    return handle;
+}
+
+void json_cache_release(JsonCacheHandle *handle) {
+    if (handle && atomic_fetch_sub(&handle->refs, 1) == 1) {
+        entry_destroy(handle);
+    }
+}
+
+void json_cache_stats(JsonCache *cache, JsonCacheStats *stats) {
+    pthread_mutex_lock(&cache->mutex);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void json_cache_destroy(JsonCache *cache) {
+    if (!cache) {
+        return;
+    }
+
+    while (cache->lru_head) {
+        JsonCacheHandle *entry = cache->lru_head;
+        cache_unlink(cache, entry);
+        json_cache_release(entry);
+    }
+
+    const JsonAllocator *allocator = cache->allocator;
+    pthread_mutex_destroy(&cache->mutex);
+    allocator->free(allocator->ctx, cache->buckets);
+    allocator->free(allocator->ctx, cache);
+}
+
+static uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Four independent multiply-rotate lanes over 32-byte blocks (the XXH64
+// round), so hashing a multi-megabyte payload runs at memory speed.
+static uint64_t hash_input(const char *input, size_t length) {
+    const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t prime3 = 0x165667B19E3779F9ull;
+    uint64_t lanes[4] = {prime1 + prime2, prime2, 0, -prime1};
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, input + i + lane * 8, sizeof(word));
+            lanes[lane] =
+                rotate_left(lanes[lane] + word * prime2, 31) * prime1;
+        }
+    }
+
+    uint64_t hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) +
+                    rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18) +
+                    (uint64_t)length;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, input + i, sizeof(word));
+        hash ^= rotate_left(word * prime2, 31) * prime1;
+        hash = rotate_left(hash, 27) * prime1 + prime3;
+    }
+    for (; i < length; i++) {
+        hash ^= (unsigned char)input[i] * prime3;
+        hash = rotate_left(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static JsonCacheHandle *cache_lookup(JsonCache *cache, uint64_t hash,
+                                     const char *input, size_t length) {
+    JsonCacheHandle *entry =
+        cache->buckets[hash & (cache->bucket_count - 1)];
+    while (entry && (entry->hash != hash || entry->length != length ||
+                     memcmp(entry->input, input, length) != 0)) {
+        entry = entry->bucket_next;
+    }
+    return entry;
+}
+
+static bool cache_insert(JsonCache *cache, JsonCacheHandle *entry) {
+    if (cache->stats.entries >= cache->bucket_count) {
+        const JsonAllocator *allocator = cache->allocator;
+        size_t bucket_count = cache->bucket_count * 2;
+        JsonCacheHandle **buckets = allocator->alloc(
+            allocator->ctx, sizeof(JsonCacheHandle *) * bucket_count);
+        if (!buckets) {
+            return false;
+        }
+        memset(buckets, 0, sizeof(JsonCacheHandle *) * bucket_count);
+
+        for (size_t i = 0; i < cache->bucket_count; i++) {
+            JsonCacheHandle *next;
+            for (JsonCacheHandle *e = cache->buckets[i]; e; e = next) {
+                next = e->bucket_next;
+                size_t bucket = e->hash & (bucket_count - 1);
+                e->bucket_next = buckets[bucket];
+                buckets[bucket] = e;
+            }
+        }
+        allocator->free(allocator->ctx, cache->buckets);
+        cache->buckets = buckets;
+        cache->bucket_count = bucket_count;
+    }
+
+    size_t bucket = entry->hash & (cache->bucket_count - 1);
+    entry->bucket_next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    lru_push_front(cache, entry);
+    cache->stats.entries++;
+    cache->stats.bytes += entry->bytes;
+
+    // One reference for the cache, one for the caller.
+    atomic_fetch_add(&entry->refs, 1);
+    return true;
+}
+
+static void cache_unlink(JsonCache *cache, JsonCacheHandle *entry) {
+    JsonCacheHandle **link = &cache->buckets[entry->hash &
+                                             (cache->bucket_count - 1)];
+    while (*link != entry) {
+        link = &(*link)->bucket_next;
+    }
+    *link = entry->bucket_next;
+
+    lru_remove(cache, entry);
+    cache->stats.entries--;
+    cache->stats.bytes -= entry->bytes;
+}
+
+static void lru_push_front(JsonCache *cache, JsonCacheHandle *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->lru_prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+static void lru_remove(JsonCache *cache, JsonCacheHandle *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static JsonCacheHandle *entry_create(JsonCache *cache, const char *input,
+                                     size_t input_length, uint64_t hash) {
+    const JsonAllocator *allocator = cache->allocator;
+    JsonCacheHandle *entry =
+        allocator->alloc(allocator->ctx, sizeof(JsonCacheHandle));
+    if (!entry) {
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->length = input_length;
+    entry->allocator = allocator;
+    entry->bucket_next = NULL;
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+    atomic_init(&entry->refs, 1);
+    json_arena_init(&entry->arena, allocator, CACHE_ARENA_CHUNK_SIZE);
+
+    JsonParseOptions options = cache->options;
+    options.allocator = json_arena_allocator(&entry->arena);
+    entry->root = json_parse_ex(input, input_length, &options);
+    char *copy = entry->root ? json_arena_alloc(&entry->arena, input_length)
+                             : NULL;
+    if (!copy) {
+        entry_destroy(entry);
+        return NULL;
+    }
+    memcpy(copy, input, input_length);
+    entry->input = copy;
+    entry->bytes = json_arena_capacity(&entry->arena);
+
+    return entry;
+}
+
+static void entry_destroy(JsonCacheHandle *entry) {
+    const JsonAllocator *allocator = entry->allocator;
+    json_arena_destroy(&entry->arena);
+    allocator->free(allocator->ctx, entry);
+}
@@ -0,0 +1,442 @@
+#include "../include/columnar.h"
+#include "../include/allocator.h"
+#include "../include/stats.h"
+#include "../include/tokenizer.h"
+#include "../include/validate.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COLUMNS_INITIAL_ROWS 64
+
+// Per-column bookkeeping that does not belong in the result.
+typedef struct {
+        size_t key_length;
+        size_t seen_row;
+        size_t data_size;
+        size_t data_capacity;
+} ColumnBuilder;
+
+typedef struct {
+        JsonTokenizerCtx tokenizer;
+        const JsonColumnSpec *spec;
+        JsonColumns *columns;
+        ColumnBuilder *builders;
+        size_t row_capacity;
+        size_t last_column;
+        char *buffer;
+        size_t buffer_capacity;
+        JsonError *error;
+        const JsonAllocator *allocator;
+        const JsonParseOptions *options;
+        JsonParseStats *stats;
+} ColumnState;
+
+static bool extract_rows(ColumnState *state);
+static bool extract_row(ColumnState *state, size_t row);
+static bool store_value(ColumnState *state, size_t column, size_t row,
+                        const JsonToken *token);
+static size_t find_column(ColumnState *state, const JsonToken *key);
+static bool reserve_rows(ColumnState *state, size_t rows);
+static bool grow(ColumnState *state, void **ptr, size_t old_size,
+                 size_t new_size);
+static bool is_integer(const JsonToken *token);
+static bool copy_number(ColumnState *state, const JsonToken *token);
+static bool fail(ColumnState *state, const char *key, const char *format, ...);
+
+bool json_to_columns(const char *input, size_t input_length,
+                     const JsonColumnSpec *spec, size_t num_columns,
+                     JsonColumns *columns, JsonError *error,
+                     const JsonParseOptions *options) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+    unsigned flags = JSON_TOKENIZER_LAZY_POSITIONS;
+    if (options && options->validate_utf8) {
+        flags |= JSON_TOKENIZER_VALIDATE_UTF8;
+    }
+
+    ColumnState state = {
+        .tokenizer = json_tokenizer_init_ex(input, input_length, flags),
+        .spec = spec,
+        .columns = columns,
+        .error = error,
+        .allocator = allocator,
+        .options = options,
+        .stats = options ? options->stats : NULL,
+    };
+    JSON_STATS_TIMER_START(deserialize_start);
+
+    if (error) {
+        error->key = NULL;
+        error->message[0] = '\0';
+    }
+    *columns = (JsonColumns){
+        .columns = NULL,
+        .column_count = num_columns,
+        .row_count = 0,
+        .allocator = allocator,
+    };
+
+    bool ok = false;
+    if (num_columns > 0) {
+        columns->columns =
+            allocator->alloc(allocator->ctx, sizeof(JsonColumn) * num_columns);
+        state.builders = allocator->alloc(allocator->ctx,
+                                          sizeof(ColumnBuilder) * num_columns);
+        if (columns->columns) {
+            memset(columns->columns, 0, sizeof(JsonColumn) * num_columns);
+        }
+        if (!columns->columns || !state.builders) {
+            fail(&state, NULL, "Out of memory");
+            goto cleanup;
+        }
+        for (size_t i = 0; i < num_columns; i++) {
+            columns->columns[i].type = spec[i].type;
+            state.builders[i] = (ColumnBuilder){
+                .key_length = strlen(spec[i].key),
+                .seen_row = SIZE_MAX,
+            };
+        }
+    }
+
+    // Reserving up front also gives empty string columns their offsets[0].
+    ok = reserve_rows(&state, COLUMNS_INITIAL_ROWS) && extract_rows(&state);
+
+cleanup:
+    allocator->free(allocator->ctx, state.builders);
+    allocator->free(allocator->ctx, state.buffer);
+    if (!ok) {
+        json_free_columns(columns);
+    }
+
+    JSON_STATS_TIMER_STOP(state.stats, JSON_PHASE_DESERIALIZE,
+                          deserialize_start);
+    return ok;
+}
+
+void json_free_columns(JsonColumns *columns) {
+    if (!columns || !columns->allocator) {
+        return;
+    }
+
+    const JsonAllocator *allocator = columns->allocator;
+    for (size_t i = 0; columns->columns && i < columns->column_count; i++) {
+        JsonColumn *column = &columns->columns[i];
+        switch (column->type) {
+        case JSON_COLUMN_DOUBLE:
+            allocator->free(allocator->ctx, column->doubles);
+            break;
+        case JSON_COLUMN_INT64:
+            allocator->free(allocator->ctx, column->int64s);
+            break;
+        case JSON_COLUMN_BOOL:
+            allocator->free(allocator->ctx, column->bools);
+            break;
+        case JSON_COLUMN_STRING:
+            allocator->free(allocator->ctx, column->offsets);
+            allocator->free(allocator->ctx, column->data);
+            break;
+        }
+        allocator->free(allocator->ctx, column->validity);
+    }
+    allocator->free(allocator->ctx, columns->columns);
+
+    columns->columns = NULL;
+    columns->column_count = 0;
+    columns->row_count = 0;
+}
+
+static bool extract_rows(ColumnState *state) {
+    JsonToken token = json_tokenizer_next(&state->tokenizer);
+    if (token.type != TOKEN_LEFT_BRACKET) {
+        return fail(state, NULL, "Expected an array of objects");
+    }
+
+    token = json_tokenizer_next(&state->tokenizer);
+    if (token.type != TOKEN_RIGHT_BRACKET) {
+        for (size_t row = 0;; row++) {
+            if (token.type != TOKEN_LEFT_BRACE) {
+                return fail(state, NULL, "Expected an object in row %zu", row);
+            }
+            if (!extract_row(state, row)) {
+                return false;
+            }
+            state->columns->row_count = row + 1;
+
+            token = json_tokenizer_next(&state->tokenizer);
+            if (token.type == TOKEN_RIGHT_BRACKET) {
+                break;
+            }
+            if (token.type != TOKEN_COMMA) {
+                return fail(state, NULL, "Expected ',' after row %zu", row);
+            }
+            token = json_tokenizer_next(&state->tokenizer);
+        }
+    }
+
+    if (json_tokenizer_next(&state->tokenizer).type != TOKEN_EOF) {
+        return fail(state, NULL, "Unexpected data after the array");
+    }
+    return true;
+}
+
+static bool extract_row(ColumnState *state, size_t row) {
+    if (!reserve_rows(state, row + 1)) {
+        return false;
+    }
+
+    JsonToken token = json_tokenizer_next(&state->tokenizer);
+    if (token.type != TOKEN_RIGHT_BRACE) {
+        for (;;) {
+            if (token.type != TOKEN_STRING) {
+                return fail(state, NULL, "Expected a key in row %zu", row);
+            }
+            size_t column = find_column(state, &token);
+            if (json_tokenizer_next(&state->tokenizer).type != TOKEN_COLON) {
+                return fail(state, NULL, "Expected ':' in row %zu", row);
+            }
+
+            JsonToken value = json_tokenizer_next(&state->tokenizer);
+            // The first occurrence of a duplicated key wins. Skipped values
+            // are still checked to be well formed.
+            if (column == SIZE_MAX || state->builders[column].seen_row == row) {
+                JsonSyntaxError syntax;
+                if (!json_skip_value(&state->tokenizer, &value, state->options,
+                                     &syntax)) {
+                    return fail(state, NULL, "%s in row %zu", syntax.message,
+                                row);
+                }
+            } else {
+                state->builders[column].seen_row = row;
+                if (!store_value(state, column, row, &value)) {
+                    return false;
+                }
+            }
+
+            token = json_tokenizer_next(&state->tokenizer);
+            if (token.type == TOKEN_RIGHT_BRACE) {
+                break;
+            }
+            if (token.type != TOKEN_COMMA) {
+                return fail(state, NULL, "Expected ',' in row %zu", row);
+            }
+            token = json_tokenizer_next(&state->tokenizer);
+        }
+    }
+
+    JsonColumns *columns = state->columns;
+    for (size_t i = 0; i < columns->column_count; i++) {
+        JsonColumn *column = &columns->columns[i];
+        if (!json_column_bit(column->validity, row)) {
+            column->null_count++;
+        }
+        if (column->type == JSON_COLUMN_STRING) {
+            column->offsets[row + 1] = state->builders[i].data_size;
+        }
+    }
+    return true;
+}
+
+static bool store_value(ColumnState *state, size_t column, size_t row,
+                        const JsonToken *token) {
+    JsonColumn *target = &state->columns->columns[column];
+    const char *key = state->spec[column].key;
+    if (token->type == TOKEN_NULL) {
+        return true;
+    }
+
+    switch (target->type) {
+    case JSON_COLUMN_DOUBLE: {
+        if (token->type != TOKEN_NUMBER) {
+            return fail(state, key, "Expected number for key '%s' in row %zu",
+                        key, row);
+        }
+        if (!copy_number(state, token)) {
+            return false;
+        }
+        char *endptr;
+        errno = 0;
+        target->doubles[row] = strtod(state->buffer, &endptr);
+        if (errno == ERANGE) {
+            return fail(state, key, "Number out of range for key '%s'", key);
+        }
+        break;
+    }
+
+    case JSON_COLUMN_INT64: {
+        if (token->type != TOKEN_NUMBER || !is_integer(token)) {
+            return fail(state, key, "Expected integer for key '%s' in row %zu",
+                        key, row);
+        }
+        if (!copy_number(state, token)) {
+            return false;
+        }
+        char *endptr;
+        errno = 0;
+        target->int64s[row] = strtoll(state->buffer, &endptr, 10);
+        if (errno == ERANGE) {
+            return fail(state, key, "Integer out of range for key '%s'", key);
+        }
+        break;
+    }
+
+    case JSON_COLUMN_BOOL:
+        if (token->type != TOKEN_TRUE && token->type != TOKEN_FALSE) {
+            return fail(state, key, "Expected bool for key '%s' in row %zu",
+                        key, row);
+        }
+        if (token->type == TOKEN_TRUE) {
+            target->bools[row / 8] |= (uint8_t)(1u << (row % 8));
+        }
+        break;
+
+    case JSON_COLUMN_STRING: {
+        if (token->type != TOKEN_STRING) {
+            return fail(state, key, "Expected string for key '%s' in row %zu",
+                        key, row);
+        }
+        ColumnBuilder *builder = &state->builders[column];
+        size_t length = token->length - 2;
+        if (builder->data_size + length > builder->data_capacity) {
+            size_t capacity = builder->data_capacity
+                                  ? builder->data_capacity * 2
+                                  : COLUMNS_INITIAL_ROWS * 16;
+            while (capacity < builder->data_size + length) {
+                capacity *= 2;
+            }
+            if (!grow(state, (void **)&target->data, builder->data_capacity,
+                      capacity)) {
+                return false;
+            }
+            builder->data_capacity = capacity;
+        }
+        memcpy(target->data + builder->data_size, token->start + 1, length);
+        builder->data_size += length;
+        break;
+    }
+    }
+
+    target->validity[row / 8] |= (uint8_t)(1u << (row % 8));
+    return true;
+}
+
+// Records usually list their keys in the same order, so the search starts
+// at the column after the last match.
+static size_t find_column(ColumnState *state, const JsonToken *key) {
+    size_t count = state->columns->column_count;
+    const char *name = key->start + 1;
+    size_t length = key->length - 2;
+
+    for (size_t n = 0; n < count; n++) {
+        size_t i = (state->last_column + n) % count;
+        if (state->builders[i].key_length == length &&
+            memcmp(state->spec[i].key, name, length) == 0) {
+            state->last_column = i + 1;
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static bool reserve_rows(ColumnState *state, size_t rows) {
+    if (rows <= state->row_capacity) {
+        return true;
+    }
+
+    size_t old_rows = state->row_capacity;
+    size_t new_rows = old_rows ? old_rows * 2 : COLUMNS_INITIAL_ROWS;
+    while (new_rows < rows) {
+        new_rows *= 2;
+    }
+    size_t old_bits = (old_rows + 7) / 8;
+    size_t new_bits = (new_rows + 7) / 8;
+
+    JsonColumns *columns = state->columns;
+    for (size_t i = 0; i < columns->column_count; i++) {
+        JsonColumn *column = &columns->columns[i];
+        bool ok = grow(state, (void **)&column->validity, old_bits, new_bits);
+        switch (column->type) {
+        case JSON_COLUMN_DOUBLE:
+            ok = ok && grow(state, (void **)&column->doubles,
+                            sizeof(double) * old_rows,
+                            sizeof(double) * new_rows);
+            break;
+        case JSON_COLUMN_INT64:
+            ok = ok && grow(state, (void **)&column->int64s,
+                            sizeof(int64_t) * old_rows,
+                            sizeof(int64_t) * new_rows);
+            break;
+        case JSON_COLUMN_BOOL:
+            ok = ok && grow(state, (void **)&column->bools, old_bits, new_bits);
+            break;
+        case JSON_COLUMN_STRING:
+            ok = ok && grow(state, (void **)&column->offsets,
+                            sizeof(size_t) * (old_rows ? old_rows + 1 : 0),
+                            sizeof(size_t) * (new_rows + 1));
+            break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    state->row_capacity = new_rows;
+    return true;
+}
+
+// Grows a column buffer and zeroes the new tail, so bitmaps start cleared and
+// missing values read as 0.
+static bool grow(ColumnState *state, void **ptr, size_t old_size,
+                 size_t new_size) {
+    const JsonAllocator *allocator = state->allocator;
+    void *new_ptr = allocator->realloc(allocator->ctx, *ptr, new_size);
+    if (!new_ptr) {
+        return fail(state, NULL, "Out of memory");
+    }
+    JSON_STATS_ALLOC(state->stats, new_size);
+
+    memset((char *)new_ptr + old_size, 0, new_size - old_size);
+    *ptr = new_ptr;
+    return true;
+}
+
+static bool is_integer(const JsonToken *token) {
+    for (size_t i = 0; i < token->length; i++) {
+        char c = token->start[i];
+        if (c == '.' || c == 'e' || c == 'E') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool copy_number(ColumnState *state, const JsonToken *token) {
+    if (token->length + 1 > state->buffer_capacity) {
+        size_t capacity = token->length + 1 < 64 ? 64 : token->length + 1;
+        if (!grow(state, (void **)&state->buffer, 0, capacity)) {
+            return false;
+        }
+        state->buffer_capacity = capacity;
+    }
+    memcpy(state->buffer, token->start, token->length);
+    state->buffer[token->length] = '\0';
+    return true;
+}
+
+static bool fail(ColumnState *state, const char *key, const char *format, ...) {
+    if (state->error && state->error->message[0] == '\0') {
+        state->error->key = key;
+        va_list args;
+        va_start(args, format);
+        vsnprintf(state->error->message, sizeof(state->error->message), format,
+                  args);
+        va_end(args);
+    }
+    return false;
+}
@@ -1,20 +1,45 @@
 #include "../include/deserializer.h"
+#include "../include/stats.h"
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static JsonValue *find_value(const JsonObject *obj, const char *key) {
-    for (size_t i = 0; i < obj->size; i++) {
-        if (strcmp(key, obj->keys[i]) == 0) {
-            return obj->values[i];
-        }
-    }
-    return NULL;
-}
+static bool deserialize_fields(void *struct_ptr, const JsonObject *json,
+                               const FieldDescriptor *fields,
+                               size_t num_fields, JsonError *error,
+                               const JsonAllocator *allocator,
+                               JsonParseStats *stats);
+
 bool json_to_struct(void *struct_ptr, const JsonObject *json,
                     const FieldDescriptor *fields, size_t num_fields,
                     JsonError *error) {
+    return json_to_struct_ex(struct_ptr, json, fields, num_fields, error,
+                             NULL);
+}
+
+bool json_to_struct_ex(void *struct_ptr, const JsonObject *json,
+                       const FieldDescriptor *fields, size_t num_fields,
+                       JsonError *error, const JsonParseOptions *options) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+    JsonParseStats *stats = options ? options->stats : NULL;
+    JSON_STATS_TIMER_START(deserialize_start);
+
+    bool ok = deserialize_fields(struct_ptr, json, fields, num_fields, error,
+                                 allocator, stats);
+
+    JSON_STATS_TIMER_STOP(stats, JSON_PHASE_DESERIALIZE, deserialize_start);
+    return ok;
+}
+
+static bool deserialize_fields(void *struct_ptr, const JsonObject *json,
+                               const FieldDescriptor *fields,
+                               size_t num_fields, JsonError *error,
+                               const JsonAllocator *allocator,
+                               JsonParseStats *stats) {
+    (void)stats;
     if (error) {
         error->key = NULL;
         error->message[0] = '\0';
@@ -22,7 +47,7 @@ bool json_to_struct(void *struct_ptr, const JsonObject *json,
 
     for (size_t i = 0; i < num_fields; i++) {
         const FieldDescriptor *field = &fields[i];
-        JsonValue *value = find_value(json, field->key);
+        JsonValue *value = json_object_get(json, field->key);
         if (!value) {
             error->key = field->key;
             snprintf(error->message, sizeof(error->message),
@@ -70,8 +95,12 @@ bool json_to_struct(void *struct_ptr, const JsonObject *json,
                 return false;
             }
 
+            size_t length;
+            const char *string = json_string(value, &length);
             char **str_ptr = (char **)field_ptr;
-            *str_ptr = strdup(value->string);
+            *str_ptr = json_allocator_strndup(allocator, string, length);
+            JSON_STATS_ALLOC(stats, length + 1);
+            JSON_STATS_ADD(stats, strings_copied, 1);
             if (!*str_ptr) {
                 if (error) {
                     error->key = field->key;
@@ -112,9 +141,17 @@ bool json_to_struct(void *struct_ptr, const JsonObject *json,
 
 void json_free_struct(void *struct_ptr, const FieldDescriptor *fields,
                       size_t num_fields) {
+    json_free_struct_ex(struct_ptr, fields, num_fields, NULL);
+}
+
+void json_free_struct_ex(void *struct_ptr, const FieldDescriptor *fields,
+                         size_t num_fields, const JsonAllocator *allocator) {
     if (!struct_ptr || !fields) {
         return;
     }
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
 
     for (size_t i = 0; i < num_fields; i++) {
         const FieldDescriptor *field = &fields[i];
@@ -123,7 +160,7 @@ void json_free_struct(void *struct_ptr, const FieldDescriptor *fields,
         switch (field->type) {
         case FIELD_STRING: {
             char **str_ptr = (char **)field_ptr;
-            free(*str_ptr);
+            allocator->free(allocator->ctx, *str_ptr);
             *str_ptr = NULL;
             break;
         }
@@ -0,0 +1,444 @@
+#include "../include/diff.h"
+#include "../include/allocator.h"
+#include "../include/edit.h"
+#include "../include/hash.h"
+#include "../include/parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Largest LCS table, in cells, before arrays fall back to positional diffs.
+#define DIFF_LCS_LIMIT 65536
+// Largest number of element comparisons spent placing a changed run.
+#define DIFF_WINDOW_LIMIT 4096
+
+typedef struct {
+        JsonValue *patch;
+        char *path;
+        size_t path_length;
+        size_t path_capacity;
+        JsonHashCache hashes;
+        const JsonAllocator *allocator;
+        bool failed;
+} DiffState;
+
+static void diff_values(DiffState *state, const JsonValue *a,
+                        const JsonValue *b);
+static void diff_objects(DiffState *state, const JsonObject *a,
+                         const JsonObject *b);
+static void diff_arrays(DiffState *state, const JsonArray *a,
+                        const JsonArray *b);
+static void diff_aligned(DiffState *state, const JsonArray *a,
+                         const JsonArray *b, size_t start, size_t a_count,
+                         size_t b_count, const uint64_t *a_hashes,
+                         const uint64_t *b_hashes);
+static void diff_run(DiffState *state, const JsonArray *a, const JsonArray *b,
+                     size_t *index, size_t *x, size_t *y, size_t removed,
+                     size_t inserted);
+static void remove_elements(DiffState *state, size_t index, size_t *x,
+                            size_t count);
+static void add_elements(DiffState *state, const JsonArray *b, size_t *index,
+                         size_t *y, size_t count);
+static size_t similarity(DiffState *state, const JsonArray *a, size_t x,
+                         const JsonArray *b, size_t y);
+static void diff_element(DiffState *state, size_t index, const JsonArray *a,
+                         size_t x, const JsonArray *b, size_t y);
+static void emit(DiffState *state, const char *op, const JsonValue *value);
+static bool set_member(JsonValue *object, const char *key,
+                       JsonValue *value, const JsonAllocator *allocator);
+static size_t push_key(DiffState *state, const char *key);
+static size_t push_index(DiffState *state, size_t index);
+static bool reserve_path(DiffState *state, size_t extra);
+static bool elements_equal(DiffState *state, const JsonArray *a, size_t x,
+                           const JsonArray *b, size_t y);
+
+JsonValue *json_diff(const JsonValue *a, const JsonValue *b,
+                     const JsonAllocator *allocator) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    JsonValue *patch = allocator->alloc(allocator->ctx, sizeof(JsonValue));
+    if (!patch) {
+        return NULL;
+    }
+    *patch = (JsonValue){.type = JSON_ARRAY};
+
+    DiffState state = {.patch = patch, .allocator = allocator};
+    json_hash_cache_init(&state.hashes, allocator);
+    diff_values(&state, a, b);
+    json_hash_cache_destroy(&state.hashes);
+    allocator->free(allocator->ctx, state.path);
+
+    if (state.failed) {
+        free_json_value_ex(patch, allocator);
+        return NULL;
+    }
+    return patch;
+}
+
+static void diff_values(DiffState *state, const JsonValue *a,
+                        const JsonValue *b) {
+    if (state->failed) {
+        return;
+    }
+    if (a->type == JSON_OBJECT && b->type == JSON_OBJECT) {
+        diff_objects(state, &a->object, &b->object);
+    } else if (a->type == JSON_ARRAY && b->type == JSON_ARRAY) {
+        diff_arrays(state, &a->array, &b->array);
+    } else if (!json_equal_ex(a, b, &state->hashes)) {
+        emit(state, "replace", b);
+    }
+}
+
+static void diff_objects(DiffState *state, const JsonObject *a,
+                         const JsonObject *b) {
+    // Records of the same shape line up member for member, which avoids a
+    // lookup per key; without a shared shape the keys are compared first.
+    bool aligned = a->size == b->size;
+    bool same_shape = a->shape && a->shape == b->shape;
+    for (size_t i = 0; i < a->size && aligned && !same_shape; i++) {
+        aligned = a->members[i].key == b->members[i].key ||
+                  strcmp(a->members[i].key, b->members[i].key) == 0;
+    }
+    if (aligned) {
+        for (size_t i = 0; i < a->size; i++) {
+            size_t mark = push_key(state, a->members[i].key);
+            diff_values(state, &a->members[i].value, &b->members[i].value);
+            state->path_length = mark;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < a->size; i++) {
+        if (!json_object_get(b, a->members[i].key)) {
+            size_t mark = push_key(state, a->members[i].key);
+            emit(state, "remove", NULL);
+            state->path_length = mark;
+        }
+    }
+    for (size_t i = 0; i < b->size; i++) {
+        const JsonMember *member = &b->members[i];
+        const JsonValue *previous = json_object_get(a, member->key);
+        size_t mark = push_key(state, member->key);
+        if (previous) {
+            diff_values(state, previous, &member->value);
+        } else {
+            emit(state, "add", &member->value);
+        }
+        state->path_length = mark;
+    }
+}
+
+static void diff_arrays(DiffState *state, const JsonArray *a,
+                        const JsonArray *b) {
+    const JsonAllocator *allocator = state->allocator;
+    size_t a_size = a->size;
+    size_t b_size = b->size;
+    if (a_size + b_size == 0) {
+        return;
+    }
+
+    uint64_t *hashes =
+        allocator->alloc(allocator->ctx, sizeof(uint64_t) * (a_size + b_size));
+    if (!hashes) {
+        state->failed = true;
+        return;
+    }
+    uint64_t *a_hashes = hashes;
+    uint64_t *b_hashes = hashes + a_size;
+    for (size_t i = 0; i < a_size; i++) {
+        JsonValue element = json_array_get(a, i);
+        a_hashes[i] = json_hash_ex(&element, &state->hashes);
+    }
+    for (size_t i = 0; i < b_size; i++) {
+        JsonValue element = json_array_get(b, i);
+        b_hashes[i] = json_hash_ex(&element, &state->hashes);
+    }
+
+    size_t prefix = 0;
+    while (prefix < a_size && prefix < b_size &&
+           a_hashes[prefix] == b_hashes[prefix] &&
+           elements_equal(state, a, prefix, b, prefix)) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < a_size - prefix && suffix < b_size - prefix &&
+           a_hashes[a_size - 1 - suffix] == b_hashes[b_size - 1 - suffix] &&
+           elements_equal(state, a, a_size - 1 - suffix, b,
+                          b_size - 1 - suffix)) {
+        suffix++;
+    }
+
+    diff_aligned(state, a, b, prefix, a_size - prefix - suffix,
+                 b_size - prefix - suffix, a_hashes, b_hashes);
+    allocator->free(allocator->ctx, hashes);
+}
+
+// Diffs a[start..start + a_count) against b[start..start + b_count). Small
+// ranges are aligned by longest common subsequence of element hashes; each
+// run between kept elements then becomes changes, removals and insertions.
+// Kept elements are still diffed, so a hash collision only costs a replace.
+static void diff_aligned(DiffState *state, const JsonArray *a,
+                         const JsonArray *b, size_t start, size_t a_count,
+                         size_t b_count, const uint64_t *a_hashes,
+                         const uint64_t *b_hashes) {
+    const JsonAllocator *allocator = state->allocator;
+    size_t index = start;
+    size_t x = start;
+    size_t y = start;
+    size_t width = b_count + 1;
+
+    uint32_t *table = NULL;
+    if (a_count > 0 && b_count > 0 &&
+        (a_count + 1) * width <= DIFF_LCS_LIMIT) {
+        table = allocator->alloc(allocator->ctx,
+                                 sizeof(uint32_t) * (a_count + 1) * width);
+    }
+    if (!table) {
+        diff_run(state, a, b, &index, &x, &y, a_count, b_count);
+        return;
+    }
+
+    // table[i * width + j] is the LCS length of the ranges from i and j on.
+    for (size_t i = a_count + 1; i-- > 0;) {
+        for (size_t j = b_count + 1; j-- > 0;) {
+            uint32_t *cell = &table[i * width + j];
+            if (i == a_count || j == b_count) {
+                *cell = 0;
+            } else if (a_hashes[start + i] == b_hashes[start + j]) {
+                *cell = table[(i + 1) * width + j + 1] + 1;
+            } else {
+                uint32_t down = table[(i + 1) * width + j];
+                uint32_t right = table[i * width + j + 1];
+                *cell = down > right ? down : right;
+            }
+        }
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a_count || j < b_count) {
+        if (i < a_count && j < b_count &&
+            a_hashes[start + i] == b_hashes[start + j]) {
+            diff_element(state, index++, a, x++, b, y++);
+            i++;
+            j++;
+            continue;
+        }
+
+        size_t removed = 0;
+        size_t inserted = 0;
+        while (i < a_count || j < b_count) {
+            if (i < a_count && j < b_count &&
+                a_hashes[start + i] == b_hashes[start + j]) {
+                break;
+            }
+            if (i < a_count &&
+                (j == b_count ||
+                 table[(i + 1) * width + j] >= table[i * width + j + 1])) {
+                i++;
+                removed++;
+            } else {
+                j++;
+                inserted++;
+            }
+        }
+        diff_run(state, a, b, &index, &x, &y, removed, inserted);
+    }
+
+    allocator->free(allocator->ctx, table);
+}
+
+// Replaces `removed` elements at *index with `inserted` ones. The shorter
+// side is diffed against the window of the longer side it resembles most;
+// what lies outside the window is removed or added.
+static void diff_run(DiffState *state, const JsonArray *a, const JsonArray *b,
+                     size_t *index, size_t *x, size_t *y, size_t removed,
+                     size_t inserted) {
+    size_t changed = removed < inserted ? removed : inserted;
+    size_t slack = removed + inserted - 2 * changed;
+    size_t offset = 0;
+    if (changed > 0 && slack > 0 &&
+        (slack + 1) * changed <= DIFF_WINDOW_LIMIT) {
+        size_t best = 0;
+        for (size_t o = 0; o <= slack; o++) {
+            size_t score = 0;
+            for (size_t k = 0; k < changed; k++) {
+                size_t i = *x + k + (removed > inserted ? o : 0);
+                size_t j = *y + k + (removed > inserted ? 0 : o);
+                score += similarity(state, a, i, b, j);
+            }
+            if (score > best) {
+                best = score;
+                offset = o;
+            }
+        }
+    }
+
+    if (removed > inserted) {
+        remove_elements(state, *index, x, offset);
+    } else {
+        add_elements(state, b, index, y, offset);
+    }
+    for (size_t k = 0; k < changed; k++) {
+        diff_element(state, (*index)++, a, (*x)++, b, (*y)++);
+    }
+    if (removed > inserted) {
+        remove_elements(state, *index, x, slack - offset);
+    } else {
+        add_elements(state, b, index, y, slack - offset);
+    }
+}
+
+static void remove_elements(DiffState *state, size_t index, size_t *x,
+                            size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        size_t mark = push_index(state, index);
+        emit(state, "remove", NULL);
+        state->path_length = mark;
+        (*x)++;
+    }
+}
+
+static void add_elements(DiffState *state, const JsonArray *b, size_t *index,
+                         size_t *y, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        JsonValue element = json_array_get(b, (*y)++);
+        size_t mark = push_index(state, (*index)++);
+        emit(state, "add", &element);
+        state->path_length = mark;
+    }
+}
+
+// How many children two elements have in common, as a cheap estimate of
+// how small their diff is.
+static size_t similarity(DiffState *state, const JsonArray *a, size_t x,
+                         const JsonArray *b, size_t y) {
+    JsonValue a_element = json_array_get(a, x);
+    JsonValue b_element = json_array_get(b, y);
+    if (a_element.type != b_element.type) {
+        return 0;
+    }
+
+    size_t score = 0;
+    if (a_element.type == JSON_OBJECT) {
+        const JsonObject *object = &a_element.object;
+        for (size_t i = 0; i < object->size; i++) {
+            const JsonValue *other =
+                json_object_get(&b_element.object, object->members[i].key);
+            score += other && json_equal_ex(&object->members[i].value, other,
+                                            &state->hashes);
+        }
+    } else if (a_element.type == JSON_ARRAY) {
+        size_t size = a_element.array.size < b_element.array.size
+                          ? a_element.array.size
+                          : b_element.array.size;
+        for (size_t i = 0; i < size; i++) {
+            score += elements_equal(state, &a_element.array, i,
+                                    &b_element.array, i);
+        }
+    }
+    return score + 1;
+}
+
+static void diff_element(DiffState *state, size_t index, const JsonArray *a,
+                         size_t x, const JsonArray *b, size_t y) {
+    JsonValue a_element = json_array_get(a, x);
+    JsonValue b_element = json_array_get(b, y);
+    size_t mark = push_index(state, index);
+    diff_values(state, &a_element, &b_element);
+    state->path_length = mark;
+}
+
+static void emit(DiffState *state, const char *op, const JsonValue *value) {
+    const JsonAllocator *allocator = state->allocator;
+    if (state->failed) {
+        return;
+    }
+
+    JsonValue operation = {.type = JSON_OBJECT};
+    JsonValue field;
+    bool ok = json_value_init_string(&field, op, strlen(op), allocator) &&
+              set_member(&operation, "op", &field, allocator) &&
+              json_value_init_string(&field, state->path ? state->path : "",
+                                     state->path_length, allocator) &&
+              set_member(&operation, "path", &field, allocator);
+    if (ok && value) {
+        ok = json_value_copy(&field, value, allocator) &&
+             set_member(&operation, "value", &field, allocator);
+    }
+    if (!ok || !json_array_push(state->patch, &operation, allocator)) {
+        json_value_release(&operation, allocator);
+        state->failed = true;
+    }
+}
+
+static bool set_member(JsonValue *object, const char *key,
+                       JsonValue *value, const JsonAllocator *allocator) {
+    if (!json_object_set(object, key, strlen(key), value, allocator)) {
+        json_value_release(value, allocator);
+        return false;
+    }
+    return true;
+}
+
+// Appends a JSON Pointer segment, escaping '~' and '/', and returns the
+// previous path length for the caller to restore.
+static size_t push_key(DiffState *state, const char *key) {
+    size_t mark = state->path_length;
+    size_t length = strlen(key);
+    if (!reserve_path(state, 2 * length + 1)) {
+        return mark;
+    }
+
+    char *path = state->path;
+    path[state->path_length++] = '/';
+    for (size_t i = 0; i < length; i++) {
+        if (key[i] == '~' || key[i] == '/') {
+            path[state->path_length++] = '~';
+            path[state->path_length++] = key[i] == '~' ? '0' : '1';
+        } else {
+            path[state->path_length++] = key[i];
+        }
+    }
+    return mark;
+}
+
+static size_t push_index(DiffState *state, size_t index) {
+    size_t mark = state->path_length;
+    if (reserve_path(state, 22)) {
+        state->path_length += (size_t)snprintf(
+            state->path + state->path_length, 22, "/%zu", index);
+    }
+    return mark;
+}
+
+static bool reserve_path(DiffState *state, size_t extra) {
+    if (state->path_length + extra <= state->path_capacity) {
+        return true;
+    }
+
+    const JsonAllocator *allocator = state->allocator;
+    size_t capacity = state->path_capacity ? state->path_capacity * 2 : 64;
+    while (capacity < state->path_length + extra) {
+        capacity *= 2;
+    }
+    char *path = allocator->realloc(allocator->ctx, state->path, capacity);
+    if (!path) {
+        state->failed = true;
+        return false;
+    }
+    state->path = path;
+    state->path_capacity = capacity;
+    return true;
+}
+
+static bool elements_equal(DiffState *state, const JsonArray *a, size_t x,
+                           const JsonArray *b, size_t y) {
+    JsonValue a_element = json_array_get(a, x);
+    JsonValue b_element = json_array_get(b, y);
+    return json_equal_ex(&a_element, &b_element, &state->hashes);
+}
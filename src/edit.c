@@ -0,0 +1,594 @@
+#include "../include/edit.h"
+#include "../include/allocator.h"
+#include "../include/intern.h"
+#include "../include/parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define EDIT_MIN_CAPACITY 4
+
+// Where json_clone places the next children and the next string: nodes fill
+// the block from the front, string bytes follow them.
+typedef struct {
+        char *nodes;
+        char *strings;
+} CloneCursor;
+
+static size_t growable_capacity(size_t size);
+static bool reserve_members(JsonValue *object, size_t size,
+                            const JsonAllocator *allocator);
+static bool reserve_elements(JsonValue *array, size_t size,
+                             const JsonAllocator *allocator);
+static bool box_elements(JsonValue *array, size_t size,
+                         const JsonAllocator *allocator);
+static size_t find_member(const JsonObject *object, const char *key,
+                          size_t key_length);
+static size_t member_key_length(const JsonValue *object, const char *key);
+static void measure_clone(const JsonValue *value, size_t *node_bytes,
+                          size_t *string_bytes);
+static void clone_value(JsonValue *copy, const JsonValue *value,
+                        CloneCursor *cursor, unsigned flags);
+static bool unclone(JsonValue *container, const JsonAllocator *allocator);
+
+bool json_value_init_string(JsonValue *value, const char *string,
+                            size_t length, const JsonAllocator *allocator) {
+    value->type = JSON_STRING;
+    if (length <= JSON_SHORT_STRING_MAX) {
+        memcpy(value->short_string, string, length);
+        value->short_string[length] = '\0';
+        value->short_string_length = (uint8_t)length;
+        value->flags = JSON_VALUE_INLINE;
+        return true;
+    }
+
+    char *copy = json_allocator_strndup(allocator, string, length);
+    if (!copy) {
+        return false;
+    }
+    value->string = copy;
+    value->string_length = length;
+    value->flags = 0;
+    return true;
+}
+
+bool json_object_set(JsonValue *object, const char *key, size_t key_length,
+                     const JsonValue *value, const JsonAllocator *allocator) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    // Replacing a value leaves the key sequence, and so the shape, intact.
+    size_t index = find_member(&object->object, key, key_length);
+    if (index < object->object.size) {
+        json_value_replace(&object->object.members[index].value, value,
+                           allocator);
+        return true;
+    }
+
+    char *copy = json_allocator_strndup(allocator, key, key_length);
+    if (!copy) {
+        return false;
+    }
+    if (!reserve_members(object, object->object.size + 1, allocator)) {
+        allocator->free(allocator->ctx, copy);
+        return false;
+    }
+
+    JsonMember *member = &object->object.members[object->object.size++];
+    member->key = copy;
+    member->value = *value;
+    return true;
+}
+
+bool json_object_remove(JsonValue *object, const char *key,
+                        size_t key_length, const JsonAllocator *allocator) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    size_t index = find_member(&object->object, key, key_length);
+    if (index == object->object.size ||
+        !reserve_members(object, object->object.size, allocator)) {
+        return false;
+    }
+
+    JsonObject *record = &object->object;
+    allocator->free(allocator->ctx, record->members[index].key);
+    json_value_release(&record->members[index].value, allocator);
+    memmove(&record->members[index], &record->members[index + 1],
+            sizeof(JsonMember) * (record->size - index - 1));
+    record->size--;
+    return true;
+}
+
+bool json_array_push(JsonValue *array, const JsonValue *value,
+                     const JsonAllocator *allocator) {
+    return json_array_insert(array, array->array.size, value, allocator);
+}
+
+bool json_array_insert(JsonValue *array, size_t index, const JsonValue *value,
+                       const JsonAllocator *allocator) {
+    JsonArray *elements = &array->array;
+    if (index > elements->size) {
+        return false;
+    }
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    bool stays_typed =
+        elements->kind == JSON_ARRAY_NUMBERS && value->type == JSON_NUMBER;
+    if (elements->kind != JSON_ARRAY_VALUES && !stays_typed) {
+        if (!box_elements(array, elements->size + 1, allocator)) {
+            return false;
+        }
+    } else if (!reserve_elements(array, elements->size + 1, allocator)) {
+        return false;
+    }
+
+    size_t tail = elements->size - index;
+    if (elements->kind == JSON_ARRAY_NUMBERS) {
+        memmove(&elements->numbers[index + 1], &elements->numbers[index],
+                sizeof(double) * tail);
+        elements->numbers[index] = value->number;
+    } else {
+        memmove(&elements->values[index + 1], &elements->values[index],
+                sizeof(JsonValue) * tail);
+        elements->values[index] = *value;
+    }
+    elements->size++;
+    return true;
+}
+
+bool json_array_set(JsonValue *array, size_t index, const JsonValue *value,
+                    const JsonAllocator *allocator) {
+    JsonArray *elements = &array->array;
+    if (index >= elements->size) {
+        return false;
+    }
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    if (elements->kind == JSON_ARRAY_NUMBERS && value->type == JSON_NUMBER) {
+        elements->numbers[index] = value->number;
+        return true;
+    }
+    if (elements->kind != JSON_ARRAY_VALUES &&
+        !box_elements(array, elements->size, allocator)) {
+        return false;
+    }
+    json_value_replace(&elements->values[index], value, allocator);
+    return true;
+}
+
+bool json_array_erase(JsonValue *array, size_t index,
+                      const JsonAllocator *allocator) {
+    JsonArray *elements = &array->array;
+    if (index >= elements->size) {
+        return false;
+    }
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    size_t tail = elements->size - index - 1;
+    if (elements->kind == JSON_ARRAY_NUMBERS) {
+        memmove(&elements->numbers[index], &elements->numbers[index + 1],
+                sizeof(double) * tail);
+    } else {
+        if (elements->kind == JSON_ARRAY_BOOLS &&
+            !box_elements(array, elements->size, allocator)) {
+            return false;
+        }
+        json_value_release(&elements->values[index], allocator);
+        memmove(&elements->values[index], &elements->values[index + 1],
+                sizeof(JsonValue) * tail);
+    }
+    elements->size--;
+    return true;
+}
+
+bool json_value_copy(JsonValue *copy, const JsonValue *value,
+                     const JsonAllocator *allocator) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    JsonValue source = *value;
+    switch (source.type) {
+    case JSON_STRING: {
+        size_t length;
+        const char *string = json_string(&source, &length);
+        if (source.flags & JSON_VALUE_INLINE) {
+            *copy = source;
+            return true;
+        }
+        return json_value_init_string(copy, string, length, allocator);
+    }
+
+    case JSON_ARRAY: {
+        JsonArray *array = &copy->array;
+        *copy = (JsonValue){.type = JSON_ARRAY};
+        array->kind = source.array.kind;
+        size_t size = source.array.size;
+        if (size == 0) {
+            return true;
+        }
+        if (source.array.kind != JSON_ARRAY_VALUES) {
+            size_t bytes = source.array.kind == JSON_ARRAY_NUMBERS
+                               ? sizeof(double) * size
+                               : (size + 7) / 8;
+            array->values = allocator->alloc(allocator->ctx, bytes);
+            if (!array->values) {
+                return false;
+            }
+            memcpy(array->values, source.array.values, bytes);
+            array->size = size;
+            return true;
+        }
+        array->values = allocator->alloc(allocator->ctx,
+                                         sizeof(JsonValue) * size);
+        if (!array->values) {
+            return false;
+        }
+        for (; array->size < size; array->size++) {
+            if (!json_value_copy(&array->values[array->size],
+                                 &source.array.values[array->size],
+                                 allocator)) {
+                json_value_release(copy, allocator);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    case JSON_OBJECT: {
+        JsonObject *object = &copy->object;
+        *copy = (JsonValue){.type = JSON_OBJECT};
+        size_t size = source.object.size;
+        if (size == 0) {
+            return true;
+        }
+        object->members =
+            allocator->alloc(allocator->ctx, sizeof(JsonMember) * size);
+        if (!object->members) {
+            return false;
+        }
+        for (; object->size < size; object->size++) {
+            const JsonMember *member = &source.object.members[object->size];
+            JsonMember *target = &object->members[object->size];
+            size_t length = member_key_length(&source, member->key);
+            target->key =
+                json_allocator_strndup(allocator, member->key, length);
+            if (!target->key) {
+                json_value_release(copy, allocator);
+                return false;
+            }
+            if (!json_value_copy(&target->value, &member->value, allocator)) {
+                allocator->free(allocator->ctx, target->key);
+                json_value_release(copy, allocator);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    case JSON_NUMBER:
+    case JSON_BOOL:
+    case JSON_NULL:
+    default:
+        *copy = source;
+        copy->flags = 0;
+        return true;
+    }
+}
+
+bool json_clone(JsonValue *clone, const JsonValue *value,
+                const JsonAllocator *allocator) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    size_t size = value->type == JSON_OBJECT  ? value->object.size
+                  : value->type == JSON_ARRAY ? value->array.size
+                                              : 0;
+    if (size == 0) {
+        return json_value_copy(clone, value, allocator);
+    }
+
+    size_t node_bytes = 0;
+    size_t string_bytes = 0;
+    measure_clone(value, &node_bytes, &string_bytes);
+    char *block = allocator->alloc(allocator->ctx, node_bytes + string_bytes);
+    if (!block) {
+        return false;
+    }
+
+    CloneCursor cursor = {.nodes = block, .strings = block + node_bytes};
+    clone_value(clone, value, &cursor, JSON_VALUE_CLONE);
+    return true;
+}
+
+void json_value_replace(JsonValue *target, const JsonValue *value,
+                        const JsonAllocator *allocator) {
+    json_value_release(target, allocator);
+    *target = *value;
+}
+
+// A JSON_VALUE_GROWABLE container's storage holds at least
+// growable_capacity(size) children. Removing children only lowers that
+// bound, so storage is never shrunk.
+static size_t growable_capacity(size_t size) {
+    size_t capacity = EDIT_MIN_CAPACITY;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Parsed members are allocated exactly and may be the shape other objects
+// point at, so the first edit copies them instead of growing them in place.
+static bool reserve_members(JsonValue *object, size_t size,
+                            const JsonAllocator *allocator) {
+    JsonObject *record = &object->object;
+    if (object->flags & JSON_VALUE_GROWABLE) {
+        if (size <= growable_capacity(record->size)) {
+            return true;
+        }
+        JsonMember *grown = allocator->realloc(
+            allocator->ctx, record->members,
+            sizeof(JsonMember) * growable_capacity(size));
+        if (!grown) {
+            return false;
+        }
+        record->members = grown;
+        return true;
+    }
+
+    if ((object->flags & JSON_VALUE_CLONE) && !unclone(object, allocator)) {
+        return false;
+    }
+
+    JsonMember *copy = allocator->alloc(
+        allocator->ctx, sizeof(JsonMember) * growable_capacity(size));
+    if (!copy) {
+        return false;
+    }
+    bool shared_keys =
+        object->flags & (JSON_VALUE_INTERNED_KEYS | JSON_VALUE_BORROWED);
+    for (size_t i = 0; i < record->size; i++) {
+        copy[i] = record->members[i];
+        if (!shared_keys) {
+            continue;
+        }
+        const char *key = record->members[i].key;
+        copy[i].key = json_allocator_strndup(
+            allocator, key, member_key_length(object, key));
+        if (!copy[i].key) {
+            while (i-- > 0) {
+                allocator->free(allocator->ctx, copy[i].key);
+            }
+            allocator->free(allocator->ctx, copy);
+            return false;
+        }
+    }
+
+    if (!(object->flags & JSON_VALUE_BORROWED) &&
+        record->shape != record->members) {
+        allocator->free(allocator->ctx, record->members);
+    }
+    record->members = copy;
+    record->shape = NULL;
+    object->flags &= ~(JSON_VALUE_INTERNED_KEYS | JSON_VALUE_BORROWED);
+    object->flags |= JSON_VALUE_GROWABLE;
+    return true;
+}
+
+static bool reserve_elements(JsonValue *array, size_t size,
+                             const JsonAllocator *allocator) {
+    JsonArray *elements = &array->array;
+    if ((array->flags & JSON_VALUE_GROWABLE) &&
+        size <= growable_capacity(elements->size)) {
+        return true;
+    }
+
+    if ((array->flags & JSON_VALUE_CLONE) && !unclone(array, allocator)) {
+        return false;
+    }
+
+    size_t element_size = elements->kind == JSON_ARRAY_NUMBERS
+                              ? sizeof(double)
+                              : sizeof(JsonValue);
+    void *grown;
+    if (array->flags & JSON_VALUE_BORROWED) {
+        grown = allocator->alloc(allocator->ctx,
+                                 element_size * growable_capacity(size));
+        if (grown && elements->size > 0) {
+            memcpy(grown, elements->values, element_size * elements->size);
+        }
+    } else {
+        grown = allocator->realloc(allocator->ctx, elements->values,
+                                   element_size * growable_capacity(size));
+    }
+    if (!grown) {
+        return false;
+    }
+    elements->values = grown;
+    array->flags &= ~JSON_VALUE_BORROWED;
+    array->flags |= JSON_VALUE_GROWABLE;
+    return true;
+}
+
+// Turns a typed array into nodes with room for size elements.
+static bool box_elements(JsonValue *array, size_t size,
+                         const JsonAllocator *allocator) {
+    JsonArray *elements = &array->array;
+    if ((array->flags & JSON_VALUE_CLONE) && !unclone(array, allocator)) {
+        return false;
+    }
+    JsonValue *values = allocator->alloc(
+        allocator->ctx, sizeof(JsonValue) * growable_capacity(size));
+    if (!values) {
+        return false;
+    }
+    for (size_t i = 0; i < elements->size; i++) {
+        values[i] = json_array_get(elements, i);
+    }
+
+    if (!(array->flags & JSON_VALUE_BORROWED)) {
+        allocator->free(allocator->ctx, elements->values);
+    }
+    elements->values = values;
+    elements->kind = JSON_ARRAY_VALUES;
+    array->flags &= ~JSON_VALUE_BORROWED;
+    array->flags |= JSON_VALUE_GROWABLE;
+    return true;
+}
+
+static size_t find_member(const JsonObject *object, const char *key,
+                          size_t key_length) {
+    for (size_t i = 0; i < object->size; i++) {
+        const char *candidate = object->members[i].key;
+        if (strnlen(candidate, key_length + 1) == key_length &&
+            memcmp(candidate, key, key_length) == 0) {
+            return i;
+        }
+    }
+    return object->size;
+}
+
+static size_t member_key_length(const JsonValue *object, const char *key) {
+    return object->flags & JSON_VALUE_INTERNED_KEYS ? json_key_of(key)->length
+                                                   : strlen(key);
+}
+
+// Every block of children is a multiple of 8 bytes, so nodes and number
+// buffers laid out one after another stay aligned.
+static void measure_clone(const JsonValue *value, size_t *node_bytes,
+                          size_t *string_bytes) {
+    switch (value->type) {
+    case JSON_STRING:
+        if (!(value->flags & JSON_VALUE_INLINE)) {
+            *string_bytes += value->string_length + 1;
+        }
+        break;
+
+    case JSON_ARRAY: {
+        const JsonArray *array = &value->array;
+        if (array->kind == JSON_ARRAY_NUMBERS) {
+            *node_bytes += sizeof(double) * array->size;
+        } else if (array->kind == JSON_ARRAY_BOOLS) {
+            *node_bytes += (array->size + 63) / 64 * 8;
+        } else {
+            *node_bytes += sizeof(JsonValue) * array->size;
+            for (size_t i = 0; i < array->size; i++) {
+                measure_clone(&array->values[i], node_bytes, string_bytes);
+            }
+        }
+        break;
+    }
+
+    case JSON_OBJECT:
+        *node_bytes += sizeof(JsonMember) * value->object.size;
+        for (size_t i = 0; i < value->object.size; i++) {
+            const JsonMember *member = &value->object.members[i];
+            *string_bytes += member_key_length(value, member->key) + 1;
+            measure_clone(&member->value, node_bytes, string_bytes);
+        }
+        break;
+
+    case JSON_NUMBER:
+    case JSON_BOOL:
+    case JSON_NULL:
+        break;
+    }
+}
+
+static void clone_value(JsonValue *copy, const JsonValue *value,
+                        CloneCursor *cursor, unsigned flags) {
+    JsonValue source = *value;
+    switch (source.type) {
+    case JSON_STRING:
+        *copy = source;
+        if (!(source.flags & JSON_VALUE_INLINE)) {
+            copy->string = cursor->strings;
+            memcpy(copy->string, source.string, source.string_length);
+            copy->string[source.string_length] = '\0';
+            cursor->strings += source.string_length + 1;
+            copy->flags = JSON_VALUE_BORROWED;
+        }
+        return;
+
+    case JSON_ARRAY: {
+        *copy = (JsonValue){.type = JSON_ARRAY, .flags = flags};
+        JsonArray *array = &copy->array;
+        array->kind = source.array.kind;
+        array->size = source.array.size;
+        if (array->size == 0) {
+            return;
+        }
+        array->values = (JsonValue *)cursor->nodes;
+        if (array->kind == JSON_ARRAY_NUMBERS) {
+            memcpy(array->numbers, source.array.numbers,
+                   sizeof(double) * array->size);
+            cursor->nodes += sizeof(double) * array->size;
+        } else if (array->kind == JSON_ARRAY_BOOLS) {
+            memcpy(array->bools, source.array.bools, (array->size + 7) / 8);
+            cursor->nodes += (array->size + 63) / 64 * 8;
+        } else {
+            cursor->nodes += sizeof(JsonValue) * array->size;
+            for (size_t i = 0; i < array->size; i++) {
+                clone_value(&array->values[i], &source.array.values[i],
+                            cursor, JSON_VALUE_BORROWED);
+            }
+        }
+        return;
+    }
+
+    case JSON_OBJECT: {
+        *copy = (JsonValue){.type = JSON_OBJECT, .flags = flags};
+        JsonObject *object = &copy->object;
+        object->size = source.object.size;
+        if (object->size == 0) {
+            return;
+        }
+        object->members = (JsonMember *)cursor->nodes;
+        cursor->nodes += sizeof(JsonMember) * object->size;
+        for (size_t i = 0; i < object->size; i++) {
+            const JsonMember *member = &source.object.members[i];
+            size_t length = member_key_length(&source, member->key);
+            object->members[i].key = cursor->strings;
+            memcpy(cursor->strings, member->key, length);
+            cursor->strings[length] = '\0';
+            cursor->strings += length + 1;
+            clone_value(&object->members[i].value, &member->value, cursor,
+                        JSON_VALUE_BORROWED);
+        }
+        return;
+    }
+
+    case JSON_NUMBER:
+    case JSON_BOOL:
+    case JSON_NULL:
+    default:
+        *copy = source;
+        copy->flags = 0;
+        return;
+    }
+}
+
+// A clone's root cannot give up its block while its children live there,
+// so the first edit that moves the root's storage copies the whole subtree
+// out. Containers below the root only copy their own children.
+static bool unclone(JsonValue *container, const JsonAllocator *allocator) {
+    JsonValue copy;
+    if (!json_value_copy(&copy, container, allocator)) {
+        return false;
+    }
+    json_value_release(container, allocator);
+    *container = copy;
+    return true;
+}
@@ -0,0 +1,159 @@
+#include "../include/file.h"
+#include "../include/allocator.h"
+#include "../include/parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FILE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static bool map_file(JsonFile *file, const char *path, unsigned flags);
+static bool read_file(JsonFile *file, const char *path);
+
+JsonFile *json_parse_file(const char *path, const JsonParseOptions *options,
+                          unsigned flags) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+
+    JsonFile *file = allocator->alloc(allocator->ctx, sizeof(JsonFile));
+    if (!file) {
+        return NULL;
+    }
+    *file = (JsonFile){
+        .root = NULL,
+        .data = NULL,
+        .length = 0,
+        .allocator = allocator,
+        .mapped = false,
+    };
+
+    if (!map_file(file, path, flags) && !read_file(file, path)) {
+        allocator->free(allocator->ctx, file);
+        return NULL;
+    }
+
+    // Every scanner in the tokenizer bounds its vector loads by the input
+    // length and finishes the tail with scalar code, so the mapping needs no
+    // padding even when the file ends exactly on a page boundary.
+    JsonParseOptions parse_options = options ? *options : (JsonParseOptions){0};
+    parse_options.allocator = allocator;
+    parse_options.borrow_strings = !(flags & JSON_FILE_COPY_STRINGS);
+
+    file->root = json_parse_ex(file->data, file->length, &parse_options);
+    if (!file->root) {
+        json_free_file(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+void json_free_file(JsonFile *file) {
+    if (!file) {
+        return;
+    }
+
+    const JsonAllocator *allocator = file->allocator;
+    free_json_value_ex((JsonValue *)file->root, allocator);
+
+#ifdef FILE_HAVE_MMAP
+    if (file->mapped) {
+        munmap((void *)file->data, file->length);
+    } else
+#endif
+    {
+        allocator->free(allocator->ctx, (void *)file->data);
+    }
+
+    allocator->free(allocator->ctx, file);
+}
+
+static bool map_file(JsonFile *file, const char *path, unsigned flags) {
+#ifdef FILE_HAVE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t length = (size_t)st.st_size;
+    void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    // The parser reads the file front to back exactly once. The advice is
+    // only a hint, so failures are ignored.
+    madvise(data, length, MADV_SEQUENTIAL);
+    madvise(data, length, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    if (flags & JSON_FILE_HUGE_PAGES) {
+        madvise(data, length, MADV_HUGEPAGE);
+    }
+#endif
+
+    file->data = data;
+    file->length = length;
+    file->mapped = true;
+    return true;
+#else
+    (void)file;
+    (void)path;
+    (void)flags;
+    return false;
+#endif
+}
+
+// Fallback for platforms without mmap and for files that cannot be mapped,
+// such as pipes or empty files.
+static bool read_file(JsonFile *file, const char *path) {
+    FILE *stream = fopen(path, "rb");
+    if (!stream) {
+        return false;
+    }
+
+    const JsonAllocator *allocator = file->allocator;
+    size_t capacity = 4096;
+    size_t length = 0;
+    char *data = allocator->alloc(allocator->ctx, capacity);
+
+    while (data) {
+        length += fread(data + length, 1, capacity - length, stream);
+        if (length < capacity) {
+            break;
+        }
+
+        capacity *= 2;
+        char *new_data = allocator->realloc(allocator->ctx, data, capacity);
+        if (!new_data) {
+            allocator->free(allocator->ctx, data);
+        }
+        data = new_data;
+    }
+
+    bool ok = data && !ferror(stream);
+    fclose(stream);
+    if (!ok) {
+        allocator->free(allocator->ctx, data);
+        return false;
+    }
+
+    file->data = data;
+    file->length = length;
+    file->mapped = false;
+    return true;
+}
@@ -0,0 +1,371 @@
+#include "../include/hash.h"
+#include "../include/allocator.h"
+#include "../include/intern.h"
+#include "../include/parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_CACHE_INITIAL_CAPACITY 64
+
+struct JsonHashEntry {
+        const void *storage;
+        uint64_t hash;
+};
+
+static uint64_t hash_value(const JsonValue *value, JsonHashCache *cache);
+static uint64_t hash_number(double number);
+static uint64_t hash_key(const JsonValue *object, const char *key);
+static bool equal_values(const JsonValue *a, const JsonValue *b,
+                         JsonHashCache *cache);
+static bool equal_arrays(const JsonArray *a, const JsonArray *b,
+                         JsonHashCache *cache);
+static bool equal_objects(const JsonObject *a, const JsonObject *b,
+                          JsonHashCache *cache);
+static bool repeats_key(const JsonObject *object, size_t index);
+static size_t count_member(const JsonObject *object, size_t from,
+                           const JsonMember *member, JsonHashCache *cache);
+static const void *cache_key(const JsonValue *value);
+static bool cache_lookup(const JsonHashCache *cache, const void *storage,
+                         uint64_t *hash);
+static void cache_store(JsonHashCache *cache, const void *storage,
+                        uint64_t hash);
+static bool cache_grow(JsonHashCache *cache);
+static uint64_t mix(uint64_t hash);
+
+void json_hash_cache_init(JsonHashCache *cache,
+                          const JsonAllocator *allocator) {
+    *cache = (JsonHashCache){
+        .entries = NULL,
+        .capacity = 0,
+        .count = 0,
+        .allocator = allocator ? allocator : json_default_allocator(),
+    };
+}
+
+void json_hash_cache_clear(JsonHashCache *cache) {
+    if (cache->entries) {
+        memset(cache->entries, 0,
+               sizeof(struct JsonHashEntry) * cache->capacity);
+    }
+    cache->count = 0;
+}
+
+void json_hash_cache_destroy(JsonHashCache *cache) {
+    cache->allocator->free(cache->allocator->ctx, cache->entries);
+    cache->entries = NULL;
+    cache->capacity = 0;
+    cache->count = 0;
+}
+
+uint64_t json_hash(const JsonValue *value) { return hash_value(value, NULL); }
+
+uint64_t json_hash_ex(const JsonValue *value, JsonHashCache *cache) {
+    return hash_value(value, cache);
+}
+
+bool json_equal(const JsonValue *a, const JsonValue *b) {
+    return json_equal_ex(a, b, NULL);
+}
+
+bool json_equal_ex(const JsonValue *a, const JsonValue *b,
+                   JsonHashCache *cache) {
+    if (a->type != b->type) {
+        return false;
+    }
+    if (cache && (a->type == JSON_OBJECT || a->type == JSON_ARRAY) &&
+        hash_value(a, cache) != hash_value(b, cache)) {
+        return false;
+    }
+    return equal_values(a, b, cache);
+}
+
+// Object members are combined with a sum so that member order does not
+// matter; arrays mix their elements in order. Every array kind hashes its
+// elements the same way, so typed and boxed arrays of equal values match.
+static uint64_t hash_value(const JsonValue *value, JsonHashCache *cache) {
+    const void *storage = cache ? cache_key(value) : NULL;
+    uint64_t hash;
+    if (storage && cache_lookup(cache, storage, &hash)) {
+        return hash;
+    }
+
+    hash = mix((uint64_t)value->type + 1);
+    switch (value->type) {
+    case JSON_STRING: {
+        size_t length;
+        const char *string = json_string(value, &length);
+        return mix(hash ^ json_hash_bytes(string, length));
+    }
+
+    case JSON_NUMBER:
+        return hash_number(value->number);
+
+    case JSON_BOOL:
+        return mix(hash ^ (uint64_t)value->boolean);
+
+    case JSON_NULL:
+        return hash;
+
+    case JSON_ARRAY: {
+        const JsonArray *array = &value->array;
+        for (size_t i = 0; i < array->size; i++) {
+            uint64_t element;
+            if (array->kind == JSON_ARRAY_NUMBERS) {
+                element = hash_number(array->numbers[i]);
+            } else if (array->kind == JSON_ARRAY_BOOLS) {
+                JsonValue boolean = json_array_get(array, i);
+                element = hash_value(&boolean, NULL);
+            } else {
+                element = hash_value(&array->values[i], cache);
+            }
+            hash = mix(hash * 31 + element);
+        }
+        break;
+    }
+
+    case JSON_OBJECT: {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < value->object.size; i++) {
+            const JsonMember *member = &value->object.members[i];
+            sum += mix(hash_key(value, member->key) ^
+                       hash_value(&member->value, cache));
+        }
+        hash = mix(hash ^ sum);
+        break;
+    }
+    }
+
+    if (storage) {
+        cache_store(cache, storage, hash);
+    }
+    return hash;
+}
+
+static uint64_t hash_number(double number) {
+    // 0 and -0 compare equal, so they must hash equally.
+    if (number == 0) {
+        number = 0;
+    }
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    return mix(mix((uint64_t)JSON_NUMBER + 1) ^ bits);
+}
+
+// Interned keys carry their hash, which is the same json_hash_bytes value.
+static uint64_t hash_key(const JsonValue *object, const char *key) {
+    if (object->flags & JSON_VALUE_INTERNED_KEYS) {
+        return json_key_of(key)->hash;
+    }
+    return json_hash_bytes(key, strlen(key));
+}
+
+static bool equal_values(const JsonValue *a, const JsonValue *b,
+                         JsonHashCache *cache) {
+    switch (a->type) {
+    case JSON_STRING: {
+        size_t a_length;
+        size_t b_length;
+        const char *a_string = json_string(a, &a_length);
+        const char *b_string = json_string(b, &b_length);
+        return a_length == b_length &&
+               memcmp(a_string, b_string, a_length) == 0;
+    }
+
+    case JSON_NUMBER:
+        return a->number == b->number;
+
+    case JSON_BOOL:
+        return a->boolean == b->boolean;
+
+    case JSON_ARRAY:
+        return equal_arrays(&a->array, &b->array, cache);
+
+    case JSON_OBJECT:
+        return equal_objects(&a->object, &b->object, cache);
+
+    case JSON_NULL:
+    default:
+        return true;
+    }
+}
+
+static bool equal_arrays(const JsonArray *a, const JsonArray *b,
+                         JsonHashCache *cache) {
+    if (a->size != b->size) {
+        return false;
+    }
+    if (a->kind == JSON_ARRAY_NUMBERS && b->kind == JSON_ARRAY_NUMBERS) {
+        for (size_t i = 0; i < a->size; i++) {
+            if (a->numbers[i] != b->numbers[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    for (size_t i = 0; i < a->size; i++) {
+        JsonValue a_element = json_array_get(a, i);
+        JsonValue b_element = json_array_get(b, i);
+        if (!json_equal_ex(&a_element, &b_element, cache)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool equal_objects(const JsonObject *a, const JsonObject *b,
+                          JsonHashCache *cache) {
+    if (a->size != b->size) {
+        return false;
+    }
+
+    // Objects of the same shape, or whose keys happen to line up, compare
+    // member for member.
+    bool same_shape = a->shape && a->shape == b->shape;
+    size_t i = 0;
+    while (i < a->size &&
+           (same_shape || a->members[i].key == b->members[i].key ||
+            strcmp(a->members[i].key, b->members[i].key) == 0)) {
+        if (!json_equal_ex(&a->members[i].value, &b->members[i].value,
+                           cache)) {
+            // Settled unless the key comes up again, in which case the
+            // matching member may sit elsewhere.
+            if (!repeats_key(a, i)) {
+                return false;
+            }
+            break;
+        }
+        i++;
+    }
+    // The rest is compared as a multiset of members, as json_hash sees it:
+    // with duplicate keys a lookup would let {"a":1,"a":1} equal
+    // {"a":1,"b":2} but not the reverse. Every member must occur as often
+    // in b as in a, which with equal sizes leaves b nothing else.
+    size_t first = i;
+    for (; i < a->size; i++) {
+        size_t in_b = count_member(b, first, &a->members[i], cache);
+        if (in_b == 0 ||
+            in_b != count_member(a, first, &a->members[i], cache)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool repeats_key(const JsonObject *object, size_t index) {
+    const char *key = object->members[index].key;
+    for (size_t i = index + 1; i < object->size; i++) {
+        if (object->members[i].key == key ||
+            strcmp(object->members[i].key, key) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t count_member(const JsonObject *object, size_t from,
+                           const JsonMember *member, JsonHashCache *cache) {
+    size_t count = 0;
+    for (size_t i = from; i < object->size; i++) {
+        const JsonMember *other = &object->members[i];
+        if ((other->key == member->key ||
+             strcmp(other->key, member->key) == 0) &&
+            json_equal_ex(&other->value, &member->value, cache)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Non-empty containers are identified by their children storage; scalars
+// and empty containers are cheap enough to rehash.
+static const void *cache_key(const JsonValue *value) {
+    if (value->type == JSON_OBJECT) {
+        return value->object.members;
+    }
+    if (value->type == JSON_ARRAY) {
+        return value->array.values;
+    }
+    return NULL;
+}
+
+static bool cache_lookup(const JsonHashCache *cache, const void *storage,
+                         uint64_t *hash) {
+    if (cache->count == 0) {
+        return false;
+    }
+
+    size_t mask = cache->capacity - 1;
+    size_t index = (size_t)mix((uintptr_t)storage) & mask;
+    while (cache->entries[index].storage) {
+        if (cache->entries[index].storage == storage) {
+            *hash = cache->entries[index].hash;
+            return true;
+        }
+        index = (index + 1) & mask;
+    }
+    return false;
+}
+
+// Caching is best effort: if the table cannot grow the hash is simply not
+// remembered.
+static void cache_store(JsonHashCache *cache, const void *storage,
+                        uint64_t hash) {
+    if ((cache->count + 1) * 2 > cache->capacity && !cache_grow(cache)) {
+        return;
+    }
+
+    size_t mask = cache->capacity - 1;
+    size_t index = (size_t)mix((uintptr_t)storage) & mask;
+    while (cache->entries[index].storage &&
+           cache->entries[index].storage != storage) {
+        index = (index + 1) & mask;
+    }
+    if (!cache->entries[index].storage) {
+        cache->count++;
+    }
+    cache->entries[index].storage = storage;
+    cache->entries[index].hash = hash;
+}
+
+static bool cache_grow(JsonHashCache *cache) {
+    size_t capacity =
+        cache->capacity ? cache->capacity * 2 : HASH_CACHE_INITIAL_CAPACITY;
+
+    const JsonAllocator *allocator = cache->allocator;
+    struct JsonHashEntry *entries = allocator->alloc(
+        allocator->ctx, sizeof(struct JsonHashEntry) * capacity);
+    if (!entries) {
+        return false;
+    }
+    memset(entries, 0, sizeof(struct JsonHashEntry) * capacity);
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < cache->capacity; i++) {
+        struct JsonHashEntry *entry = &cache->entries[i];
+        if (!entry->storage) {
+            continue;
+        }
+        size_t index = (size_t)mix((uintptr_t)entry->storage) & mask;
+        while (entries[index].storage) {
+            index = (index + 1) & mask;
+        }
+        entries[index] = *entry;
+    }
+
+    allocator->free(allocator->ctx, cache->entries);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return true;
+}
+
+static uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
@@ -0,0 +1,116 @@
+#include "../include/intern.h"
+#include "../include/allocator.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define KEY_TABLE_INITIAL_CAPACITY 64
+
+static bool key_table_grow(JsonKeyTable *table);
+
+void json_key_table_init(JsonKeyTable *table, const JsonAllocator *allocator) {
+    *table = (JsonKeyTable){
+        .entries = NULL,
+        .capacity = 0,
+        .count = 0,
+        .allocator = allocator ? allocator : json_default_allocator(),
+    };
+}
+
+const char *json_key_table_intern(JsonKeyTable *table,
+                                  const JsonAllocator *key_allocator,
+                                  const char *key, size_t length) {
+    if (length > UINT32_MAX) {
+        return NULL;
+    }
+
+    // Keep the load factor at or below one half.
+    if ((table->count + 1) * 2 > table->capacity && !key_table_grow(table)) {
+        return NULL;
+    }
+
+    uint64_t hash = json_hash_bytes(key, length);
+    size_t mask = table->capacity - 1;
+    size_t index = (size_t)hash & mask;
+
+    while (table->entries[index]) {
+        JsonKey *entry = table->entries[index];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->chars, key, length) == 0) {
+            return entry->chars;
+        }
+        index = (index + 1) & mask;
+    }
+
+    JsonKey *entry = key_allocator->alloc(key_allocator->ctx,
+                                          sizeof(JsonKey) + length + 1);
+    if (!entry) {
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->length = (uint32_t)length;
+    memcpy(entry->chars, key, length);
+    entry->chars[length] = '\0';
+
+    table->entries[index] = entry;
+    table->count++;
+
+    return entry->chars;
+}
+
+void json_key_table_clear(JsonKeyTable *table) {
+    if (table->entries) {
+        memset(table->entries, 0, sizeof(JsonKey *) * table->capacity);
+    }
+    table->count = 0;
+}
+
+void json_key_table_destroy(JsonKeyTable *table) {
+    table->allocator->free(table->allocator->ctx, table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+// FNV-1a. Keys are short, so a byte loop is cheaper than anything that needs
+// setup or a tail.
+uint64_t json_hash_bytes(const char *data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool key_table_grow(JsonKeyTable *table) {
+    size_t capacity =
+        table->capacity ? table->capacity * 2 : KEY_TABLE_INITIAL_CAPACITY;
+
+    const JsonAllocator *allocator = table->allocator;
+    JsonKey **entries =
+        allocator->alloc(allocator->ctx, sizeof(JsonKey *) * capacity);
+    if (!entries) {
+        return false;
+    }
+    memset(entries, 0, sizeof(JsonKey *) * capacity);
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < table->capacity; i++) {
+        JsonKey *entry = table->entries[i];
+        if (!entry) {
+            continue;
+        }
+        size_t index = (size_t)entry->hash & mask;
+        while (entries[index]) {
+            index = (index + 1) & mask;
+        }
+        entries[index] = entry;
+    }
+
+    allocator->free(allocator->ctx, table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    return true;
+}
@@ -0,0 +1,126 @@
+#include "../include/number.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NUMBER_MAX_DIGITS 19
+#define NUMBER_MAX_EXACT_MANTISSA (1ull << 53)
+#define NUMBER_MAX_EXACT_POWER 22
+
+// Every power of ten up to 1e22 is exactly representable as a double.
+static const double powers_of_ten[NUMBER_MAX_EXACT_POWER + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const char *parse_digits(const char *p, const char *end,
+                                uint64_t *mantissa, size_t *digits);
+static bool is_eight_digits(uint64_t chunk);
+static uint32_t parse_eight_digits(uint64_t chunk);
+
+bool json_number_parse_fast(const char *input, size_t length,
+                            double *number) {
+    const char *p = input;
+    const char *end = input + length;
+    bool negative = p < end && *p == '-';
+    if (negative) {
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    size_t digits = 0;
+    p = parse_digits(p, end, &mantissa, &digits);
+
+    int exponent = 0;
+    if (p < end && *p == '.') {
+        size_t integer_digits = digits;
+        p = parse_digits(p + 1, end, &mantissa, &digits);
+        exponent = -(int)(digits - integer_digits);
+    }
+    if (digits > NUMBER_MAX_DIGITS) {
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negative_exponent = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            p++;
+        }
+        int value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (value > 1000) {
+                return false;
+            }
+            value = value * 10 + (*p - '0');
+        }
+        exponent += negative_exponent ? -value : value;
+    }
+    if (p != end) {
+        return false;
+    }
+
+    // Clinger's fast path: both operands are exact, so one IEEE operation
+    // gives the correctly rounded result.
+    if (mantissa > NUMBER_MAX_EXACT_MANTISSA ||
+        exponent < -NUMBER_MAX_EXACT_POWER ||
+        exponent > NUMBER_MAX_EXACT_POWER) {
+        return false;
+    }
+    double value = (double)mantissa;
+    if (exponent < 0) {
+        value /= powers_of_ten[-exponent];
+    } else {
+        value *= powers_of_ten[exponent];
+    }
+    *number = negative ? -value : value;
+    return true;
+}
+
+// Long digit runs are consumed eight at a time. Once more digits than fit in
+// the mantissa have been seen the caller gives up, so overflow here is
+// harmless.
+static const char *parse_digits(const char *p, const char *end,
+                                uint64_t *mantissa, size_t *digits) {
+    uint64_t value = *mantissa;
+    size_t count = *digits;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - p >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, p, sizeof(chunk));
+        if (!is_eight_digits(chunk)) {
+            break;
+        }
+        value = value * 100000000 + parse_eight_digits(chunk);
+        count += 8;
+        p += 8;
+    }
+#endif
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (uint64_t)(*p - '0');
+        count++;
+    }
+
+    *mantissa = value;
+    *digits = count;
+    return p;
+}
+
+// SWAR checks and conversions over eight little-endian ASCII bytes.
+static bool is_eight_digits(uint64_t chunk) {
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) |
+            (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+           0x3333333333333333;
+}
+
+static uint32_t parse_eight_digits(uint64_t chunk) {
+    const uint64_t mask = 0x000000FF000000FF;
+    const uint64_t mul1 = 100 + (1000000ull << 32);
+    const uint64_t mul2 = 1 + (10000ull << 32);
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t)chunk;
+}
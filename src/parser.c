@@ -1,4 +1,9 @@
 #include "../include/parser.h"
+#include "../include/allocator.h"
+#include "../include/arena.h"
+#include "../include/intern.h"
+#include "../include/number.h"
+#include "../include/stats.h"
 #include "../include/tokenizer.h"
 #include <errno.h>
 #include <stdbool.h>
@@ -6,371 +11,1354 @@
 #include <stdlib.h>
 #include <string.h>
 
-static char *extract_json_string(JsonToken *token);
-static double *extract_json_number(JsonToken *token);
-static JsonValue *extract_json_value(JsonToken *token);
-static JsonArray *extract_json_array(JsonTokenizerCtx *ctx, bool is_nested);
-static JsonObject *extract_json_object(JsonTokenizerCtx *ctx, bool is_nested);
+#define PARSER_ARENA_CHUNK_SIZE 16384
+#define PARSER_TOKEN_BATCH 64
+
+// An open container: where its children start on the scratch stacks and, for
+// arrays, whether they are still collected unboxed. An array remembers its
+// last record to offer as a shape to the next one; an object keeps the shape
+// it was offered.
+typedef struct {
+        size_t values_base;
+        size_t keys_base;
+        size_t numbers_base;
+        JsonObject previous;
+        JsonArrayKind kind;
+        bool object;
+} JsonFrame;
+
+// Containers collect their children here while they are being parsed and get
+// an exactly sized array of nodes once they close. Nested containers push
+// above their parent's entries, so one stack serves the whole document, and
+// frames holds one JsonFrame per open container.
+typedef struct {
+        JsonFrame *frames;
+        size_t frames_capacity;
+        JsonValue *values;
+        size_t values_size;
+        size_t values_capacity;
+        char **keys;
+        size_t keys_size;
+        size_t keys_capacity;
+        double *numbers;
+        size_t numbers_size;
+        size_t numbers_capacity;
+        char *buffer;
+        size_t buffer_capacity;
+} JsonScratch;
+
+// What the parser keeps of a token: small enough to travel in two registers
+// like a compact token, but with room for any length.
+typedef struct {
+        const char *start;
+        uint64_t type : 4;
+        uint64_t length : 60;
+} ParserToken;
+
+// Tokens are pulled from the tokenizer in batches of compact tokens whose
+// offsets are relative to token_base; next_token widens them to
+// ParserTokens.
+typedef struct {
+        JsonTokenizerCtx tokenizer;
+        JsonCompactToken tokens[PARSER_TOKEN_BATCH];
+        const char *token_base;
+        size_t token_count;
+        size_t token_index;
+        size_t consumed;
+        const JsonAllocator *allocator;
+        const JsonAllocator *scratch_allocator;
+        JsonScratch *scratch;
+        JsonParseStats *stats;
+        JsonKeyTable *keys;
+        size_t depth;
+        size_t max_depth;
+        bool borrow_strings;
+} JsonParseState;
+
+struct JsonParser {
+        JsonArena arena;
+        JsonScratch scratch;
+        JsonKeyTable keys;
+        const JsonAllocator *backing;
+        JsonParseStats *stats;
+        unsigned tokenizer_flags;
+        size_t max_depth;
+        bool borrow_strings;
+};
+
+// What a push parser accepts next.
+typedef enum {
+    PUSH_EXPECT_VALUE,
+    PUSH_EXPECT_VALUE_OR_CLOSE,
+    PUSH_EXPECT_KEY,
+    PUSH_EXPECT_KEY_OR_CLOSE,
+    PUSH_EXPECT_COLON,
+    PUSH_EXPECT_COMMA_OR_CLOSE,
+    PUSH_EXPECT_END,
+} PushExpect;
+
+// Between calls the document lives entirely in scratch, the open frames and
+// expect; pending holds the start of a token cut off by the end of the last
+// piece. Only the document-building fields of state are used.
+struct JsonPushParser {
+        JsonParseState state;
+        JsonScratch scratch;
+        JsonValue root;
+        char *pending;
+        size_t pending_size;
+        size_t pending_capacity;
+        unsigned tokenizer_flags;
+        PushExpect expect;
+        bool failed;
+        bool finished;
+};
+
+static unsigned tokenizer_flags(const JsonParseOptions *options);
+static JsonValue *parse_document(JsonParseState *state, bool any_value);
+static bool parse_value(JsonParseState *state, ParserToken token,
+                        JsonValue *value);
+static ParserToken next_token(JsonParseState *state);
+static void *parser_alloc(JsonParseState *state, size_t size);
+static void parser_free(JsonParseState *state, void *ptr);
+static bool scratch_reserve(JsonParseState *state, void **items,
+                            size_t *capacity, size_t needed, size_t item_size);
+static bool scratch_push_value(JsonParseState *state, const JsonValue *value);
+static bool scratch_push_key(JsonParseState *state, char *key);
+static bool scratch_push_number(JsonParseState *state, double number);
+static void scratch_destroy(JsonScratch *scratch,
+                            const JsonAllocator *allocator);
+static char *extract_json_string(JsonParseState *state,
+                                 ParserToken *token);
+static char *extract_json_key(JsonParseState *state, ParserToken *token);
+static bool extract_json_number(JsonParseState *state, ParserToken *token,
+                                double *number);
+static bool extract_json_value(JsonParseState *state, ParserToken *token,
+                               JsonValue *value);
+static bool open_container(JsonParseState *state, bool object);
+static bool close_container(JsonParseState *state, JsonValue *value);
+static bool extract_member_key(JsonParseState *state, ParserToken *token);
+static bool push_member_key(JsonParseState *state, ParserToken *token);
+static JsonArrayKind first_element_kind(JsonTokenType type);
+static bool collect_typed_element(JsonParseState *state, JsonFrame *frame,
+                                  ParserToken *token, bool *collected);
+static bool box_typed_elements(JsonParseState *state, JsonArrayKind kind,
+                               size_t numbers_base);
+static bool store_typed_elements(JsonParseState *state, JsonArray *array,
+                                 JsonArrayKind kind, size_t numbers_base);
+static bool same_shape(const JsonObject *shape, char *const *keys,
+                       size_t size);
+static bool push_token(JsonPushParser *parser, const JsonToken *token);
+static bool push_value(JsonPushParser *parser, JsonValue *value);
+static bool push_pending(JsonPushParser *parser);
+static bool keep_pending(JsonPushParser *parser, const char *bytes,
+                         size_t length);
+static bool find_token_end(const char *seen, size_t seen_length,
+                           const char *input, size_t length, size_t *end);
+static bool is_word_byte(char c);
+static JsonPushStatus push_fail(JsonPushParser *parser);
+static void discard_document(JsonPushParser *parser);
+static void release_json_value(JsonValue *value,
+                               const JsonAllocator *allocator);
+
+bool json_stats_enabled(void) {
+#ifdef JSONIC_STATS
+    return true;
+#else
+    return false;
+#endif
+}
 
 JsonObject *json_parse(const char *input, size_t input_length) {
-    JsonTokenizerCtx ctx = json_tokenizer_init(input, input_length);
+    return json_parse_ex(input, input_length, NULL);
+}
 
-    JsonObject *object = extract_json_object(&ctx, false);
+JsonObject *json_parse_ex(const char *input, size_t input_length,
+                          const JsonParseOptions *options) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+    JsonScratch scratch = {0};
+    JsonParseState state = {
+        .tokenizer = json_tokenizer_init_ex(input, input_length,
+                                            tokenizer_flags(options)),
+        .allocator = allocator,
+        .scratch_allocator = allocator,
+        .scratch = &scratch,
+        .stats = options ? options->stats : NULL,
+        .depth = 0,
+        .max_depth = json_parse_max_depth(options),
+        .borrow_strings = options && options->borrow_strings,
+    };
 
-    if (object) {
-        JsonToken token = json_tokenizer_next(&ctx);
-        if (token.type != TOKEN_EOF) {
-            free_json_value((JsonValue *)object);
-            return NULL;
-        }
+    JsonValue *root = parse_document(&state, false);
+    scratch_destroy(&scratch, allocator);
+
+    return root ? &root->object : NULL;
+}
+
+JsonValue *json_parse_value(const char *input, size_t input_length) {
+    return json_parse_value_ex(input, input_length, NULL);
+}
+
+JsonValue *json_parse_value_ex(const char *input, size_t input_length,
+                               const JsonParseOptions *options) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+    JsonScratch scratch = {0};
+    JsonParseState state = {
+        .tokenizer = json_tokenizer_init_ex(input, input_length,
+                                            tokenizer_flags(options)),
+        .allocator = allocator,
+        .scratch_allocator = allocator,
+        .scratch = &scratch,
+        .stats = options ? options->stats : NULL,
+        .depth = 0,
+        .max_depth = json_parse_max_depth(options),
+        .borrow_strings = options && options->borrow_strings,
+    };
+
+    JsonValue *root = parse_document(&state, true);
+    scratch_destroy(&scratch, allocator);
+
+    return root;
+}
+
+JsonParser *json_parser_create(const JsonParseOptions *options) {
+    const JsonAllocator *backing = options && options->allocator
+                                       ? options->allocator
+                                       : json_default_allocator();
+
+    JsonParser *parser = backing->alloc(backing->ctx, sizeof(JsonParser));
+    if (!parser) {
+        return NULL;
     }
+    json_arena_init(&parser->arena, backing, PARSER_ARENA_CHUNK_SIZE);
+    parser->scratch = (JsonScratch){0};
+    json_key_table_init(&parser->keys, backing);
+    parser->backing = backing;
+    parser->stats = options ? options->stats : NULL;
+    parser->tokenizer_flags = tokenizer_flags(options);
+    parser->max_depth = json_parse_max_depth(options);
+    parser->borrow_strings = options && options->borrow_strings;
+
+    return parser;
+}
+
+JsonObject *json_parser_parse(JsonParser *parser, const char *input,
+                              size_t input_length) {
+    JsonParseState state = {
+        .tokenizer = json_tokenizer_init_ex(input, input_length,
+                                            parser->tokenizer_flags),
+        .allocator = json_arena_allocator(&parser->arena),
+        .scratch_allocator = parser->backing,
+        .scratch = &parser->scratch,
+        .stats = parser->stats,
+        .keys = &parser->keys,
+        .depth = 0,
+        .max_depth = parser->max_depth,
+        .borrow_strings = parser->borrow_strings,
+    };
 
-    return object;
+    JsonValue *root = parse_document(&state, false);
+    return root ? &root->object : NULL;
 }
 
-static char *extract_json_string(JsonToken *token) {
-    if (token->length <= 2) {
-        return strdup("");
+void json_parser_reset(JsonParser *parser) {
+    json_arena_reset(&parser->arena);
+    json_key_table_clear(&parser->keys);
+}
+
+const char *json_parser_intern(JsonParser *parser, const char *key,
+                               size_t length) {
+    return json_key_table_intern(&parser->keys,
+                                 json_arena_allocator(&parser->arena), key,
+                                 length);
+}
+
+const JsonAllocator *json_parser_allocator(JsonParser *parser) {
+    return json_arena_allocator(&parser->arena);
+}
+
+void json_parser_destroy(JsonParser *parser) {
+    if (!parser) {
+        return;
     }
 
-    char *string = strndup(token->start + 1, token->length - 2);
-    if (!string) {
+    const JsonAllocator *backing = parser->backing;
+    json_arena_destroy(&parser->arena);
+    scratch_destroy(&parser->scratch, backing);
+    json_key_table_destroy(&parser->keys);
+    backing->free(backing->ctx, parser);
+}
+
+JsonPushParser *json_push_parser_create(const JsonParseOptions *options) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+
+    JsonPushParser *parser =
+        allocator->alloc(allocator->ctx, sizeof(JsonPushParser));
+    if (!parser) {
         return NULL;
     }
+    *parser = (JsonPushParser){
+        .state =
+            {
+                .allocator = allocator,
+                .scratch_allocator = allocator,
+                .scratch = &parser->scratch,
+                .max_depth = json_parse_max_depth(options),
+            },
+        .tokenizer_flags = tokenizer_flags(options),
+        .expect = PUSH_EXPECT_VALUE,
+    };
 
-    return string;
+    return parser;
 }
 
-static double *extract_json_number(JsonToken *token) {
-    char *num_str = strndup(token->start, token->length);
-    if (!num_str) {
-        return NULL;
+JsonPushStatus json_push_parser_feed(JsonPushParser *parser, const char *input,
+                                     size_t input_length, size_t budget,
+                                     size_t *consumed) {
+    *consumed = 0;
+    if (parser->failed || parser->finished) {
+        return JSON_PUSH_ERROR;
     }
 
-    char *endptr;
-    errno = 0;
-    double number = strtod(num_str, &endptr);
+    size_t pos = 0;
+    size_t tokens = 0;
+    if (parser->pending_size > 0) {
+        size_t end;
+        bool complete = find_token_end(parser->pending, parser->pending_size,
+                                       input, input_length, &end);
+        if (!keep_pending(parser, input, complete ? end : input_length)) {
+            return push_fail(parser);
+        }
+        if (!complete) {
+            *consumed = input_length;
+            return JSON_PUSH_NEED_MORE;
+        }
+        if (!push_pending(parser)) {
+            return push_fail(parser);
+        }
+        pos = end;
+        tokens++;
+    }
 
-    if ((errno == ERANGE) || (endptr == num_str)) {
-        free(num_str);
-        return NULL;
+    JsonTokenizerCtx tokenizer = json_tokenizer_init_ex(
+        input + pos, input_length - pos, parser->tokenizer_flags);
+    for (;;) {
+        if (budget && tokens == budget &&
+            tokenizer.pos < tokenizer.input_length) {
+            *consumed = pos + tokenizer.pos;
+            return JSON_PUSH_SUSPENDED;
+        }
+
+        size_t start = tokenizer.pos;
+        JsonToken token = json_tokenizer_next(&tokenizer);
+        if (token.type == TOKEN_EOF) {
+            break;
+        }
+
+        // A number or literal that runs to the end of the piece may go on in
+        // the next one, and a token may have been rejected only for want of
+        // bytes. Either is carried over when no delimiter or closing quote
+        // shows where it ends.
+        bool at_end = token.type != TOKEN_STRING && token.start &&
+                      token.start + token.length ==
+                          tokenizer.input + tokenizer.input_length;
+        if (at_end || token.type == TOKEN_INVALID) {
+            const char *rest = tokenizer.input + start;
+            size_t rest_length = tokenizer.input_length - start;
+            while (*rest == ' ' || *rest == '\t' || *rest == '\n' ||
+                   *rest == '\r') {
+                rest++;
+                rest_length--;
+            }
+            size_t end;
+            if ((*rest == '"' || is_word_byte(*rest)) &&
+                !find_token_end(rest, 1, rest + 1, rest_length - 1, &end)) {
+                if (!keep_pending(parser, rest, rest_length)) {
+                    return push_fail(parser);
+                }
+                break;
+            }
+        }
+
+        if (!push_token(parser, &token)) {
+            return push_fail(parser);
+        }
+        tokens++;
     }
 
-    double *number_ptr = malloc(sizeof(double));
-    if (!number_ptr) {
+    *consumed = input_length;
+    return JSON_PUSH_NEED_MORE;
+}
+
+JsonPushStatus json_push_parser_finish(JsonPushParser *parser) {
+    if (parser->failed) {
+        return JSON_PUSH_ERROR;
+    }
+    if (parser->pending_size > 0 && !push_pending(parser)) {
+        return push_fail(parser);
+    }
+    if (parser->expect != PUSH_EXPECT_END) {
+        return push_fail(parser);
+    }
+    parser->finished = true;
+    return JSON_PUSH_DONE;
+}
+
+JsonValue *json_push_parser_take(JsonPushParser *parser) {
+    if (!parser->finished) {
         return NULL;
     }
 
-    free(num_str);
-    *number_ptr = number;
+    // As with parse_document, the root is a full JsonValue so it can be
+    // handed to free_json_value.
+    JsonValue *root = parser_alloc(&parser->state, sizeof(JsonValue));
+    if (root) {
+        *root = parser->root;
+        parser->expect = PUSH_EXPECT_VALUE;
+    }
+    json_push_parser_reset(parser);
+    return root;
+}
+
+void json_push_parser_reset(JsonPushParser *parser) {
+    discard_document(parser);
+    parser->failed = false;
+    parser->finished = false;
+}
+
+void json_push_parser_destroy(JsonPushParser *parser) {
+    if (!parser) {
+        return;
+    }
+
+    const JsonAllocator *allocator = parser->state.allocator;
+    discard_document(parser);
+    scratch_destroy(&parser->scratch, allocator);
+    allocator->free(allocator->ctx, parser->pending);
+    allocator->free(allocator->ctx, parser);
+}
+
+// The parser never reports token positions, so line/column tracking is
+// always left to json_tokenizer_position.
+static unsigned tokenizer_flags(const JsonParseOptions *options) {
+    unsigned flags = JSON_TOKENIZER_LAZY_POSITIONS;
+    if (options && options->validate_utf8) {
+        flags |= JSON_TOKENIZER_VALIDATE_UTF8;
+    }
+    return flags;
+}
 
-    return number_ptr;
+size_t json_parse_max_depth(const JsonParseOptions *options) {
+    if (!options || !options->max_depth) {
+        return JSON_DEFAULT_MAX_DEPTH;
+    }
+    return options->max_depth < JSON_MAX_DEPTH ? options->max_depth
+                                               : JSON_MAX_DEPTH;
 }
 
-static JsonArray *extract_json_array(JsonTokenizerCtx *ctx, bool is_nested) {
-    JsonToken token;
-    if (!is_nested) {
-        token = json_tokenizer_next(ctx);
-        if (token.type != TOKEN_LEFT_BRACKET) {
-            return NULL;
+static JsonValue *parse_document(JsonParseState *state, bool any_value) {
+    if (state->stats) {
+        memset(state->stats, 0, sizeof(*state->stats));
+    }
+    JSON_STATS_TIMER_START(parse_start);
+
+    // The root is allocated as a full JsonValue so the returned JsonObject
+    // can be handed back to free_json_value.
+    JsonValue *root = parser_alloc(state, sizeof(JsonValue));
+    if (root) {
+        ParserToken token = next_token(state);
+        bool extracted = (any_value || token.type == TOKEN_LEFT_BRACE) &&
+                         parse_value(state, token, root);
+        if (!extracted) {
+            parser_free(state, root);
+            root = NULL;
+        } else if (next_token(state).type != TOKEN_EOF) {
+            free_json_value_ex(root, state->allocator);
+            root = NULL;
         }
-        token = json_tokenizer_next(ctx);
+    }
+
+#ifdef JSONIC_STATS
+    if (state->stats) {
+        // Tokenizer time is accumulated separately, the rest is tree building.
+        state->stats->bytes_consumed = state->consumed;
+        state->stats->phase_cycles[JSON_PHASE_BUILD] =
+            json_stats_cycles() - parse_start -
+            state->stats->phase_cycles[JSON_PHASE_TOKENIZE];
+    }
+#endif
+
+    return root;
+}
+
+static ParserToken next_token(JsonParseState *state) {
+    if (state->token_index == state->token_count) {
+        JSON_STATS_TIMER_START(tokenize_start);
+        state->token_base = state->tokenizer.input + state->tokenizer.pos;
+        state->token_count = json_tokenizer_next_batch(
+            &state->tokenizer, state->tokens, PARSER_TOKEN_BATCH);
+        state->token_index = 0;
+        JSON_STATS_TIMER_STOP(state->stats, JSON_PHASE_TOKENIZE,
+                              tokenize_start);
+    }
+
+    ParserToken token;
+    if (state->token_index < state->token_count) {
+        JsonCompactToken compact = state->tokens[state->token_index++];
+        token = (ParserToken){
+            .start = state->token_base + compact.offset,
+            .type = compact.type,
+            .length = compact.length,
+        };
     } else {
-        token = json_tokenizer_next(ctx);
+        // Too long for a compact token; the tokenizer is left at it.
+        JSON_STATS_TIMER_START(tokenize_start);
+        JsonToken full = json_tokenizer_next(&state->tokenizer);
+        token = (ParserToken){
+            .start = full.start,
+            .type = full.type,
+            .length = full.length,
+        };
+        JSON_STATS_TIMER_STOP(state->stats, JSON_PHASE_TOKENIZE,
+                              tokenize_start);
+    }
+#ifdef JSONIC_STATS
+    if (state->stats) {
+        state->stats->token_counts[token.type]++;
+        // Invalid tokens have no start; the tokenizer stopped on them.
+        state->consumed = token.start ? (size_t)(token.start -
+                                                 state->tokenizer.input) +
+                                            token.length
+                                      : state->tokenizer.pos;
+    }
+#endif
+    return token;
+}
+
+static void *parser_alloc(JsonParseState *state, size_t size) {
+    JSON_STATS_ALLOC(state->stats, size);
+    return state->allocator->alloc(state->allocator->ctx, size);
+}
+
+static void parser_free(JsonParseState *state, void *ptr) {
+    state->allocator->free(state->allocator->ctx, ptr);
+}
+
+static bool scratch_reserve(JsonParseState *state, void **items,
+                            size_t *capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return true;
     }
 
-    JsonArray *array = malloc(sizeof(JsonArray));
-    if (!array) {
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    const JsonAllocator *allocator = state->scratch_allocator;
+    void *new_items =
+        allocator->realloc(allocator->ctx, *items, new_capacity * item_size);
+    if (!new_items) {
+        return false;
+    }
+    JSON_STATS_ALLOC(state->stats, new_capacity * item_size);
+
+    *items = new_items;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool scratch_push_value(JsonParseState *state, const JsonValue *value) {
+    JsonScratch *scratch = state->scratch;
+    if (!scratch_reserve(state, (void **)&scratch->values,
+                         &scratch->values_capacity, scratch->values_size + 1,
+                         sizeof(JsonValue))) {
+        return false;
+    }
+    scratch->values[scratch->values_size++] = *value;
+    return true;
+}
+
+static bool scratch_push_key(JsonParseState *state, char *key) {
+    JsonScratch *scratch = state->scratch;
+    if (!scratch_reserve(state, (void **)&scratch->keys,
+                         &scratch->keys_capacity, scratch->keys_size + 1,
+                         sizeof(char *))) {
+        return false;
+    }
+    scratch->keys[scratch->keys_size++] = key;
+    return true;
+}
+
+static bool scratch_push_number(JsonParseState *state, double number) {
+    JsonScratch *scratch = state->scratch;
+    if (!scratch_reserve(state, (void **)&scratch->numbers,
+                         &scratch->numbers_capacity, scratch->numbers_size + 1,
+                         sizeof(double))) {
+        return false;
+    }
+    scratch->numbers[scratch->numbers_size++] = number;
+    return true;
+}
+
+static void scratch_destroy(JsonScratch *scratch,
+                            const JsonAllocator *allocator) {
+    allocator->free(allocator->ctx, scratch->frames);
+    allocator->free(allocator->ctx, scratch->values);
+    allocator->free(allocator->ctx, scratch->keys);
+    allocator->free(allocator->ctx, scratch->numbers);
+    allocator->free(allocator->ctx, scratch->buffer);
+    *scratch = (JsonScratch){0};
+}
+
+static char *extract_json_string(JsonParseState *state,
+                                 ParserToken *token) {
+    size_t length = token->length <= 2 ? 0 : token->length - 2;
+
+    char *string = parser_alloc(state, length + 1);
+    if (!string) {
         return NULL;
     }
-    array->size = 0;
-    array->values = NULL;
+    memcpy(string, token->start + 1, length);
+    string[length] = '\0';
+    JSON_STATS_ADD(state->stats, strings_copied, 1);
 
-    while (token.type != TOKEN_RIGHT_BRACKET && token.type != TOKEN_EOF) {
-        JsonValue **new_values =
-            realloc(array->values, sizeof(JsonValue *) * (array->size + 1));
-        if (!new_values) {
-            goto error_cleanup;
-        }
-        array->values = new_values;
+    return string;
+}
 
-        array->values[array->size] = malloc(sizeof(JsonValue));
-        if (!array->values[array->size]) {
-            goto error_cleanup;
-        }
+// Keys are interned when the parser owns a key table: every occurrence of a
+// key shares one copy, and only the first one is counted as copied.
+static char *extract_json_key(JsonParseState *state, ParserToken *token) {
+    if (!state->keys) {
+        return extract_json_string(state, token);
+    }
 
-        switch (token.type) {
-        case TOKEN_STRING: {
-            array->values[array->size]->type = JSON_STRING;
-            array->values[array->size]->string = extract_json_string(&token);
-            if (!array->values[array->size]->string) {
-                goto error_cleanup;
-            }
-            break;
-        }
+    size_t length = token->length <= 2 ? 0 : token->length - 2;
+#ifdef JSONIC_STATS
+    size_t count = state->keys->count;
+#endif
+    const char *key = json_key_table_intern(
+        state->keys, state->allocator, token->start + 1, length);
+#ifdef JSONIC_STATS
+    if (state->stats && state->keys->count != count) {
+        state->stats->strings_copied++;
+        JSON_STATS_ALLOC(state->stats, sizeof(JsonKey) + length + 1);
+    }
+#endif
 
-        case TOKEN_NUMBER: {
-            double *num_ptr = extract_json_number(&token);
-            if (!num_ptr) {
-                goto error_cleanup;
-            }
-            array->values[array->size]->type = JSON_NUMBER;
-            array->values[array->size]->number = *num_ptr;
-            free(num_ptr);
-            break;
-        }
+    return (char *)key;
+}
 
-        case TOKEN_LEFT_BRACE: {
-            JsonObject *obj = extract_json_object(ctx, true);
-            if (!obj) {
-                goto error_cleanup;
-            }
-            array->values[array->size]->type = JSON_OBJECT;
-            array->values[array->size]->object = *obj;
-            break;
-        }
+static bool extract_json_number(JsonParseState *state, ParserToken *token,
+                                double *number) {
+    if (json_number_parse_fast(token->start, token->length,
+                               number)) {
+        return true;
+    }
 
-        case TOKEN_LEFT_BRACKET: {
-            JsonArray *arr = extract_json_array(ctx, true);
-            if (!arr) {
-                goto error_cleanup;
-            }
-            array->values[array->size]->type = JSON_ARRAY;
-            array->values[array->size]->array = *arr;
-            break;
+    // strtod needs a terminated copy; reuse the scratch buffer for it.
+    JsonScratch *scratch = state->scratch;
+    if (!scratch_reserve(state, (void **)&scratch->buffer,
+                         &scratch->buffer_capacity, token->length + 1, 1)) {
+        return false;
+    }
+    char *num_str = scratch->buffer;
+    memcpy(num_str, token->start, token->length);
+    num_str[token->length] = '\0';
+
+    char *endptr;
+    errno = 0;
+    *number = strtod(num_str, &endptr);
+
+    return errno != ERANGE && endptr != num_str;
+}
+
+static bool extract_json_value(JsonParseState *state, ParserToken *token,
+                               JsonValue *value) {
+    value->flags = 0;
+
+    switch (token->type) {
+    case TOKEN_STRING: {
+        value->type = JSON_STRING;
+        size_t length = token->length - 2;
+        if (state->borrow_strings) {
+            // Strings are kept exactly as written, so the view can point
+            // straight at the input.
+            value->string = (char *)token->start + 1;
+            value->string_length = length;
+            value->flags = JSON_VALUE_BORROWED;
+            JSON_STATS_ADD(state->stats, strings_borrowed, 1);
+            return true;
+        }
+        if (length <= JSON_SHORT_STRING_MAX) {
+            memcpy(value->short_string, token->start + 1, length);
+            value->short_string[length] = '\0';
+            value->short_string_length = (uint8_t)length;
+            value->flags = JSON_VALUE_INLINE;
+            JSON_STATS_ADD(state->stats, strings_copied, 1);
+            return true;
         }
+        value->string_length = length;
+        value->string = extract_json_string(state, token);
+        return value->string != NULL;
+    }
 
-        case TOKEN_TRUE:
-            array->values[array->size]->type = JSON_BOOL;
-            array->values[array->size]->boolean = true;
-            break;
+    case TOKEN_NUMBER:
+        value->type = JSON_NUMBER;
+        return extract_json_number(state, token, &value->number);
 
-        case TOKEN_FALSE:
-            array->values[array->size]->type = JSON_BOOL;
-            array->values[array->size]->boolean = false;
-            break;
+    case TOKEN_TRUE:
+        value->type = JSON_BOOL;
+        value->boolean = true;
+        return true;
 
-        case TOKEN_NULL:
-            array->values[array->size]->type = JSON_NULL;
-            array->values[array->size]->null = NULL;
-            break;
+    case TOKEN_FALSE:
+        value->type = JSON_BOOL;
+        value->boolean = false;
+        return true;
 
-        case TOKEN_COMMA:
+    case TOKEN_NULL:
+        value->type = JSON_NULL;
+        value->null = NULL;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// Containers are parsed without recursion: each open container has a frame
+// on the scratch stack, and the loop alternates between reading a value and
+// the separator after it, handing finished values to the innermost frame.
+static bool parse_value(JsonParseState *state, ParserToken token,
+                        JsonValue *value) {
+    JsonScratch *scratch = state->scratch;
+    size_t depth_base = state->depth;
+    size_t values_base = scratch->values_size;
+    size_t keys_base = scratch->keys_size;
+    size_t numbers_base = scratch->numbers_size;
+    JsonFrame *frame;
+
+    for (;;) {
+        frame = state->depth > depth_base ? &scratch->frames[state->depth - 1]
+                                          : NULL;
+        bool collected;
+        if (!collect_typed_element(state, frame, &token, &collected)) {
             goto error_cleanup;
+        }
+        if (collected) {
+            goto next_separator;
+        }
 
-        default:
+        if (token.type == TOKEN_LEFT_BRACE ||
+            token.type == TOKEN_LEFT_BRACKET) {
+            bool object = token.type == TOKEN_LEFT_BRACE;
+            if (!open_container(state, object)) {
+                goto error_cleanup;
+            }
+            token = next_token(state);
+            if (token.type ==
+                (object ? TOKEN_RIGHT_BRACE : TOKEN_RIGHT_BRACKET)) {
+                if (!close_container(state, value)) {
+                    goto error_cleanup;
+                }
+                goto store_value;
+            }
+            if (object) {
+                if (!extract_member_key(state, &token)) {
+                    goto error_cleanup;
+                }
+            } else {
+                scratch->frames[state->depth - 1].kind =
+                    first_element_kind(token.type);
+            }
+            continue;
+        }
+        if (!extract_json_value(state, &token, value)) {
             goto error_cleanup;
         }
 
-        array->size++;
-        token = json_tokenizer_next(ctx);
+    store_value:
+        if (state->depth == depth_base) {
+            return true;
+        }
+        frame = &scratch->frames[state->depth - 1];
+        if (!scratch_push_value(state, value)) {
+            release_json_value(value, state->allocator);
+            goto error_cleanup;
+        }
+        if (!frame->object && value->type == JSON_OBJECT &&
+            value->object.size > 0) {
+            frame->previous = value->object;
+        }
 
+    next_separator:
+        frame = &scratch->frames[state->depth - 1];
+        token = next_token(state);
         if (token.type == TOKEN_COMMA) {
-            token = json_tokenizer_next(ctx);
-            if (token.type == TOKEN_RIGHT_BRACKET) {
+            token = next_token(state);
+            if (frame->object && !extract_member_key(state, &token)) {
                 goto error_cleanup;
             }
+            continue;
+        }
+        if (token.type !=
+            (frame->object ? TOKEN_RIGHT_BRACE : TOKEN_RIGHT_BRACKET)) {
+            goto error_cleanup;
+        }
+        if (!close_container(state, value)) {
+            goto error_cleanup;
         }
+        goto store_value;
     }
 
-    if (token.type != TOKEN_RIGHT_BRACKET) {
-        goto error_cleanup;
+error_cleanup:
+    state->depth = depth_base;
+    if (!state->keys) {
+        for (size_t i = keys_base; i < scratch->keys_size; i++) {
+            parser_free(state, scratch->keys[i]);
+        }
     }
+    for (size_t i = values_base; i < scratch->values_size; i++) {
+        release_json_value(&scratch->values[i], state->allocator);
+    }
+    scratch->keys_size = keys_base;
+    scratch->values_size = values_base;
+    scratch->numbers_size = numbers_base;
 
-    return array;
+    return false;
+}
 
-error_cleanup:
-    if (array) {
-        if (array->values) {
-            for (size_t i = 0; i < array->size; i++) {
-                if (array->values[i]) {
-                    free_json_value(array->values[i]);
+// Records in an array usually repeat the previous record's keys, so an
+// object is offered its array's last record as a shape.
+static bool open_container(JsonParseState *state, bool object) {
+    JsonScratch *scratch = state->scratch;
+    if (state->depth >= state->max_depth ||
+        !scratch_reserve(state, (void **)&scratch->frames,
+                         &scratch->frames_capacity, state->depth + 1,
+                         sizeof(JsonFrame))) {
+        return false;
+    }
+
+    JsonFrame *frame = &scratch->frames[state->depth];
+    *frame = (JsonFrame){
+        .values_base = scratch->values_size,
+        .keys_base = scratch->keys_size,
+        .numbers_base = scratch->numbers_size,
+        .kind = JSON_ARRAY_VALUES,
+        .object = object,
+    };
+    if (object && state->keys && state->depth > 0 && !frame[-1].object) {
+        frame->previous = frame[-1].previous;
+    }
+    state->depth++;
+    JSON_STATS_MAX(state->stats, max_depth, state->depth);
+    return true;
+}
+
+// Pops the innermost frame, giving its container exactly sized children.
+// On failure the children stay on the scratch stacks for error_cleanup.
+static bool close_container(JsonParseState *state, JsonValue *value) {
+    JsonScratch *scratch = state->scratch;
+    JsonFrame *frame = &scratch->frames[state->depth - 1];
+
+    if (!frame->object) {
+        *value = (JsonValue){.type = JSON_ARRAY};
+        JsonArray *array = &value->array;
+        if (frame->kind != JSON_ARRAY_VALUES) {
+            if (!store_typed_elements(state, array, frame->kind,
+                                      frame->numbers_base)) {
+                return false;
+            }
+        } else {
+            size_t size = scratch->values_size - frame->values_base;
+            if (size > 0) {
+                array->values = parser_alloc(state, sizeof(JsonValue) * size);
+                if (!array->values) {
+                    return false;
                 }
+                memcpy(array->values, scratch->values + frame->values_base,
+                       sizeof(JsonValue) * size);
+                array->size = size;
             }
-            free(array->values);
+            scratch->values_size = frame->values_base;
         }
-        free(array);
+        state->depth--;
+        return true;
     }
 
-    return NULL;
+    *value = (JsonValue){
+        .type = JSON_OBJECT,
+        .flags = state->keys ? JSON_VALUE_INTERNED_KEYS : 0,
+    };
+    JsonObject *object = &value->object;
+    size_t size = scratch->keys_size - frame->keys_base;
+    if (size > 0) {
+        char **keys = scratch->keys + frame->keys_base;
+        const JsonValue *values = scratch->values + frame->values_base;
+        object->members = parser_alloc(state, sizeof(JsonMember) * size);
+        if (!object->members) {
+            return false;
+        }
+        for (size_t i = 0; i < size; i++) {
+            object->members[i].key = keys[i];
+            object->members[i].value = values[i];
+        }
+        object->size = size;
+        // With interned keys two objects have the same shape exactly when
+        // their key pointer sequences match, so a sibling's shape is
+        // adopted after comparing pointers only.
+        if (state->keys) {
+            object->shape = same_shape(&frame->previous, keys, size)
+                                ? frame->previous.shape
+                                : object->members;
+        }
+    }
+    scratch->keys_size = frame->keys_base;
+    scratch->values_size = frame->values_base;
+    state->depth--;
+    return true;
 }
 
-static JsonObject *extract_json_object(JsonTokenizerCtx *ctx, bool is_nested) {
-    JsonToken token;
-    if (!is_nested) {
-        token = json_tokenizer_next(ctx);
-        if (token.type != TOKEN_LEFT_BRACE) {
-            return NULL;
+// Reads "key": and leaves *token at the member's value.
+static bool extract_member_key(JsonParseState *state, ParserToken *token) {
+    if (!push_member_key(state, token) ||
+        next_token(state).type != TOKEN_COLON) {
+        return false;
+    }
+    *token = next_token(state);
+    return true;
+}
+
+static bool push_member_key(JsonParseState *state, ParserToken *token) {
+    if (token->type != TOKEN_STRING) {
+        return false;
+    }
+    char *key = extract_json_key(state, token);
+    if (!key) {
+        return false;
+    }
+    if (!scratch_push_key(state, key)) {
+        if (!state->keys) {
+            parser_free(state, key);
         }
-        token = json_tokenizer_next(ctx);
-    } else {
-        token = json_tokenizer_next(ctx);
+        return false;
     }
+    return true;
+}
 
-    JsonObject *object = malloc(sizeof(JsonObject));
-    if (!object) {
-        return NULL;
+// An array starts out unboxed when its first element is a number or a
+// boolean.
+static JsonArrayKind first_element_kind(JsonTokenType type) {
+    if (type == TOKEN_NUMBER) {
+        return JSON_ARRAY_NUMBERS;
+    }
+    if (type == TOKEN_TRUE || type == TOKEN_FALSE) {
+        return JSON_ARRAY_BOOLS;
     }
-    object->size = 0;
-    object->keys = NULL;
-    object->values = NULL;
+    return JSON_ARRAY_VALUES;
+}
 
-    while (token.type != TOKEN_RIGHT_BRACE) {
-        char **new_keys =
-            realloc(object->keys, sizeof(char *) * (object->size + 1));
-        JsonValue **new_values =
-            realloc(object->values, sizeof(JsonValue *) * (object->size + 1));
-        if (!new_keys || !new_values) {
-            goto error_cleanup;
-        }
-        object->keys = new_keys;
-        object->values = new_values;
+// Numbers and booleans are collected unboxed for as long as the array stays
+// homogeneous; the first other element turns what was collected so far into
+// nodes. *collected tells whether token was stored as a typed element.
+static bool collect_typed_element(JsonParseState *state, JsonFrame *frame,
+                                  ParserToken *token, bool *collected) {
+    *collected = false;
+    if (!frame || frame->kind == JSON_ARRAY_VALUES) {
+        return true;
+    }
 
-        if (token.type != TOKEN_STRING) {
-            goto error_cleanup;
-        }
-        object->keys[object->size] = extract_json_string(&token);
-        if (!object->keys[object->size]) {
-            goto error_cleanup;
+    bool is_number = token->type == TOKEN_NUMBER;
+    bool is_bool = token->type == TOKEN_TRUE || token->type == TOKEN_FALSE;
+    if (frame->kind == JSON_ARRAY_NUMBERS ? is_number : is_bool) {
+        double element = token->type == TOKEN_TRUE;
+        if ((is_number && !extract_json_number(state, token, &element)) ||
+            !scratch_push_number(state, element)) {
+            return false;
         }
+        *collected = true;
+        return true;
+    }
+    if (!box_typed_elements(state, frame->kind, frame->numbers_base)) {
+        return false;
+    }
+    frame->kind = JSON_ARRAY_VALUES;
+    return true;
+}
 
-        token = json_tokenizer_next(ctx);
-        if (token.type != TOKEN_COLON) {
-            goto error_cleanup;
+static bool box_typed_elements(JsonParseState *state, JsonArrayKind kind,
+                               size_t numbers_base) {
+    JsonScratch *scratch = state->scratch;
+    for (size_t i = numbers_base; i < scratch->numbers_size; i++) {
+        JsonValue value = {.flags = 0};
+        if (kind == JSON_ARRAY_NUMBERS) {
+            value.type = JSON_NUMBER;
+            value.number = scratch->numbers[i];
+        } else {
+            value.type = JSON_BOOL;
+            value.boolean = scratch->numbers[i] != 0;
+        }
+        if (!scratch_push_value(state, &value)) {
+            return false;
         }
+    }
+    scratch->numbers_size = numbers_base;
+    return true;
+}
 
-        token = json_tokenizer_next(ctx);
+static bool store_typed_elements(JsonParseState *state, JsonArray *array,
+                                 JsonArrayKind kind, size_t numbers_base) {
+    JsonScratch *scratch = state->scratch;
+    size_t size = scratch->numbers_size - numbers_base;
+    const double *numbers = scratch->numbers + numbers_base;
 
-        object->values[object->size] = malloc(sizeof(JsonValue));
-        if (!object->values[object->size]) {
-            goto error_cleanup;
+    if (kind == JSON_ARRAY_NUMBERS) {
+        array->numbers = parser_alloc(state, sizeof(double) * size);
+        if (!array->numbers) {
+            return false;
         }
-
-        switch (token.type) {
-        case TOKEN_STRING: {
-            object->values[object->size]->type = JSON_STRING;
-            object->values[object->size]->string = extract_json_string(&token);
-            if (!object->values[object->size]->string) {
-                goto error_cleanup;
+        memcpy(array->numbers, numbers, sizeof(double) * size);
+    } else {
+        array->bools = parser_alloc(state, (size + 7) / 8);
+        if (!array->bools) {
+            return false;
+        }
+        memset(array->bools, 0, (size + 7) / 8);
+        for (size_t i = 0; i < size; i++) {
+            if (numbers[i] != 0) {
+                array->bools[i / 8] |= (uint8_t)(1u << (i % 8));
             }
-            break;
         }
+    }
+    array->size = size;
+    array->kind = kind;
+    scratch->numbers_size = numbers_base;
+    return true;
+}
 
-        case TOKEN_NUMBER: {
-            double *num_ptr = extract_json_number(&token);
-            if (!num_ptr) {
-                goto error_cleanup;
-            }
-            object->values[object->size]->type = JSON_NUMBER;
-            object->values[object->size]->number = *num_ptr;
-            free(num_ptr);
-            break;
+static bool same_shape(const JsonObject *shape, char *const *keys,
+                       size_t size) {
+    if (shape->size != size) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (shape->members[i].key != keys[i]) {
+            return false;
         }
+    }
+    return true;
+}
 
-        case TOKEN_LEFT_BRACE: {
-            JsonObject *obj = extract_json_object(ctx, true);
-            if (!obj) {
-                goto error_cleanup;
-            }
-            object->values[object->size]->type = JSON_OBJECT;
-            object->values[object->size]->object = *obj;
+// The push parser's counterpart of parse_value: one token moves the document
+// one step, with expect standing in for the position in parse_value's loop.
+static bool push_token(JsonPushParser *parser, const JsonToken *token) {
+    if (token->type == TOKEN_INVALID) {
+        return false;
+    }
+
+    JsonParseState *state = &parser->state;
+    JsonFrame *frame =
+        state->depth > 0 ? &parser->scratch.frames[state->depth - 1] : NULL;
+    ParserToken current = {
+        .start = token->start,
+        .type = token->type,
+        .length = token->length,
+    };
+    JsonValue value;
+
+    switch (parser->expect) {
+    case PUSH_EXPECT_KEY_OR_CLOSE:
+        if (current.type == TOKEN_RIGHT_BRACE) {
             break;
         }
+        // fall through
+    case PUSH_EXPECT_KEY:
+        if (!push_member_key(state, &current)) {
+            return false;
+        }
+        parser->expect = PUSH_EXPECT_COLON;
+        return true;
 
-        case TOKEN_LEFT_BRACKET: {
-            JsonArray *arr = extract_json_array(ctx, true);
-            if (!arr) {
-                goto error_cleanup;
-            }
-            object->values[object->size]->type = JSON_ARRAY;
-            object->values[object->size]->array = *arr;
-            break;
+    case PUSH_EXPECT_COLON:
+        if (current.type != TOKEN_COLON) {
+            return false;
         }
+        parser->expect = PUSH_EXPECT_VALUE;
+        return true;
 
-        case TOKEN_TRUE:
-            object->values[object->size]->type = JSON_BOOL;
-            object->values[object->size]->boolean = true;
+    case PUSH_EXPECT_VALUE_OR_CLOSE:
+        if (current.type == TOKEN_RIGHT_BRACKET) {
             break;
+        }
+        frame->kind = first_element_kind(current.type);
+        // fall through
+    case PUSH_EXPECT_VALUE: {
+        bool collected;
+        if (!collect_typed_element(state, frame, &current, &collected)) {
+            return false;
+        }
+        if (collected) {
+            parser->expect = PUSH_EXPECT_COMMA_OR_CLOSE;
+            return true;
+        }
+        if (current.type == TOKEN_LEFT_BRACE ||
+            current.type == TOKEN_LEFT_BRACKET) {
+            bool object = current.type == TOKEN_LEFT_BRACE;
+            if (!open_container(state, object)) {
+                return false;
+            }
+            parser->expect =
+                object ? PUSH_EXPECT_KEY_OR_CLOSE : PUSH_EXPECT_VALUE_OR_CLOSE;
+            return true;
+        }
+        return extract_json_value(state, &current, &value) &&
+               push_value(parser, &value);
+    }
 
-        case TOKEN_FALSE:
-            object->values[object->size]->type = JSON_BOOL;
-            object->values[object->size]->boolean = false;
-            break;
+    case PUSH_EXPECT_COMMA_OR_CLOSE:
+        if (current.type == TOKEN_COMMA) {
+            parser->expect =
+                frame->object ? PUSH_EXPECT_KEY : PUSH_EXPECT_VALUE;
+            return true;
+        }
+        if (current.type !=
+            (frame->object ? TOKEN_RIGHT_BRACE : TOKEN_RIGHT_BRACKET)) {
+            return false;
+        }
+        break;
 
-        case TOKEN_NULL:
-            object->values[object->size]->type = JSON_NULL;
-            object->values[object->size]->null = NULL;
-            break;
+    case PUSH_EXPECT_END:
+        return false;
+    }
 
-        default:
-            goto error_cleanup;
-        }
+    return close_container(state, &value) && push_value(parser, &value);
+}
 
-        object->size++;
-        token = json_tokenizer_next(ctx);
-        if (token.type == TOKEN_COMMA) {
-            token = json_tokenizer_next(ctx);
-        }
+// Hands a finished value to the innermost open container, or keeps it as the
+// document once nothing is open.
+static bool push_value(JsonPushParser *parser, JsonValue *value) {
+    JsonParseState *state = &parser->state;
+    if (state->depth == 0) {
+        parser->root = *value;
+        parser->expect = PUSH_EXPECT_END;
+        return true;
+    }
+    if (!scratch_push_value(state, value)) {
+        release_json_value(value, state->allocator);
+        return false;
     }
+    parser->expect = PUSH_EXPECT_COMMA_OR_CLOSE;
+    return true;
+}
 
-    return object;
+// Pushes the carried-over token once its end, or the end of the input, has
+// arrived; it must be a single token.
+static bool push_pending(JsonPushParser *parser) {
+    JsonTokenizerCtx tokenizer = json_tokenizer_init_ex(
+        parser->pending, parser->pending_size, parser->tokenizer_flags);
+    JsonToken token = json_tokenizer_next(&tokenizer);
+    parser->pending_size = 0;
+    return tokenizer.pos == tokenizer.input_length &&
+           push_token(parser, &token);
+}
 
-error_cleanup:
-    if (object) {
-        if (object->keys) {
-            for (size_t i = 0; i < object->size; i++) {
-                if (object->keys[i]) {
-                    free(object->keys[i]);
-                }
+static bool keep_pending(JsonPushParser *parser, const char *bytes,
+                         size_t length) {
+    if (length == 0) {
+        return true;
+    }
+    if (!scratch_reserve(&parser->state, (void **)&parser->pending,
+                         &parser->pending_capacity,
+                         parser->pending_size + length, 1)) {
+        return false;
+    }
+    memcpy(parser->pending + parser->pending_size, bytes, length);
+    parser->pending_size += length;
+    return true;
+}
+
+// Looks in input for the end of a token whose first seen_length bytes are
+// seen: the closing quote of a string, or the first byte that cannot
+// continue a number or literal. *end counts the input bytes that belong to
+// the token.
+static bool find_token_end(const char *seen, size_t seen_length,
+                           const char *input, size_t length, size_t *end) {
+    if (seen[0] == '"') {
+        // Only a quote after an even run of backslashes closes the string.
+        bool escaped = false;
+        for (size_t i = seen_length; i-- > 1 && seen[i] == '\\';) {
+            escaped = !escaped;
+        }
+        for (size_t i = 0; i < length; i++) {
+            if (escaped) {
+                escaped = false;
+            } else if (input[i] == '\\') {
+                escaped = true;
+            } else if (input[i] == '"') {
+                *end = i + 1;
+                return true;
             }
-            free(object->keys);
         }
+        return false;
+    }
 
-        if (object->values) {
-            for (size_t i = 0; i < object->size; i++) {
-                if (object->values[i]) {
-                    free_json_value(object->values[i]);
-                }
-            }
-            free(object->values);
+    for (size_t i = 0; i < length; i++) {
+        if (!is_word_byte(input[i])) {
+            *end = i;
+            return true;
         }
+    }
+    return false;
+}
+
+static bool is_word_byte(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || c == '+' || c == '-' || c == '.';
+}
+
+static JsonPushStatus push_fail(JsonPushParser *parser) {
+    discard_document(parser);
+    parser->failed = true;
+    return JSON_PUSH_ERROR;
+}
+
+// Releases the partial or finished document, keeping the stacks' capacity.
+static void discard_document(JsonPushParser *parser) {
+    JsonParseState *state = &parser->state;
+    JsonScratch *scratch = &parser->scratch;
+    for (size_t i = 0; i < scratch->keys_size; i++) {
+        parser_free(state, scratch->keys[i]);
+    }
+    for (size_t i = 0; i < scratch->values_size; i++) {
+        release_json_value(&scratch->values[i], state->allocator);
+    }
+    scratch->keys_size = 0;
+    scratch->values_size = 0;
+    scratch->numbers_size = 0;
+    state->depth = 0;
+    if (parser->expect == PUSH_EXPECT_END) {
+        release_json_value(&parser->root, state->allocator);
+    }
+    parser->expect = PUSH_EXPECT_VALUE;
+    parser->pending_size = 0;
+}
+
+const char *json_string(const JsonValue *value, size_t *length) {
+    if (value->flags & JSON_VALUE_INLINE) {
+        *length = value->short_string_length;
+        return value->short_string;
+    }
+    *length = value->string_length;
+    return value->string;
+}
+
+size_t json_array_size(const JsonArray *array) { return array->size; }
+
+JsonValue json_array_get(const JsonArray *array, size_t index) {
+    switch (array->kind) {
+    case JSON_ARRAY_NUMBERS:
+        return (JsonValue){.number = array->numbers[index],
+                           .type = JSON_NUMBER};
+    case JSON_ARRAY_BOOLS:
+        return (JsonValue){
+            .boolean = (array->bools[index / 8] >> (index % 8)) & 1,
+            .type = JSON_BOOL};
+    case JSON_ARRAY_VALUES:
+    default:
+        return array->values[index];
+    }
+}
 
-        free(object);
+const double *json_array_numbers(const JsonArray *array) {
+    return array->kind == JSON_ARRAY_NUMBERS ? array->numbers : NULL;
+}
+
+bool json_array_next(JsonArrayIterator *iterator, JsonValue *element) {
+    if (iterator->index >= iterator->array->size) {
+        return false;
+    }
+    *element = json_array_get(iterator->array, iterator->index++);
+    return true;
+}
+
+JsonValue *json_object_get(const JsonObject *object, const char *key) {
+    for (size_t i = 0; i < object->size; i++) {
+        if (strcmp(object->members[i].key, key) == 0) {
+            return &object->members[i].value;
+        }
     }
     return NULL;
 }
 
-void free_json_value(JsonValue *value) {
+void free_json_value(JsonValue *value) { free_json_value_ex(value, NULL); }
+
+void free_json_value_ex(JsonValue *value, const JsonAllocator *allocator) {
     if (!value) {
         return;
     }
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    release_json_value(value, allocator);
+    allocator->free(allocator->ctx, value);
+}
 
+void json_value_release(JsonValue *value, const JsonAllocator *allocator) {
+    release_json_value(value, allocator ? allocator
+                                        : json_default_allocator());
+}
+
+// Frees what a node owns but not the node itself, which may sit inside its
+// parent's children array.
+static void release_json_value(JsonValue *value,
+                               const JsonAllocator *allocator) {
     switch (value->type) {
     case JSON_STRING:
-        free(value->string);
+        if (!(value->flags & (JSON_VALUE_BORROWED | JSON_VALUE_INLINE))) {
+            allocator->free(allocator->ctx, value->string);
+        }
         break;
 
+    // Borrowed containers still hold children that edits may have given
+    // storage of their own, so they are walked but not freed.
     case JSON_ARRAY:
-        for (size_t i = 0; i < value->array.size; i++) {
-            free_json_value(value->array.values[i]);
+        if (value->array.kind == JSON_ARRAY_VALUES) {
+            for (size_t i = 0; i < value->array.size; i++) {
+                release_json_value(&value->array.values[i], allocator);
+            }
+        }
+        if (!(value->flags & JSON_VALUE_BORROWED)) {
+            allocator->free(allocator->ctx, value->array.values);
         }
-        free(value->array.values);
         break;
 
-    case JSON_OBJECT:
+    case JSON_OBJECT: {
+        bool owned_keys =
+            !(value->flags & (JSON_VALUE_INTERNED_KEYS | JSON_VALUE_BORROWED |
+                              JSON_VALUE_CLONE));
         for (size_t i = 0; i < value->object.size; i++) {
-            free(value->object.keys[i]);
-            free_json_value(value->object.values[i]);
+            JsonMember *member = &value->object.members[i];
+            if (owned_keys) {
+                allocator->free(allocator->ctx, member->key);
+            }
+            release_json_value(&member->value, allocator);
+        }
+        if (!(value->flags & JSON_VALUE_BORROWED)) {
+            allocator->free(allocator->ctx, value->object.members);
         }
-        free(value->object.keys);
-        free(value->object.values);
         break;
+    }
 
     case JSON_NUMBER:
     case JSON_BOOL:
     case JSON_NULL:
         break;
     }
-
-    free(value);
 }
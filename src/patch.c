@@ -0,0 +1,645 @@
+#include "../include/patch.h"
+#include "../include/allocator.h"
+#include "../include/edit.h"
+#include "../include/hash.h"
+#include "../include/intern.h"
+#include "../include/parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Segment index values that are not array positions.
+#define SEGMENT_KEY SIZE_MAX
+#define SEGMENT_END (SIZE_MAX - 1)
+
+typedef enum {
+    PATCH_ADD,
+    PATCH_REMOVE,
+    PATCH_REPLACE,
+    PATCH_MOVE,
+    PATCH_COPY,
+    PATCH_TEST,
+} PatchOp;
+
+typedef struct {
+        char *key;
+        size_t length;
+        size_t index;
+} PatchSegment;
+
+typedef struct {
+        PatchSegment *segments;
+        size_t depth;
+} PatchPath;
+
+typedef struct {
+        PatchOp op;
+        char *text;
+        PatchPath path;
+        PatchPath from;
+        JsonValue value;
+        size_t shared;
+} PatchOperation;
+
+struct JsonPatch {
+        PatchOperation *operations;
+        size_t count;
+        size_t max_depth;
+        const JsonAllocator *allocator;
+};
+
+static bool compile_operation(JsonPatch *patch, PatchOperation *operation,
+                              const JsonValue *source, JsonError *error);
+static bool compile_path(const JsonAllocator *allocator, const char *text,
+                         size_t length, PatchPath *path);
+static size_t shared_segments(const PatchPath *previous,
+                              const PatchPath *path);
+static bool is_proper_prefix(const PatchPath *prefix, const PatchPath *path);
+static void free_path(const JsonAllocator *allocator, PatchPath *path);
+static bool apply_operation(const PatchOperation *operation,
+                            JsonValue *document, JsonValue **resolved,
+                            size_t *valid, const JsonAllocator *allocator);
+static JsonValue *resolve_parent(const PatchOperation *operation,
+                                 JsonValue **resolved, size_t *valid);
+static JsonValue *walk(JsonValue *node, const PatchSegment *segments,
+                       size_t count);
+static JsonValue *child_of(JsonValue *node, const PatchSegment *segment);
+static bool read_path(JsonValue *document, const PatchPath *path,
+                      JsonValue *value);
+static bool read_child(JsonValue *parent, const PatchSegment *segment,
+                       JsonValue *value);
+static bool take_child(JsonValue *parent, const PatchSegment *segment,
+                       JsonValue *value, const JsonAllocator *allocator);
+static bool add_child(JsonValue *parent, const PatchSegment *segment,
+                      const JsonValue *value, const JsonAllocator *allocator);
+static bool replace_child(JsonValue *parent, const PatchSegment *segment,
+                          const JsonValue *value,
+                          const JsonAllocator *allocator);
+static bool remove_child(JsonValue *parent, const PatchSegment *segment,
+                         const JsonAllocator *allocator);
+static size_t key_length(const JsonValue *object, const char *key);
+static void set_error(JsonError *error, const char *key, const char *message);
+
+JsonPatch *json_patch_compile(const JsonValue *operations,
+                              const JsonAllocator *allocator,
+                              JsonError *error) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+    set_error(error, NULL, "");
+    if (operations->type != JSON_ARRAY) {
+        set_error(error, NULL, "Patch must be an array of operations");
+        return NULL;
+    }
+
+    JsonPatch *patch = allocator->alloc(allocator->ctx, sizeof(JsonPatch));
+    if (!patch) {
+        return NULL;
+    }
+    size_t count = json_array_size(&operations->array);
+    *patch = (JsonPatch){.allocator = allocator};
+    if (count > 0) {
+        patch->operations =
+            allocator->alloc(allocator->ctx, sizeof(PatchOperation) * count);
+        if (!patch->operations) {
+            goto error_cleanup;
+        }
+    }
+
+    // A test only reads its path, so the nodes cached for the next
+    // operation are still those of the last one that resolved a parent.
+    const PatchPath *previous = NULL;
+    for (size_t i = 0; i < count; i++) {
+        PatchOperation *operation = &patch->operations[i];
+        *operation = (PatchOperation){.value = {.type = JSON_NULL}};
+        patch->count++;
+
+        JsonValue source = json_array_get(&operations->array, i);
+        if (!compile_operation(patch, operation, &source, error)) {
+            goto error_cleanup;
+        }
+        if (operation->op != PATCH_TEST) {
+            if (previous) {
+                operation->shared =
+                    shared_segments(previous, &operation->path);
+            }
+            previous = &operation->path;
+        }
+        if (operation->path.depth > patch->max_depth) {
+            patch->max_depth = operation->path.depth;
+        }
+    }
+
+    return patch;
+
+error_cleanup:
+    json_patch_free(patch);
+    return NULL;
+}
+
+bool json_patch_apply(const JsonPatch *patch, JsonValue *document,
+                      const JsonAllocator *allocator, JsonError *error) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+    set_error(error, NULL, "");
+
+    // resolved[i] is the node reached after i segments of the most recently
+    // resolved path; the first `valid` entries are still current.
+    const JsonAllocator *own = patch->allocator;
+    JsonValue **resolved =
+        own->alloc(own->ctx, sizeof(JsonValue *) * (patch->max_depth + 1));
+    if (!resolved) {
+        set_error(error, NULL, "Out of memory");
+        return false;
+    }
+    resolved[0] = document;
+    size_t valid = 1;
+
+    bool ok = true;
+    for (size_t i = 0; i < patch->count && ok; i++) {
+        const PatchOperation *operation = &patch->operations[i];
+        ok = apply_operation(operation, document, resolved, &valid, allocator);
+        if (!ok) {
+            char message[64];
+            snprintf(message, sizeof(message), "Operation %zu failed", i);
+            set_error(error, operation->text, message);
+        }
+    }
+
+    own->free(own->ctx, resolved);
+    return ok;
+}
+
+void json_patch_free(JsonPatch *patch) {
+    if (!patch) {
+        return;
+    }
+
+    const JsonAllocator *allocator = patch->allocator;
+    for (size_t i = 0; i < patch->count; i++) {
+        PatchOperation *operation = &patch->operations[i];
+        allocator->free(allocator->ctx, operation->text);
+        free_path(allocator, &operation->path);
+        free_path(allocator, &operation->from);
+        json_value_release(&operation->value, allocator);
+    }
+    allocator->free(allocator->ctx, patch->operations);
+    allocator->free(allocator->ctx, patch);
+}
+
+bool json_merge_patch_apply(JsonValue *document, const JsonValue *patch,
+                            const JsonAllocator *allocator) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    if (patch->type != JSON_OBJECT) {
+        JsonValue copy;
+        if (!json_value_copy(&copy, patch, allocator)) {
+            return false;
+        }
+        json_value_replace(document, &copy, allocator);
+        return true;
+    }
+    if (document->type != JSON_OBJECT) {
+        json_value_release(document, allocator);
+        *document = (JsonValue){.type = JSON_OBJECT};
+    }
+
+    for (size_t i = 0; i < patch->object.size; i++) {
+        const JsonMember *member = &patch->object.members[i];
+        size_t length = key_length(patch, member->key);
+        if (member->value.type == JSON_NULL) {
+            json_object_remove(document, member->key, length, allocator);
+            continue;
+        }
+
+        JsonValue *target = json_object_get(&document->object, member->key);
+        if (target) {
+            if (!json_merge_patch_apply(target, &member->value, allocator)) {
+                return false;
+            }
+            continue;
+        }
+
+        // New members are merged into null so nested nulls are dropped.
+        JsonValue merged = {.type = JSON_NULL};
+        if (!json_merge_patch_apply(&merged, &member->value, allocator) ||
+            !json_object_set(document, member->key, length, &merged,
+                             allocator)) {
+            json_value_release(&merged, allocator);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compile_operation(JsonPatch *patch, PatchOperation *operation,
+                              const JsonValue *source, JsonError *error) {
+    static const char *const names[] = {"add",  "remove", "replace",
+                                        "move", "copy",   "test"};
+    const JsonAllocator *allocator = patch->allocator;
+    if (source->type != JSON_OBJECT) {
+        set_error(error, NULL, "Patch operation must be an object");
+        return false;
+    }
+
+    const JsonValue *op = json_object_get(&source->object, "op");
+    const JsonValue *path = json_object_get(&source->object, "path");
+    if (!op || op->type != JSON_STRING || !path ||
+        path->type != JSON_STRING) {
+        set_error(error, NULL, "Patch operation needs string op and path");
+        return false;
+    }
+
+    size_t length;
+    const char *name = json_string(op, &length);
+    size_t index = 0;
+    while (index < sizeof(names) / sizeof(names[0]) &&
+           !(strlen(names[index]) == length &&
+             memcmp(names[index], name, length) == 0)) {
+        index++;
+    }
+    if (index == sizeof(names) / sizeof(names[0])) {
+        set_error(error, NULL, "Unknown patch operation");
+        return false;
+    }
+    operation->op = (PatchOp)index;
+
+    const char *text = json_string(path, &length);
+    operation->text = json_allocator_strndup(allocator, text, length);
+    if (!operation->text) {
+        set_error(error, NULL, "Out of memory");
+        return false;
+    }
+    if (!compile_path(allocator, text, length, &operation->path)) {
+        set_error(error, operation->text, "Invalid JSON Pointer");
+        return false;
+    }
+
+    if (operation->op == PATCH_MOVE || operation->op == PATCH_COPY) {
+        const JsonValue *from = json_object_get(&source->object, "from");
+        if (!from || from->type != JSON_STRING) {
+            set_error(error, operation->text, "Missing from");
+            return false;
+        }
+        text = json_string(from, &length);
+        if (!compile_path(allocator, text, length, &operation->from)) {
+            set_error(error, operation->text, "Invalid JSON Pointer in from");
+            return false;
+        }
+        // A value cannot be moved into one of its own children.
+        if (operation->op == PATCH_MOVE &&
+            is_proper_prefix(&operation->from, &operation->path)) {
+            set_error(error, operation->text, "Cannot move into a child");
+            return false;
+        }
+    }
+
+    if (operation->op == PATCH_ADD || operation->op == PATCH_REPLACE ||
+        operation->op == PATCH_TEST) {
+        const JsonValue *value = json_object_get(&source->object, "value");
+        if (!value) {
+            set_error(error, operation->text, "Missing value");
+            return false;
+        }
+        if (!json_value_copy(&operation->value, value, allocator)) {
+            operation->value = (JsonValue){.type = JSON_NULL};
+            set_error(error, operation->text, "Out of memory");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Splits a JSON Pointer (RFC 6901) into unescaped segments.
+static bool compile_path(const JsonAllocator *allocator, const char *text,
+                         size_t length, PatchPath *path) {
+    path->segments = NULL;
+    path->depth = 0;
+    if (length == 0) {
+        return true;
+    }
+    if (text[0] != '/') {
+        return false;
+    }
+
+    size_t depth = 0;
+    for (size_t i = 0; i < length; i++) {
+        depth += text[i] == '/';
+    }
+    path->segments =
+        allocator->alloc(allocator->ctx, sizeof(PatchSegment) * depth);
+    if (!path->segments) {
+        return false;
+    }
+
+    size_t pos = 1;
+    for (size_t s = 0; s < depth; s++) {
+        size_t end = pos;
+        while (end < length && text[end] != '/') {
+            end++;
+        }
+
+        char *key = allocator->alloc(allocator->ctx, end - pos + 1);
+        if (!key) {
+            goto error_cleanup;
+        }
+        PatchSegment *segment = &path->segments[path->depth++];
+        segment->key = key;
+        size_t n = 0;
+        for (size_t i = pos; i < end; i++) {
+            if (text[i] != '~') {
+                key[n++] = text[i];
+            } else if (i + 1 < end && (text[i + 1] == '0' ||
+                                       text[i + 1] == '1')) {
+                key[n++] = text[++i] == '0' ? '~' : '/';
+            } else {
+                goto error_cleanup;
+            }
+        }
+        key[n] = '\0';
+        segment->length = n;
+
+        // Array positions are digits without leading zeros, or "-" for the
+        // end of the array.
+        segment->index = SEGMENT_KEY;
+        if (n == 1 && key[0] == '-') {
+            segment->index = SEGMENT_END;
+        } else if (n > 0 && n < 19 && (key[0] != '0' || n == 1)) {
+            size_t index = 0;
+            size_t i = 0;
+            while (i < n && key[i] >= '0' && key[i] <= '9') {
+                index = index * 10 + (size_t)(key[i++] - '0');
+            }
+            if (i == n) {
+                segment->index = index;
+            }
+        }
+        pos = end + 1;
+    }
+    return true;
+
+error_cleanup:
+    free_path(allocator, path);
+    return false;
+}
+
+// Number of leading segments of both parents that match, which is how much
+// of path's parent a previous resolution of previous can supply.
+static size_t shared_segments(const PatchPath *previous,
+                              const PatchPath *path) {
+    if (previous->depth == 0 || path->depth == 0) {
+        return 0;
+    }
+    size_t limit = previous->depth < path->depth ? previous->depth
+                                                 : path->depth;
+    limit--;
+    size_t shared = 0;
+    while (shared < limit &&
+           previous->segments[shared].length ==
+               path->segments[shared].length &&
+           memcmp(previous->segments[shared].key, path->segments[shared].key,
+                  path->segments[shared].length) == 0) {
+        shared++;
+    }
+    return shared;
+}
+
+static bool is_proper_prefix(const PatchPath *prefix, const PatchPath *path) {
+    if (prefix->depth >= path->depth) {
+        return false;
+    }
+    for (size_t i = 0; i < prefix->depth; i++) {
+        if (prefix->segments[i].length != path->segments[i].length ||
+            memcmp(prefix->segments[i].key, path->segments[i].key,
+                   path->segments[i].length) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void free_path(const JsonAllocator *allocator, PatchPath *path) {
+    for (size_t i = 0; i < path->depth; i++) {
+        allocator->free(allocator->ctx, path->segments[i].key);
+    }
+    allocator->free(allocator->ctx, path->segments);
+    path->segments = NULL;
+    path->depth = 0;
+}
+
+static bool apply_operation(const PatchOperation *operation,
+                            JsonValue *document, JsonValue **resolved,
+                            size_t *valid, const JsonAllocator *allocator) {
+    JsonValue value;
+    switch (operation->op) {
+    case PATCH_TEST:
+        return read_path(document, &operation->path, &value) &&
+               json_equal(&value, &operation->value);
+
+    case PATCH_COPY:
+        if (!read_path(document, &operation->from, &value) ||
+            !json_value_copy(&value, &value, allocator)) {
+            return false;
+        }
+        break;
+
+    case PATCH_MOVE: {
+        const PatchPath *from = &operation->from;
+        if (from->depth == 0) {
+            // Moving the root onto itself; anything else is rejected when
+            // compiling.
+            return true;
+        }
+        JsonValue *parent = walk(document, from->segments, from->depth - 1);
+        if (!parent ||
+            !take_child(parent, &from->segments[from->depth - 1], &value,
+                        allocator)) {
+            return false;
+        }
+        // The removal changed the children of the node at depth
+        // from->depth - 1; cached nodes below it may have moved.
+        if (*valid > from->depth) {
+            *valid = from->depth;
+        }
+        break;
+    }
+
+    case PATCH_ADD:
+    case PATCH_REPLACE:
+        if (!json_value_copy(&value, &operation->value, allocator)) {
+            return false;
+        }
+        break;
+
+    case PATCH_REMOVE:
+    default:
+        break;
+    }
+
+    const PatchPath *path = &operation->path;
+    if (path->depth == 0) {
+        *valid = 1;
+        if (operation->op == PATCH_REMOVE) {
+            return false;
+        }
+        json_value_replace(document, &value, allocator);
+        return true;
+    }
+
+    JsonValue *parent = resolve_parent(operation, resolved, valid);
+    const PatchSegment *last = &path->segments[path->depth - 1];
+    if (operation->op == PATCH_REMOVE) {
+        return parent && remove_child(parent, last, allocator);
+    }
+
+    bool ok = parent && (operation->op == PATCH_REPLACE
+                             ? replace_child(parent, last, &value, allocator)
+                             : add_child(parent, last, &value, allocator));
+    if (!ok) {
+        json_value_release(&value, allocator);
+    }
+    return ok;
+}
+
+// Resolves the parent of the operation's target, starting from the deepest
+// node the previous operation left cached along the shared prefix.
+static JsonValue *resolve_parent(const PatchOperation *operation,
+                                 JsonValue **resolved, size_t *valid) {
+    size_t depth = operation->path.depth - 1;
+    size_t start = operation->shared < *valid - 1 ? operation->shared
+                                                  : *valid - 1;
+    for (size_t i = start; i < depth; i++) {
+        JsonValue *node =
+            child_of(resolved[i], &operation->path.segments[i]);
+        if (!node) {
+            *valid = i + 1;
+            return NULL;
+        }
+        resolved[i + 1] = node;
+    }
+    *valid = depth + 1;
+    return resolved[depth];
+}
+
+static JsonValue *walk(JsonValue *node, const PatchSegment *segments,
+                       size_t count) {
+    for (size_t i = 0; i < count && node; i++) {
+        node = child_of(node, &segments[i]);
+    }
+    return node;
+}
+
+// Typed array elements are scalars, so a path never continues through them.
+static JsonValue *child_of(JsonValue *node, const PatchSegment *segment) {
+    if (node->type == JSON_OBJECT) {
+        return json_object_get(&node->object, segment->key);
+    }
+    if (node->type == JSON_ARRAY && node->array.kind == JSON_ARRAY_VALUES &&
+        segment->index < node->array.size) {
+        return &node->array.values[segment->index];
+    }
+    return NULL;
+}
+
+static bool read_path(JsonValue *document, const PatchPath *path,
+                      JsonValue *value) {
+    if (path->depth == 0) {
+        *value = *document;
+        return true;
+    }
+    JsonValue *parent = walk(document, path->segments, path->depth - 1);
+    return parent && read_child(parent, &path->segments[path->depth - 1],
+                                value);
+}
+
+static bool read_child(JsonValue *parent, const PatchSegment *segment,
+                       JsonValue *value) {
+    if (parent->type == JSON_OBJECT) {
+        JsonValue *child = json_object_get(&parent->object, segment->key);
+        if (child) {
+            *value = *child;
+        }
+        return child != NULL;
+    }
+    if (parent->type == JSON_ARRAY && segment->index < parent->array.size) {
+        *value = json_array_get(&parent->array, segment->index);
+        return true;
+    }
+    return false;
+}
+
+// Removes a child without releasing it, handing ownership to value.
+static bool take_child(JsonValue *parent, const PatchSegment *segment,
+                       JsonValue *value, const JsonAllocator *allocator) {
+    JsonValue *slot = child_of(parent, segment);
+    if (!slot) {
+        return read_child(parent, segment, value) &&
+               json_array_erase(parent, segment->index, allocator);
+    }
+
+    *value = *slot;
+    *slot = (JsonValue){.type = JSON_NULL};
+    bool removed =
+        parent->type == JSON_OBJECT
+            ? json_object_remove(parent, segment->key, segment->length,
+                                 allocator)
+            : json_array_erase(parent, segment->index, allocator);
+    if (!removed) {
+        *slot = *value;
+    }
+    return removed;
+}
+
+static bool add_child(JsonValue *parent, const PatchSegment *segment,
+                      const JsonValue *value, const JsonAllocator *allocator) {
+    if (parent->type == JSON_OBJECT) {
+        return json_object_set(parent, segment->key, segment->length, value,
+                               allocator);
+    }
+    if (parent->type != JSON_ARRAY) {
+        return false;
+    }
+    size_t index = segment->index == SEGMENT_END ? parent->array.size
+                                                 : segment->index;
+    return json_array_insert(parent, index, value, allocator);
+}
+
+static bool replace_child(JsonValue *parent, const PatchSegment *segment,
+                          const JsonValue *value,
+                          const JsonAllocator *allocator) {
+    if (parent->type == JSON_OBJECT) {
+        return json_object_get(&parent->object, segment->key) &&
+               json_object_set(parent, segment->key, segment->length, value,
+                               allocator);
+    }
+    return parent->type == JSON_ARRAY &&
+           json_array_set(parent, segment->index, value, allocator);
+}
+
+static bool remove_child(JsonValue *parent, const PatchSegment *segment,
+                         const JsonAllocator *allocator) {
+    if (parent->type == JSON_OBJECT) {
+        return json_object_remove(parent, segment->key, segment->length,
+                                  allocator);
+    }
+    return parent->type == JSON_ARRAY &&
+           json_array_erase(parent, segment->index, allocator);
+}
+
+static size_t key_length(const JsonValue *object, const char *key) {
+    return object->flags & JSON_VALUE_INTERNED_KEYS ? json_key_of(key)->length
+                                                   : strlen(key);
+}
+
+static void set_error(JsonError *error, const char *key,
+                      const char *message) {
+    if (error) {
+        error->key = key;
+        snprintf(error->message, sizeof(error->message), "%s", message);
+    }
+}
@@ -0,0 +1,964 @@
+#include "../include/schema.h"
+#include "../include/allocator.h"
+#include "../include/number.h"
+#include "../include/parser.h"
+#include "../include/tokenizer.h"
+#include "../include/validate.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Node 0 accepts any value and node 1 none. Schemas without constraints
+// compile to node 0, whose values are only checked for well-formedness.
+#define SCHEMA_ANY 0
+#define SCHEMA_NEVER 1
+#define SCHEMA_TYPE_ALL ((1u << (JSON_NULL + 1)) - 1)
+#define SCHEMA_TYPE_INTEGER (1u << (JSON_NULL + 1))
+#define SCHEMA_LOCAL_PROPERTIES 64
+
+typedef enum {
+    SCHEMA_MINIMUM = 1 << 0,
+    SCHEMA_MAXIMUM = 1 << 1,
+    SCHEMA_EXCLUSIVE_MINIMUM = 1 << 2,
+    SCHEMA_EXCLUSIVE_MAXIMUM = 1 << 3,
+} SchemaBounds;
+
+// Subschemas are referenced by node index. A node's properties are
+// schema->properties[first_property..first_property + property_count) and
+// its enum values schema->values[first_value..first_value + value_count).
+typedef struct {
+        unsigned types;
+        unsigned bounds;
+        double minimum;
+        double maximum;
+        double exclusive_minimum;
+        double exclusive_maximum;
+        size_t min_length;
+        size_t max_length;
+        size_t min_items;
+        size_t max_items;
+        size_t first_property;
+        size_t property_count;
+        size_t required_count;
+        size_t additional;
+        size_t items;
+        size_t first_value;
+        size_t value_count;
+} SchemaNode;
+
+typedef struct {
+        char *key;
+        size_t length;
+        size_t node;
+        bool required;
+} SchemaProperty;
+
+typedef struct {
+        JsonType type;
+        double number;
+        bool boolean;
+        char *string;
+        size_t length;
+} SchemaValue;
+
+struct JsonSchema {
+        SchemaNode *nodes;
+        size_t node_count;
+        size_t node_capacity;
+        SchemaProperty *properties;
+        size_t property_count;
+        size_t property_capacity;
+        SchemaValue *values;
+        size_t value_count;
+        size_t value_capacity;
+        size_t root;
+        const JsonAllocator *allocator;
+};
+
+// seen has one byte per compiled property. A node is never active twice at
+// once, so each object visit can reuse its node's range.
+typedef struct {
+        JsonTokenizerCtx tokenizer;
+        const JsonSchema *schema;
+        uint8_t *seen;
+        char *buffer;
+        size_t buffer_capacity;
+        JsonError *error;
+} SchemaState;
+
+static const char *const type_names[] = {
+    "string", "number", "boolean", "array", "object", "null",
+};
+
+static bool compile_node(JsonSchema *schema, const JsonValue *source,
+                         const char *key, size_t *index, JsonError *error);
+static bool compile_properties(JsonSchema *schema, size_t index,
+                               const JsonObject *source, const char *key,
+                               JsonError *error);
+static bool compile_types(SchemaNode *node, const JsonValue *source,
+                          const char *key, JsonError *error);
+static bool compile_value(JsonSchema *schema, size_t index,
+                          const JsonValue *source, const char *key,
+                          JsonError *error);
+static bool compile_count(const JsonValue *source, const char *keyword,
+                          const char *key, size_t *count, JsonError *error);
+static bool is_annotation(const char *keyword);
+static bool is_unconstrained(const SchemaNode *node);
+static bool reserve(JsonSchema *schema, void **items, size_t *capacity,
+                    size_t needed, size_t item_size);
+static bool validate_value(SchemaState *state, size_t index,
+                           const JsonToken *token, const char *key);
+static bool validate_object(SchemaState *state, const SchemaNode *node,
+                            const char *key);
+static bool validate_array(SchemaState *state, const SchemaNode *node,
+                           const char *key);
+static bool validate_number(SchemaState *state, const SchemaNode *node,
+                            const JsonToken *token, const char *key,
+                            double *number);
+static bool skip_value(SchemaState *state, const JsonToken *token,
+                       const char *key);
+static bool token_json_type(const JsonToken *token, JsonType *type);
+static size_t find_property(const JsonSchema *schema, const SchemaNode *node,
+                            const JsonToken *token, size_t *hint);
+static bool matches_value(const JsonSchema *schema, const SchemaNode *node,
+                          const JsonToken *token, JsonType type,
+                          double number);
+static size_t string_length(const JsonToken *token);
+static bool is_integral(double number);
+static bool compile_error(JsonError *error, const char *key,
+                          const char *format, ...);
+static bool fail(SchemaState *state, const char *key, const JsonToken *token,
+                 const char *format, ...);
+
+JsonSchema *json_schema_compile(const JsonValue *source,
+                                const JsonAllocator *allocator,
+                                JsonError *error) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+    if (error) {
+        error->key = NULL;
+        error->message[0] = '\0';
+    }
+
+    JsonSchema *schema = allocator->alloc(allocator->ctx, sizeof(JsonSchema));
+    if (!schema) {
+        compile_error(error, NULL, "Out of memory");
+        return NULL;
+    }
+    *schema = (JsonSchema){.allocator = allocator};
+
+    size_t index;
+    if (!reserve(schema, (void **)&schema->nodes, &schema->node_capacity, 2,
+                 sizeof(SchemaNode))) {
+        compile_error(error, NULL, "Out of memory");
+        goto error_cleanup;
+    }
+    // The two fixed nodes are plain defaults; only their indices matter.
+    schema->node_count = 2;
+    schema->nodes[SCHEMA_ANY] = (SchemaNode){
+        .types = SCHEMA_TYPE_ALL | SCHEMA_TYPE_INTEGER,
+        .max_length = SIZE_MAX,
+        .max_items = SIZE_MAX,
+    };
+    schema->nodes[SCHEMA_NEVER] = (SchemaNode){0};
+
+    if (!compile_node(schema, source, NULL, &index, error)) {
+        goto error_cleanup;
+    }
+    schema->root = index;
+    return schema;
+
+error_cleanup:
+    json_schema_free(schema);
+    return NULL;
+}
+
+bool json_schema_validate(const JsonSchema *schema, const char *input,
+                          size_t input_length, JsonError *error) {
+    if (error) {
+        error->key = NULL;
+        error->message[0] = '\0';
+    }
+
+    const JsonAllocator *allocator = schema->allocator;
+    uint8_t local_seen[SCHEMA_LOCAL_PROPERTIES];
+    SchemaState state = {
+        .tokenizer = json_tokenizer_init_ex(input, input_length,
+                                            JSON_TOKENIZER_LAZY_POSITIONS),
+        .schema = schema,
+        .seen = local_seen,
+        .error = error,
+    };
+    if (schema->property_count > SCHEMA_LOCAL_PROPERTIES) {
+        state.seen = allocator->alloc(allocator->ctx, schema->property_count);
+        if (!state.seen) {
+            return fail(&state, NULL, NULL, "Out of memory");
+        }
+    }
+
+    JsonToken token = json_tokenizer_next(&state.tokenizer);
+    bool ok = validate_value(&state, schema->root, &token, NULL);
+    if (ok) {
+        token = json_tokenizer_next(&state.tokenizer);
+        if (token.type != TOKEN_EOF) {
+            ok = fail(&state, NULL, &token, "Unexpected data after the value");
+        }
+    }
+
+    if (state.seen != local_seen) {
+        allocator->free(allocator->ctx, state.seen);
+    }
+    allocator->free(allocator->ctx, state.buffer);
+    return ok;
+}
+
+void json_schema_free(JsonSchema *schema) {
+    if (!schema) {
+        return;
+    }
+
+    const JsonAllocator *allocator = schema->allocator;
+    for (size_t i = 0; i < schema->property_count; i++) {
+        allocator->free(allocator->ctx, schema->properties[i].key);
+    }
+    for (size_t i = 0; i < schema->value_count; i++) {
+        allocator->free(allocator->ctx, schema->values[i].string);
+    }
+    allocator->free(allocator->ctx, schema->nodes);
+    allocator->free(allocator->ctx, schema->properties);
+    allocator->free(allocator->ctx, schema->values);
+    allocator->free(allocator->ctx, schema);
+}
+
+// key names the property whose schema is being compiled, for errors.
+static bool compile_node(JsonSchema *schema, const JsonValue *source,
+                         const char *key, size_t *index, JsonError *error) {
+    if (source->type == JSON_BOOL) {
+        *index = source->boolean ? SCHEMA_ANY : SCHEMA_NEVER;
+        return true;
+    }
+    if (source->type != JSON_OBJECT) {
+        return compile_error(error, key,
+                             "Schema must be an object or a boolean");
+    }
+
+    if (!reserve(schema, (void **)&schema->nodes, &schema->node_capacity,
+                 schema->node_count + 1, sizeof(SchemaNode))) {
+        return compile_error(error, key, "Out of memory");
+    }
+    size_t node_index = schema->node_count++;
+    schema->nodes[node_index] = (SchemaNode){
+        .types = SCHEMA_TYPE_ALL | SCHEMA_TYPE_INTEGER,
+        .max_length = SIZE_MAX,
+        .max_items = SIZE_MAX,
+        .first_property = schema->property_count,
+        .additional = SCHEMA_ANY,
+        .items = SCHEMA_ANY,
+        .first_value = schema->value_count,
+    };
+
+    // Properties claim their slots before any subschema is compiled, so a
+    // node's properties stay contiguous.
+    const JsonObject *object = &source->object;
+    if (!compile_properties(schema, node_index, object, key, error)) {
+        return false;
+    }
+
+    // Subschemas append nodes, so the node is looked up again after each.
+    bool empty_enum = false;
+    for (size_t i = 0; i < object->size; i++) {
+        const char *keyword = object->members[i].key;
+        const JsonValue *value = &object->members[i].value;
+        size_t child;
+
+        if (strcmp(keyword, "properties") == 0) {
+            const SchemaNode *node = &schema->nodes[node_index];
+            size_t first = node->first_property;
+            for (size_t j = 0; j < value->object.size; j++) {
+                const JsonMember *member = &value->object.members[j];
+                if (!compile_node(schema, &member->value, member->key, &child,
+                                  error)) {
+                    return false;
+                }
+                schema->properties[first + j].node = child;
+            }
+        } else if (strcmp(keyword, "items") == 0) {
+            if (value->type == JSON_ARRAY) {
+                return compile_error(error, key,
+                                     "Tuple 'items' is not supported");
+            }
+            if (!compile_node(schema, value, key, &child, error)) {
+                return false;
+            }
+            schema->nodes[node_index].items = child;
+        } else if (strcmp(keyword, "additionalProperties") == 0) {
+            if (!compile_node(schema, value, key, &child, error)) {
+                return false;
+            }
+            schema->nodes[node_index].additional = child;
+        } else if (strcmp(keyword, "type") == 0) {
+            if (!compile_types(&schema->nodes[node_index], value, key,
+                               error)) {
+                return false;
+            }
+        } else if (strcmp(keyword, "enum") == 0) {
+            if (value->type != JSON_ARRAY) {
+                return compile_error(error, key, "'enum' must be an array");
+            }
+            if (json_object_get(object, "const")) {
+                return compile_error(error, key,
+                                     "'enum' and 'const' cannot be combined");
+            }
+            empty_enum = value->array.size == 0;
+            for (size_t j = 0; j < value->array.size; j++) {
+                JsonValue element = json_array_get(&value->array, j);
+                if (!compile_value(schema, node_index, &element, key,
+                                   error)) {
+                    return false;
+                }
+            }
+        } else if (strcmp(keyword, "const") == 0) {
+            if (!compile_value(schema, node_index, value, key, error)) {
+                return false;
+            }
+        } else if (strcmp(keyword, "minimum") == 0 ||
+                   strcmp(keyword, "maximum") == 0 ||
+                   strcmp(keyword, "exclusiveMinimum") == 0 ||
+                   strcmp(keyword, "exclusiveMaximum") == 0) {
+            if (value->type != JSON_NUMBER) {
+                return compile_error(error, key, "'%s' must be a number",
+                                     keyword);
+            }
+            SchemaNode *node = &schema->nodes[node_index];
+            if (strcmp(keyword, "minimum") == 0) {
+                node->minimum = value->number;
+                node->bounds |= SCHEMA_MINIMUM;
+            } else if (strcmp(keyword, "maximum") == 0) {
+                node->maximum = value->number;
+                node->bounds |= SCHEMA_MAXIMUM;
+            } else if (strcmp(keyword, "exclusiveMinimum") == 0) {
+                node->exclusive_minimum = value->number;
+                node->bounds |= SCHEMA_EXCLUSIVE_MINIMUM;
+            } else {
+                node->exclusive_maximum = value->number;
+                node->bounds |= SCHEMA_EXCLUSIVE_MAXIMUM;
+            }
+        } else if (strcmp(keyword, "minLength") == 0) {
+            if (!compile_count(value, keyword, key,
+                               &schema->nodes[node_index].min_length, error)) {
+                return false;
+            }
+        } else if (strcmp(keyword, "maxLength") == 0) {
+            if (!compile_count(value, keyword, key,
+                               &schema->nodes[node_index].max_length, error)) {
+                return false;
+            }
+        } else if (strcmp(keyword, "minItems") == 0) {
+            if (!compile_count(value, keyword, key,
+                               &schema->nodes[node_index].min_items, error)) {
+                return false;
+            }
+        } else if (strcmp(keyword, "maxItems") == 0) {
+            if (!compile_count(value, keyword, key,
+                               &schema->nodes[node_index].max_items, error)) {
+                return false;
+            }
+        } else if (strcmp(keyword, "required") != 0 &&
+                   !is_annotation(keyword)) {
+            return compile_error(error, key, "Unsupported keyword '%s'",
+                                 keyword);
+        }
+    }
+
+    // An empty enum allows nothing, whatever the other keywords say.
+    if (empty_enum) {
+        schema->nodes[node_index].types = 0;
+    }
+
+    // Nothing nested was kept either, so this is still the last node.
+    if (is_unconstrained(&schema->nodes[node_index])) {
+        schema->node_count--;
+        *index = SCHEMA_ANY;
+    } else {
+        *index = node_index;
+    }
+    return true;
+}
+
+static bool compile_properties(JsonSchema *schema, size_t index,
+                               const JsonObject *source, const char *key,
+                               JsonError *error) {
+    const JsonValue *properties = json_object_get(source, "properties");
+    const JsonValue *required = json_object_get(source, "required");
+    if (properties && properties->type != JSON_OBJECT) {
+        return compile_error(error, key, "'properties' must be an object");
+    }
+    if (required && required->type != JSON_ARRAY) {
+        return compile_error(error, key, "'required' must be an array");
+    }
+
+    const JsonAllocator *allocator = schema->allocator;
+    size_t first = schema->property_count;
+    size_t declared = properties ? properties->object.size : 0;
+    size_t listed = required ? required->array.size : 0;
+    if (!reserve(schema, (void **)&schema->properties,
+                 &schema->property_capacity, first + declared + listed,
+                 sizeof(SchemaProperty))) {
+        return compile_error(error, key, "Out of memory");
+    }
+
+    for (size_t i = 0; i < declared; i++) {
+        const char *name = properties->object.members[i].key;
+        SchemaProperty *property = &schema->properties[first + i];
+        *property = (SchemaProperty){.length = strlen(name),
+                                     .node = SCHEMA_ANY};
+        property->key = json_allocator_strndup(allocator, name,
+                                               property->length);
+        if (!property->key) {
+            return compile_error(error, key, "Out of memory");
+        }
+        schema->property_count++;
+    }
+
+    SchemaNode *node = &schema->nodes[index];
+    for (size_t i = 0; i < listed; i++) {
+        JsonValue element = json_array_get(&required->array, i);
+        if (element.type != JSON_STRING) {
+            return compile_error(error, key,
+                                 "'required' must list property names");
+        }
+        size_t length;
+        const char *name = json_string(&element, &length);
+
+        size_t slot = first;
+        while (slot < schema->property_count &&
+               (schema->properties[slot].length != length ||
+                memcmp(schema->properties[slot].key, name, length) != 0)) {
+            slot++;
+        }
+        if (slot == schema->property_count) {
+            SchemaProperty *property = &schema->properties[slot];
+            *property = (SchemaProperty){.length = length,
+                                         .node = SCHEMA_ANY};
+            property->key = json_allocator_strndup(allocator, name, length);
+            if (!property->key) {
+                return compile_error(error, key, "Out of memory");
+            }
+            schema->property_count++;
+        }
+        if (!schema->properties[slot].required) {
+            schema->properties[slot].required = true;
+            node->required_count++;
+        }
+    }
+
+    node->property_count = schema->property_count - first;
+    return true;
+}
+
+static bool compile_types(SchemaNode *node, const JsonValue *source,
+                          const char *key, JsonError *error) {
+    size_t count = source->type == JSON_ARRAY ? source->array.size : 1;
+    if (source->type != JSON_ARRAY && source->type != JSON_STRING) {
+        return compile_error(error, key,
+                             "'type' must be a string or an array");
+    }
+
+    node->types = 0;
+    for (size_t i = 0; i < count; i++) {
+        JsonValue name = source->type == JSON_ARRAY
+                             ? json_array_get(&source->array, i)
+                             : *source;
+        size_t length = 0;
+        const char *string =
+            name.type == JSON_STRING ? json_string(&name, &length) : "";
+        unsigned type = 0;
+        if (length == 7 && memcmp(string, "integer", 7) == 0) {
+            type = SCHEMA_TYPE_INTEGER;
+        }
+        for (size_t t = 0; t <= JSON_NULL && !type; t++) {
+            if (strlen(type_names[t]) == length &&
+                memcmp(string, type_names[t], length) == 0) {
+                type = 1u << t;
+            }
+        }
+        if (!type) {
+            return compile_error(error, key, "Unknown type in 'type'");
+        }
+        node->types |= type;
+    }
+    return true;
+}
+
+static bool compile_value(JsonSchema *schema, size_t index,
+                          const JsonValue *source, const char *key,
+                          JsonError *error) {
+    if (source->type == JSON_ARRAY || source->type == JSON_OBJECT) {
+        return compile_error(error, key,
+                             "'enum' and 'const' values must be scalars");
+    }
+    if (!reserve(schema, (void **)&schema->values, &schema->value_capacity,
+                 schema->value_count + 1, sizeof(SchemaValue))) {
+        return compile_error(error, key, "Out of memory");
+    }
+
+    SchemaValue *value = &schema->values[schema->value_count];
+    *value = (SchemaValue){.type = source->type};
+    if (source->type == JSON_STRING) {
+        const char *string = json_string(source, &value->length);
+        value->string = json_allocator_strndup(schema->allocator, string,
+                                               value->length);
+        if (!value->string) {
+            return compile_error(error, key, "Out of memory");
+        }
+    } else if (source->type == JSON_NUMBER) {
+        value->number = source->number;
+    } else if (source->type == JSON_BOOL) {
+        value->boolean = source->boolean;
+    }
+    schema->value_count++;
+    schema->nodes[index].value_count++;
+    return true;
+}
+
+static bool compile_count(const JsonValue *source, const char *keyword,
+                          const char *key, size_t *count, JsonError *error) {
+    if (source->type != JSON_NUMBER || source->number < 0 ||
+        source->number >= 18446744073709551616.0 ||
+        source->number != (double)(size_t)source->number) {
+        return compile_error(error, key,
+                             "'%s' must be a non-negative integer", keyword);
+    }
+    *count = (size_t)source->number;
+    return true;
+}
+
+static bool is_annotation(const char *keyword) {
+    static const char *const annotations[] = {
+        "$schema", "$id",     "id",       "$comment",
+        "title",   "default", "examples", "description",
+    };
+    for (size_t i = 0; i < sizeof(annotations) / sizeof(*annotations); i++) {
+        if (strcmp(keyword, annotations[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_unconstrained(const SchemaNode *node) {
+    return node->types == (SCHEMA_TYPE_ALL | SCHEMA_TYPE_INTEGER) &&
+           node->bounds == 0 && node->min_length == 0 &&
+           node->max_length == SIZE_MAX && node->min_items == 0 &&
+           node->max_items == SIZE_MAX && node->property_count == 0 &&
+           node->additional == SCHEMA_ANY && node->items == SCHEMA_ANY &&
+           node->value_count == 0;
+}
+
+static bool reserve(JsonSchema *schema, void **items, size_t *capacity,
+                    size_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 8;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    const JsonAllocator *allocator = schema->allocator;
+    void *grown =
+        allocator->realloc(allocator->ctx, *items, item_size * new_capacity);
+    if (!grown) {
+        return false;
+    }
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool validate_value(SchemaState *state, size_t index,
+                           const JsonToken *token, const char *key) {
+    if (index == SCHEMA_ANY) {
+        return skip_value(state, token, key);
+    }
+
+    JsonType type;
+    if (!token_json_type(token, &type)) {
+        return fail(state, key, token, "Expected a value");
+    }
+    const SchemaNode *node = &state->schema->nodes[index];
+    if (node->types == 0) {
+        return fail(state, key, token, "No value is allowed here");
+    }
+    if (!(node->types & (1u << type)) &&
+        !(type == JSON_NUMBER && (node->types & SCHEMA_TYPE_INTEGER))) {
+        return fail(state, key, token, "Unexpected %s", type_names[type]);
+    }
+
+    double number = 0;
+    switch (type) {
+    case JSON_OBJECT:
+        if (node->value_count > 0) {
+            return fail(state, key, token, "Value is not one of the allowed");
+        }
+        return validate_object(state, node, key);
+
+    case JSON_ARRAY:
+        if (node->value_count > 0) {
+            return fail(state, key, token, "Value is not one of the allowed");
+        }
+        return validate_array(state, node, key);
+
+    case JSON_NUMBER:
+        if (!validate_number(state, node, token, key, &number)) {
+            return false;
+        }
+        break;
+
+    case JSON_STRING:
+        if (node->min_length > 0 || node->max_length < SIZE_MAX) {
+            size_t length = string_length(token);
+            if (length < node->min_length) {
+                return fail(state, key, token,
+                            "String shorter than %zu characters",
+                            node->min_length);
+            }
+            if (length > node->max_length) {
+                return fail(state, key, token,
+                            "String longer than %zu characters",
+                            node->max_length);
+            }
+        }
+        break;
+
+    case JSON_BOOL:
+    case JSON_NULL:
+        break;
+    }
+
+    if (node->value_count > 0 &&
+        !matches_value(state->schema, node, token, type, number)) {
+        return fail(state, key, token, "Value is not one of the allowed");
+    }
+    return true;
+}
+
+static bool validate_object(SchemaState *state, const SchemaNode *node,
+                            const char *key) {
+    const JsonSchema *schema = state->schema;
+    uint8_t *seen = state->seen + node->first_property;
+    memset(seen, 0, node->property_count);
+    size_t required = 0;
+    size_t hint = 0;
+
+    JsonToken token = json_tokenizer_next(&state->tokenizer);
+    if (token.type != TOKEN_RIGHT_BRACE) {
+        for (;;) {
+            if (token.type != TOKEN_STRING) {
+                return fail(state, key, &token, "Expected a key");
+            }
+            JsonToken name = token;
+            size_t slot = find_property(schema, node, &name, &hint);
+            if (json_tokenizer_next(&state->tokenizer).type != TOKEN_COLON) {
+                return fail(state, key, &name, "Expected ':' after key");
+            }
+
+            JsonToken value = json_tokenizer_next(&state->tokenizer);
+            if (slot < node->property_count) {
+                const SchemaProperty *property =
+                    &schema->properties[node->first_property + slot];
+                if (property->required && !seen[slot]) {
+                    required++;
+                }
+                seen[slot] = 1;
+                if (!validate_value(state, property->node, &value,
+                                    property->key)) {
+                    return false;
+                }
+            } else if (node->additional == SCHEMA_NEVER) {
+                return fail(state, key, &name, "Property %.*s is not allowed",
+                            (int)name.length, name.start);
+            } else if (!validate_value(state, node->additional, &value,
+                                       key)) {
+                return false;
+            }
+
+            token = json_tokenizer_next(&state->tokenizer);
+            if (token.type == TOKEN_RIGHT_BRACE) {
+                break;
+            }
+            if (token.type != TOKEN_COMMA) {
+                return fail(state, key, &token, "Expected ',' or '}'");
+            }
+            token = json_tokenizer_next(&state->tokenizer);
+        }
+    }
+
+    if (required < node->required_count) {
+        for (size_t i = 0; i < node->property_count; i++) {
+            const SchemaProperty *property =
+                &schema->properties[node->first_property + i];
+            if (property->required && !seen[i]) {
+                return fail(state, property->key, &token,
+                            "Missing required property '%s'", property->key);
+            }
+        }
+    }
+    return true;
+}
+
+static bool validate_array(SchemaState *state, const SchemaNode *node,
+                           const char *key) {
+    size_t count = 0;
+    JsonToken token = json_tokenizer_next(&state->tokenizer);
+    if (token.type != TOKEN_RIGHT_BRACKET) {
+        for (;;) {
+            if (!validate_value(state, node->items, &token, key)) {
+                return false;
+            }
+            count++;
+
+            token = json_tokenizer_next(&state->tokenizer);
+            if (token.type == TOKEN_RIGHT_BRACKET) {
+                break;
+            }
+            if (token.type != TOKEN_COMMA) {
+                return fail(state, key, &token, "Expected ',' or ']'");
+            }
+            token = json_tokenizer_next(&state->tokenizer);
+        }
+    }
+
+    if (count < node->min_items) {
+        return fail(state, key, &token, "Array has fewer than %zu items",
+                    node->min_items);
+    }
+    if (count > node->max_items) {
+        return fail(state, key, &token, "Array has more than %zu items",
+                    node->max_items);
+    }
+    return true;
+}
+
+static bool validate_number(SchemaState *state, const SchemaNode *node,
+                            const JsonToken *token, const char *key,
+                            double *number) {
+    // Numbers are converted even when nothing else looks at them, so that
+    // out-of-range ones fail as they do in the parser.
+    bool integer_only = !(node->types & (1u << JSON_NUMBER));
+    if (!json_number_parse_fast(token->start, token->length, number)) {
+        // strtod needs a terminated copy.
+        if (token->length + 1 > state->buffer_capacity) {
+            const JsonAllocator *allocator = state->schema->allocator;
+            char *buffer = allocator->realloc(allocator->ctx, state->buffer,
+                                              token->length + 1);
+            if (!buffer) {
+                return fail(state, key, token, "Out of memory");
+            }
+            state->buffer = buffer;
+            state->buffer_capacity = token->length + 1;
+        }
+        memcpy(state->buffer, token->start, token->length);
+        state->buffer[token->length] = '\0';
+        errno = 0;
+        *number = strtod(state->buffer, NULL);
+        if (errno == ERANGE) {
+            return fail(state, key, token, "Number out of range");
+        }
+    }
+
+    if (integer_only && !is_integral(*number)) {
+        return fail(state, key, token, "Expected an integer");
+    }
+    if (((node->bounds & SCHEMA_MINIMUM) && *number < node->minimum) ||
+        ((node->bounds & SCHEMA_EXCLUSIVE_MINIMUM) &&
+         *number <= node->exclusive_minimum)) {
+        return fail(state, key, token, "Number below the minimum");
+    }
+    if (((node->bounds & SCHEMA_MAXIMUM) && *number > node->maximum) ||
+        ((node->bounds & SCHEMA_EXCLUSIVE_MAXIMUM) &&
+         *number >= node->exclusive_maximum)) {
+        return fail(state, key, token, "Number above the maximum");
+    }
+    return true;
+}
+
+// Values the schema does not constrain are only checked the way
+// json_validate checks them.
+static bool skip_value(SchemaState *state, const JsonToken *token,
+                       const char *key) {
+    JsonParseOptions options = {
+        .allocator = state->schema->allocator,
+        .max_depth = JSON_SCHEMA_MAX_DEPTH,
+    };
+    JsonSyntaxError syntax;
+    if (json_skip_value(&state->tokenizer, token, &options, &syntax)) {
+        return true;
+    }
+    JsonToken at = {.start = state->tokenizer.input + syntax.offset};
+    return fail(state, key, &at, "%s", syntax.message);
+}
+
+static bool token_json_type(const JsonToken *token, JsonType *type) {
+    switch (token->type) {
+    case TOKEN_STRING:
+        *type = JSON_STRING;
+        return true;
+    case TOKEN_NUMBER:
+        *type = JSON_NUMBER;
+        return true;
+    case TOKEN_TRUE:
+    case TOKEN_FALSE:
+        *type = JSON_BOOL;
+        return true;
+    case TOKEN_NULL:
+        *type = JSON_NULL;
+        return true;
+    case TOKEN_LEFT_BRACE:
+        *type = JSON_OBJECT;
+        return true;
+    case TOKEN_LEFT_BRACKET:
+        *type = JSON_ARRAY;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Records usually list their keys in schema order, so the search starts
+// after the last match.
+static size_t find_property(const JsonSchema *schema, const SchemaNode *node,
+                            const JsonToken *token, size_t *hint) {
+    const char *name = token->start + 1;
+    size_t length = token->length - 2;
+    size_t count = node->property_count;
+
+    for (size_t n = 0; n < count; n++) {
+        size_t i = (*hint + n) % count;
+        const SchemaProperty *property =
+            &schema->properties[node->first_property + i];
+        if (property->length == length &&
+            memcmp(property->key, name, length) == 0) {
+            *hint = i + 1;
+            return i;
+        }
+    }
+    return count;
+}
+
+static bool matches_value(const JsonSchema *schema, const SchemaNode *node,
+                          const JsonToken *token, JsonType type,
+                          double number) {
+    for (size_t i = 0; i < node->value_count; i++) {
+        const SchemaValue *value = &schema->values[node->first_value + i];
+        if (value->type != type) {
+            continue;
+        }
+        switch (type) {
+        case JSON_STRING:
+            if (value->length == token->length - 2 &&
+                memcmp(value->string, token->start + 1, value->length) == 0) {
+                return true;
+            }
+            break;
+        case JSON_NUMBER:
+            if (value->number == number) {
+                return true;
+            }
+            break;
+        case JSON_BOOL:
+            if (value->boolean == (token->type == TOKEN_TRUE)) {
+                return true;
+            }
+            break;
+        case JSON_NULL:
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+// Counts code points between the quotes; an escape counts as one, and a
+// \u surrogate pair as one.
+static size_t string_length(const JsonToken *token) {
+    const unsigned char *string = (const unsigned char *)token->start + 1;
+    size_t end = token->length - 2;
+    size_t length = 0;
+
+    for (size_t i = 0; i < end; length++) {
+        if (string[i] != '\\') {
+            i++;
+            while (i < end && (string[i] & 0xC0) == 0x80) {
+                i++;
+            }
+            continue;
+        }
+        if (string[i + 1] != 'u') {
+            i += 2;
+            continue;
+        }
+        bool high = (string[i + 2] == 'd' || string[i + 2] == 'D') &&
+                    strchr("89abAB", string[i + 3]);
+        i += 6;
+        if (high && i + 1 < end && string[i] == '\\' && string[i + 1] == 'u') {
+            i += 6;
+        }
+    }
+    return length;
+}
+
+static bool is_integral(double number) {
+    if (number > -9.2e18 && number < 9.2e18) {
+        return number == (double)(int64_t)number;
+    }
+    // Doubles this large have no fractional part; infinities fail.
+    return number - number == 0;
+}
+
+static bool compile_error(JsonError *error, const char *key,
+                          const char *format, ...) {
+    if (error && error->message[0] == '\0') {
+        error->key = key;
+        va_list args;
+        va_start(args, format);
+        vsnprintf(error->message, sizeof(error->message), format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+static bool fail(SchemaState *state, const char *key, const JsonToken *token,
+                 const char *format, ...) {
+    JsonError *error = state->error;
+    if (!error || error->message[0] != '\0') {
+        return false;
+    }
+
+    error->key = key;
+    va_list args;
+    va_start(args, format);
+    int length =
+        vsnprintf(error->message, sizeof(error->message), format, args);
+    va_end(args);
+
+    if (token && length >= 0 && (size_t)length < sizeof(error->message)) {
+        // Invalid tokens have no start; the tokenizer stopped on them.
+        size_t offset = token->start
+                            ? (size_t)(token->start - state->tokenizer.input)
+                            : state->tokenizer.pos;
+        size_t line;
+        size_t column;
+        json_tokenizer_position(&state->tokenizer, offset, &line, &column);
+        snprintf(error->message + length, sizeof(error->message) - length,
+                 " at line %zu, column %zu", line, column);
+    }
+    return false;
+}
@@ -0,0 +1,596 @@
+#include "../include/snapshot.h"
+#include "../include/allocator.h"
+#include "../include/parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SNAPSHOT_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_MAGIC "JSONSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_NO_INDEX UINT32_MAX
+#define SNAPSHOT_INDEX_MIN_MEMBERS 8
+
+// Layout: header, nodes, key index (uint32 member numbers), string pool.
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint64_t node_count;
+        uint64_t index_offset;
+        uint64_t index_count;
+        uint64_t strings_offset;
+        uint64_t strings_size;
+        uint64_t reserved;
+} SnapshotHeader;
+
+struct JsonSnapshot {
+        const char *data;
+        size_t length;
+        const JsonSnapshotNode *nodes;
+        size_t node_count;
+        const uint32_t *index;
+        size_t index_count;
+        const char *strings;
+        size_t strings_size;
+        const JsonAllocator *allocator;
+        bool mapped;
+};
+
+// Nodes are laid out breadth first: sources[i] is the DOM container that
+// node i still has to expand, so every container's children end up
+// contiguous and after their parent.
+typedef struct {
+        JsonSnapshotNode *nodes;
+        const JsonValue **sources;
+        size_t node_count;
+        size_t node_capacity;
+        size_t sources_capacity;
+        uint32_t *index;
+        size_t index_count;
+        size_t index_capacity;
+        char *strings;
+        size_t strings_size;
+        size_t strings_capacity;
+        const JsonAllocator *allocator;
+        unsigned flags;
+} SnapshotWriter;
+
+typedef struct {
+        const char *key;
+        size_t length;
+        uint32_t member;
+} SnapshotKey;
+
+static bool writer_reserve(SnapshotWriter *writer, void **items,
+                           size_t *capacity, size_t needed, size_t item_size);
+static bool append_node(SnapshotWriter *writer, const JsonValue *value);
+static bool append_string(SnapshotWriter *writer, uint32_t type,
+                          const char *string, size_t length);
+static bool expand_node(SnapshotWriter *writer, size_t node);
+static bool build_key_index(SnapshotWriter *writer, size_t node,
+                            const JsonObject *object);
+static int compare_keys(const char *a, size_t a_length, const char *b,
+                        size_t b_length);
+static int compare_snapshot_keys(const void *a, const void *b);
+static bool write_snapshot(const SnapshotWriter *writer, const char *path);
+static void writer_destroy(SnapshotWriter *writer);
+static bool load_data(JsonSnapshot *snapshot, const char *path);
+static bool check_header(JsonSnapshot *snapshot);
+static bool verify_nodes(const JsonSnapshot *snapshot);
+
+bool json_document_save(const JsonObject *root, const char *path,
+                        unsigned flags) {
+    SnapshotWriter writer = {
+        .allocator = json_default_allocator(),
+        .flags = flags,
+    };
+    JsonValue root_value = {.object = *root, .type = JSON_OBJECT};
+
+    bool ok = append_node(&writer, &root_value);
+    for (size_t i = 0; ok && i < writer.node_count; i++) {
+        ok = expand_node(&writer, i);
+    }
+    ok = ok && write_snapshot(&writer, path);
+
+    writer_destroy(&writer);
+    return ok;
+}
+
+JsonSnapshot *json_document_load(const char *path,
+                                 const JsonAllocator *allocator,
+                                 unsigned flags) {
+    if (!allocator) {
+        allocator = json_default_allocator();
+    }
+
+    JsonSnapshot *snapshot = allocator->alloc(allocator->ctx,
+                                              sizeof(JsonSnapshot));
+    if (!snapshot) {
+        return NULL;
+    }
+    *snapshot = (JsonSnapshot){.allocator = allocator};
+
+    if (!load_data(snapshot, path)) {
+        allocator->free(allocator->ctx, snapshot);
+        return NULL;
+    }
+    if (!check_header(snapshot) ||
+        ((flags & JSON_SNAPSHOT_VERIFY) && !verify_nodes(snapshot))) {
+        json_snapshot_close(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+void json_snapshot_close(JsonSnapshot *snapshot) {
+    if (!snapshot) {
+        return;
+    }
+
+    const JsonAllocator *allocator = snapshot->allocator;
+#ifdef SNAPSHOT_HAVE_MMAP
+    if (snapshot->mapped) {
+        munmap((void *)snapshot->data, snapshot->length);
+    } else
+#endif
+    {
+        allocator->free(allocator->ctx, (void *)snapshot->data);
+    }
+
+    allocator->free(allocator->ctx, snapshot);
+}
+
+const JsonSnapshotNode *json_snapshot_root(const JsonSnapshot *snapshot) {
+    return &snapshot->nodes[0];
+}
+
+const char *json_snapshot_string(const JsonSnapshot *snapshot,
+                                 const JsonSnapshotNode *node,
+                                 size_t *length) {
+    if (node->type != JSON_STRING) {
+        return NULL;
+    }
+    *length = node->size;
+    return snapshot->strings + node->string;
+}
+
+const JsonSnapshotNode *json_snapshot_element(const JsonSnapshot *snapshot,
+                                              const JsonSnapshotNode *array,
+                                              size_t index) {
+    if (array->type != JSON_ARRAY || index >= array->size) {
+        return NULL;
+    }
+    return &snapshot->nodes[array->first + index];
+}
+
+const JsonSnapshotNode *json_snapshot_member(const JsonSnapshot *snapshot,
+                                             const JsonSnapshotNode *object,
+                                             size_t index, const char **key,
+                                             size_t *key_length) {
+    if (object->type != JSON_OBJECT || index >= object->size) {
+        return NULL;
+    }
+
+    const JsonSnapshotNode *key_node =
+        &snapshot->nodes[object->first + 2 * index];
+    if (key) {
+        *key = snapshot->strings + key_node->string;
+    }
+    if (key_length) {
+        *key_length = key_node->size;
+    }
+    return key_node + 1;
+}
+
+const JsonSnapshotNode *json_snapshot_get(const JsonSnapshot *snapshot,
+                                          const JsonSnapshotNode *object,
+                                          const char *key, size_t length) {
+    if (object->type != JSON_OBJECT) {
+        return NULL;
+    }
+
+    const JsonSnapshotNode *members = &snapshot->nodes[object->first];
+    if (object->index == SNAPSHOT_NO_INDEX) {
+        for (size_t i = 0; i < object->size; i++) {
+            const JsonSnapshotNode *key_node = &members[2 * i];
+            const char *name = snapshot->strings + key_node->string;
+            if (key_node->size == length && memcmp(name, key, length) == 0) {
+                return key_node + 1;
+            }
+        }
+        return NULL;
+    }
+
+    const uint32_t *order = snapshot->index + object->index;
+    size_t low = 0;
+    size_t high = object->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const JsonSnapshotNode *key_node = &members[2 * order[mid]];
+        int cmp = compare_keys(snapshot->strings + key_node->string,
+                               key_node->size, key, length);
+        if (cmp == 0) {
+            return key_node + 1;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+static bool writer_reserve(SnapshotWriter *writer, void **items,
+                           size_t *capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 256;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    const JsonAllocator *allocator = writer->allocator;
+    void *new_items =
+        allocator->realloc(allocator->ctx, *items, new_capacity * item_size);
+    if (!new_items) {
+        return false;
+    }
+
+    *items = new_items;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool append_node(SnapshotWriter *writer, const JsonValue *value) {
+    if (value->type == JSON_STRING) {
+        size_t length;
+        const char *string = json_string(value, &length);
+        return append_string(writer, JSON_STRING, string, length);
+    }
+
+    size_t needed = writer->node_count + 1;
+    if (needed > UINT32_MAX ||
+        !writer_reserve(writer, (void **)&writer->nodes,
+                        &writer->node_capacity, needed,
+                        sizeof(JsonSnapshotNode)) ||
+        !writer_reserve(writer, (void **)&writer->sources,
+                        &writer->sources_capacity, needed,
+                        sizeof(JsonValue *))) {
+        return false;
+    }
+
+    JsonSnapshotNode *node = &writer->nodes[writer->node_count];
+    const JsonValue **source = &writer->sources[writer->node_count];
+    *node = (JsonSnapshotNode){.type = value->type};
+    *source = NULL;
+    switch (value->type) {
+    case JSON_NUMBER:
+        node->number = value->number;
+        break;
+    case JSON_BOOL:
+        node->boolean = value->boolean;
+        break;
+    case JSON_ARRAY:
+    case JSON_OBJECT:
+        *source = value;
+        break;
+    case JSON_STRING:
+    case JSON_NULL:
+        break;
+    }
+
+    writer->node_count++;
+    return true;
+}
+
+static bool append_string(SnapshotWriter *writer, uint32_t type,
+                          const char *string, size_t length) {
+    if (length > UINT32_MAX ||
+        !writer_reserve(writer, (void **)&writer->strings,
+                        &writer->strings_capacity,
+                        writer->strings_size + length + 1, 1)) {
+        return false;
+    }
+    size_t offset = writer->strings_size;
+    memcpy(writer->strings + offset, string, length);
+    writer->strings[offset + length] = '\0';
+    writer->strings_size += length + 1;
+
+    JsonValue placeholder = {.type = JSON_NULL};
+    if (!append_node(writer, &placeholder)) {
+        return false;
+    }
+    JsonSnapshotNode *node = &writer->nodes[writer->node_count - 1];
+    node->type = type;
+    node->size = (uint32_t)length;
+    node->string = offset;
+    return true;
+}
+
+static bool expand_node(SnapshotWriter *writer, size_t node) {
+    const JsonValue *source = writer->sources[node];
+    if (!source) {
+        return true;
+    }
+
+    size_t first = writer->node_count;
+    size_t size;
+    if (source->type == JSON_ARRAY) {
+        const JsonArray *array = &source->array;
+        size = array->size;
+        for (size_t i = 0; i < size; i++) {
+            JsonValue element = json_array_get(array, i);
+            const JsonValue *child = array->kind == JSON_ARRAY_VALUES
+                                         ? &array->values[i]
+                                         : &element;
+            if (!append_node(writer, child)) {
+                return false;
+            }
+        }
+    } else {
+        const JsonObject *object = &source->object;
+        size = object->size;
+        for (size_t i = 0; i < size; i++) {
+            const JsonMember *member = &object->members[i];
+            if (!append_string(writer, JSON_STRING, member->key,
+                               strlen(member->key)) ||
+                !append_node(writer, &member->value)) {
+                return false;
+            }
+        }
+    }
+    if (size > UINT32_MAX) {
+        return false;
+    }
+
+    writer->nodes[node].first = (uint32_t)first;
+    writer->nodes[node].size = (uint32_t)size;
+    writer->nodes[node].index = SNAPSHOT_NO_INDEX;
+    if (source->type == JSON_OBJECT &&
+        (writer->flags & JSON_SNAPSHOT_KEY_INDEX) &&
+        size >= SNAPSHOT_INDEX_MIN_MEMBERS) {
+        return build_key_index(writer, node, &source->object);
+    }
+    return true;
+}
+
+static bool build_key_index(SnapshotWriter *writer, size_t node,
+                            const JsonObject *object) {
+    const JsonAllocator *allocator = writer->allocator;
+    size_t size = object->size;
+    if (writer->index_count + size > UINT32_MAX ||
+        !writer_reserve(writer, (void **)&writer->index,
+                        &writer->index_capacity, writer->index_count + size,
+                        sizeof(uint32_t))) {
+        return false;
+    }
+
+    SnapshotKey *keys = allocator->alloc(allocator->ctx,
+                                         sizeof(SnapshotKey) * size);
+    if (!keys) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = (SnapshotKey){
+            .key = object->members[i].key,
+            .length = strlen(object->members[i].key),
+            .member = (uint32_t)i,
+        };
+    }
+    qsort(keys, size, sizeof(SnapshotKey), compare_snapshot_keys);
+
+    writer->nodes[node].index = (uint32_t)writer->index_count;
+    for (size_t i = 0; i < size; i++) {
+        writer->index[writer->index_count++] = keys[i].member;
+    }
+
+    allocator->free(allocator->ctx, keys);
+    return true;
+}
+
+static int compare_keys(const char *a, size_t a_length, const char *b,
+                        size_t b_length) {
+    int cmp = memcmp(a, b, a_length < b_length ? a_length : b_length);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+static int compare_snapshot_keys(const void *a, const void *b) {
+    const SnapshotKey *left = a;
+    const SnapshotKey *right = b;
+    return compare_keys(left->key, left->length, right->key, right->length);
+}
+
+static bool write_snapshot(const SnapshotWriter *writer, const char *path) {
+    SnapshotHeader header = {
+        .version = SNAPSHOT_VERSION,
+        .byte_order = SNAPSHOT_BYTE_ORDER,
+        .node_count = writer->node_count,
+        .index_offset = sizeof(SnapshotHeader) +
+                        writer->node_count * sizeof(JsonSnapshotNode),
+        .index_count = writer->index_count,
+        .strings_size = writer->strings_size,
+    };
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.strings_offset =
+        header.index_offset + writer->index_count * sizeof(uint32_t);
+
+    FILE *stream = fopen(path, "wb");
+    if (!stream) {
+        return false;
+    }
+
+    bool ok =
+        fwrite(&header, sizeof(header), 1, stream) == 1 &&
+        fwrite(writer->nodes, sizeof(JsonSnapshotNode), writer->node_count,
+               stream) == writer->node_count &&
+        fwrite(writer->index, sizeof(uint32_t), writer->index_count, stream) ==
+            writer->index_count &&
+        fwrite(writer->strings, 1, writer->strings_size, stream) ==
+            writer->strings_size;
+
+    return fclose(stream) == 0 && ok;
+}
+
+static void writer_destroy(SnapshotWriter *writer) {
+    const JsonAllocator *allocator = writer->allocator;
+    allocator->free(allocator->ctx, writer->nodes);
+    allocator->free(allocator->ctx, writer->sources);
+    allocator->free(allocator->ctx, writer->index);
+    allocator->free(allocator->ctx, writer->strings);
+}
+
+static bool load_data(JsonSnapshot *snapshot, const char *path) {
+#ifdef SNAPSHOT_HAVE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            // Shared and read-only, so every process that loads the same
+            // snapshot uses the same page cache pages.
+            data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd,
+                        0);
+        }
+        close(fd);
+        if (data != MAP_FAILED) {
+            snapshot->data = data;
+            snapshot->length = (size_t)st.st_size;
+            snapshot->mapped = true;
+            return true;
+        }
+    }
+#endif
+
+    FILE *stream = fopen(path, "rb");
+    if (!stream) {
+        return false;
+    }
+
+    const JsonAllocator *allocator = snapshot->allocator;
+    char *data = NULL;
+    long length = -1;
+    if (fseek(stream, 0, SEEK_END) == 0 && (length = ftell(stream)) > 0 &&
+        fseek(stream, 0, SEEK_SET) == 0) {
+        data = allocator->alloc(allocator->ctx, (size_t)length);
+    }
+    bool ok = data && fread(data, 1, (size_t)length, stream) == (size_t)length;
+    fclose(stream);
+    if (!ok) {
+        allocator->free(allocator->ctx, data);
+        return false;
+    }
+
+    snapshot->data = data;
+    snapshot->length = (size_t)length;
+    snapshot->mapped = false;
+    return true;
+}
+
+static bool check_header(JsonSnapshot *snapshot) {
+    SnapshotHeader header;
+    if (snapshot->length < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, snapshot->data, sizeof(header));
+
+    size_t length = snapshot->length;
+    size_t nodes_space = length - sizeof(header);
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION ||
+        header.byte_order != SNAPSHOT_BYTE_ORDER || header.node_count == 0 ||
+        header.node_count > nodes_space / sizeof(JsonSnapshotNode) ||
+        header.index_offset !=
+            sizeof(header) + header.node_count * sizeof(JsonSnapshotNode) ||
+        header.index_count >
+            (length - header.index_offset) / sizeof(uint32_t) ||
+        header.strings_offset !=
+            header.index_offset + header.index_count * sizeof(uint32_t) ||
+        header.strings_size > length - header.strings_offset) {
+        return false;
+    }
+
+    snapshot->nodes =
+        (const JsonSnapshotNode *)(snapshot->data + sizeof(header));
+    snapshot->node_count = header.node_count;
+    snapshot->index = (const uint32_t *)(snapshot->data + header.index_offset);
+    snapshot->index_count = header.index_count;
+    snapshot->strings = snapshot->data + header.strings_offset;
+    snapshot->strings_size = header.strings_size;
+
+    return snapshot->nodes[0].type == JSON_OBJECT;
+}
+
+// Children always follow their parent, so checking that every reference
+// points forward and in bounds also rules out cycles.
+static bool verify_nodes(const JsonSnapshot *snapshot) {
+    for (size_t i = 0; i < snapshot->node_count; i++) {
+        const JsonSnapshotNode *node = &snapshot->nodes[i];
+        size_t size = node->size;
+        size_t children = size;
+
+        switch (node->type) {
+        case JSON_STRING:
+            if (node->string >= snapshot->strings_size ||
+                size >= snapshot->strings_size - node->string ||
+                snapshot->strings[node->string + size] != '\0') {
+                return false;
+            }
+            continue;
+        case JSON_NUMBER:
+        case JSON_BOOL:
+        case JSON_NULL:
+            continue;
+        case JSON_OBJECT:
+            children = 2 * size;
+            break;
+        case JSON_ARRAY:
+            break;
+        default:
+            return false;
+        }
+
+        if (size > 0 && (node->first <= i ||
+                         children > snapshot->node_count - node->first)) {
+            return false;
+        }
+        if (node->type != JSON_OBJECT) {
+            continue;
+        }
+        for (size_t m = 0; m < size; m++) {
+            if (snapshot->nodes[node->first + 2 * m].type != JSON_STRING) {
+                return false;
+            }
+        }
+        if (node->index != SNAPSHOT_NO_INDEX) {
+            if (node->index > snapshot->index_count ||
+                size > snapshot->index_count - node->index) {
+                return false;
+            }
+            for (size_t m = 0; m < size; m++) {
+                if (snapshot->index[node->index + m] >= size) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
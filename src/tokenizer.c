@@ -1,13 +1,69 @@
 #include "../include/tokenizer.h"
-#include <ctype.h>
+#include "../include/utf8.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-static bool is_whitespace(const char c);
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Character classes for every byte value, indexed as unsigned char so bytes
+// above 0x7F classify the same way regardless of locale or char signedness.
+enum {
+    CHAR_WHITESPACE = 1 << 0,
+    CHAR_DIGIT = 1 << 1,
+    CHAR_HEX_DIGIT = 1 << 2,
+    CHAR_NUMBER_START = 1 << 3,
+    CHAR_DELIMITER = 1 << 4,
+    CHAR_CONTROL = 1 << 5,
+    CHAR_STRING_SPECIAL = 1 << 6,
+    CHAR_SIMPLE_ESCAPE = 1 << 7,
+};
+
+#define WS (CHAR_WHITESPACE | CHAR_DELIMITER)
+#define DIG (CHAR_DIGIT | CHAR_HEX_DIGIT | CHAR_NUMBER_START)
+#define HEX CHAR_HEX_DIGIT
+#define CTL (CHAR_CONTROL | CHAR_STRING_SPECIAL)
+
+static const uint8_t char_classes[256] = {
+    ['\0'] = CTL | CHAR_DELIMITER,
+    [0x01] = CTL, [0x02] = CTL, [0x03] = CTL, [0x04] = CTL, [0x05] = CTL,
+    [0x06] = CTL, [0x07] = CTL, [0x08] = CTL, [0x0b] = CTL, [0x0c] = CTL,
+    [0x0e] = CTL, [0x0f] = CTL, [0x10] = CTL, [0x11] = CTL, [0x12] = CTL,
+    [0x13] = CTL, [0x14] = CTL, [0x15] = CTL, [0x16] = CTL, [0x17] = CTL,
+    [0x18] = CTL, [0x19] = CTL, [0x1a] = CTL, [0x1b] = CTL, [0x1c] = CTL,
+    [0x1d] = CTL, [0x1e] = CTL, [0x1f] = CTL,
+    ['\n'] = WS | CTL, ['\r'] = WS | CTL, ['\t'] = WS, [' '] = WS,
+    [','] = CHAR_DELIMITER, [']'] = CHAR_DELIMITER, ['}'] = CHAR_DELIMITER,
+    ['"'] = CHAR_STRING_SPECIAL | CHAR_SIMPLE_ESCAPE,
+    ['\\'] = CHAR_STRING_SPECIAL | CHAR_SIMPLE_ESCAPE,
+    ['/'] = CHAR_SIMPLE_ESCAPE,
+    ['b'] = HEX | CHAR_SIMPLE_ESCAPE, ['f'] = HEX | CHAR_SIMPLE_ESCAPE,
+    ['n'] = CHAR_SIMPLE_ESCAPE, ['r'] = CHAR_SIMPLE_ESCAPE,
+    ['t'] = CHAR_SIMPLE_ESCAPE,
+    ['-'] = CHAR_NUMBER_START,
+    ['0'] = DIG, ['1'] = DIG, ['2'] = DIG, ['3'] = DIG, ['4'] = DIG,
+    ['5'] = DIG, ['6'] = DIG, ['7'] = DIG, ['8'] = DIG, ['9'] = DIG,
+    ['a'] = HEX, ['c'] = HEX, ['d'] = HEX, ['e'] = HEX,
+    ['A'] = HEX, ['B'] = HEX, ['C'] = HEX, ['D'] = HEX, ['E'] = HEX,
+    ['F'] = HEX,
+};
+
+#undef WS
+#undef DIG
+#undef HEX
+#undef CTL
+
+static inline JsonToken scan_token(JsonTokenizerCtx *ctx);
+static bool has_class(const char c, uint8_t char_class);
 static char peek(const JsonTokenizerCtx *ctx, size_t offset);
 static void advance(JsonTokenizerCtx *ctx);
+static void advance_run(JsonTokenizerCtx *ctx, size_t count);
+static size_t digit_run(const JsonTokenizerCtx *ctx);
+static size_t string_run(const JsonTokenizerCtx *ctx);
 static JsonToken simple_json_token(JsonTokenType type, JsonTokenizerCtx *ctx);
 static JsonToken invalid_json_token(JsonTokenizerCtx *ctx);
 static JsonToken extract_string_token(JsonTokenizerCtx *ctx);
@@ -15,19 +71,79 @@ static JsonToken extract_number_token(JsonTokenizerCtx *ctx);
 static JsonToken extract_literal_token(JsonTokenizerCtx *ctx,
                                        const char *literal, size_t len,
                                        JsonTokenType type);
+static size_t count_line_breaks(const char *input, size_t length);
 
 JsonTokenizerCtx json_tokenizer_init(const char *json_input, size_t length) {
+    return json_tokenizer_init_ex(json_input, length, 0);
+}
+
+JsonTokenizerCtx json_tokenizer_init_ex(const char *json_input, size_t length,
+                                        unsigned flags) {
+    bool lazy = flags & JSON_TOKENIZER_LAZY_POSITIONS;
     return (JsonTokenizerCtx){
         .input = json_input,
         .input_length = length,
         .pos = 0,
-        .line = 1,
-        .column = 1,
+        .line = lazy ? 0 : 1,
+        .column = lazy ? 0 : 1,
+        .flags = flags,
     };
 }
 
-JsonToken json_tokenizer_next(JsonTokenizerCtx *ctx) {
-    while (is_whitespace(peek(ctx, 0))) {
+void json_tokenizer_position(const JsonTokenizerCtx *ctx, size_t offset,
+                             size_t *line, size_t *column) {
+    if (offset > ctx->input_length) {
+        offset = ctx->input_length;
+    }
+
+    size_t line_start = offset;
+    while (line_start > 0 && ctx->input[line_start - 1] != '\n' &&
+           ctx->input[line_start - 1] != '\r') {
+        line_start--;
+    }
+
+    *line = 1 + count_line_breaks(ctx->input, offset);
+    *column = offset - line_start + 1;
+}
+
+JsonToken json_tokenizer_next(JsonTokenizerCtx *ctx) { return scan_token(ctx); }
+
+size_t json_tokenizer_next_batch(JsonTokenizerCtx *ctx,
+                                 JsonCompactToken *tokens, size_t capacity) {
+    size_t base = ctx->pos;
+    size_t count = 0;
+
+    while (count < capacity) {
+        JsonTokenizerCtx saved = *ctx;
+        JsonToken token = scan_token(ctx);
+
+        size_t offset = token.start ? (size_t)(token.start - ctx->input) - base
+                                    : ctx->pos - base;
+        if (offset > UINT32_MAX - token.length ||
+            token.length > JSON_COMPACT_TOKEN_MAX_LENGTH) {
+            // The token does not fit a compact token. It is left for the
+            // next batch, relative to a new base, or for json_tokenizer_next
+            // when it is the first one.
+            *ctx = saved;
+            break;
+        }
+
+        tokens[count++] = (JsonCompactToken){
+            .offset = (uint32_t)offset,
+            .type = token.type,
+            .length = (uint32_t)token.length,
+        };
+
+        if (token.type == TOKEN_EOF || token.type == TOKEN_INVALID) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+static inline JsonToken scan_token(JsonTokenizerCtx *ctx) {
+    while (has_class(peek(ctx, 0), CHAR_WHITESPACE)) {
         advance(ctx);
     }
 
@@ -45,6 +161,14 @@ JsonToken json_tokenizer_next(JsonTokenizerCtx *ctx) {
         return simple_json_token(TOKEN_COMMA, ctx);
     case ':':
         return simple_json_token(TOKEN_COLON, ctx);
+    case '"':
+        return extract_string_token(ctx);
+    case 't':
+        return extract_literal_token(ctx, "true", 4, TOKEN_TRUE);
+    case 'f':
+        return extract_literal_token(ctx, "false", 5, TOKEN_FALSE);
+    case 'n':
+        return extract_literal_token(ctx, "null", 4, TOKEN_NULL);
     case '\0':
         if (ctx->pos >= ctx->input_length) {
             return (JsonToken){
@@ -58,31 +182,15 @@ JsonToken json_tokenizer_next(JsonTokenizerCtx *ctx) {
         return invalid_json_token(ctx);
     }
 
-    if (current == '"') {
-        return extract_string_token(ctx);
-    }
-
-    if (isdigit(current) || current == '-') {
+    if (has_class(current, CHAR_NUMBER_START)) {
         return extract_number_token(ctx);
     }
 
-    if (isalpha(current)) {
-        if (current == 't' && strncmp(ctx->input + ctx->pos, "true", 4) == 0) {
-            return extract_literal_token(ctx, "true", 4, TOKEN_TRUE);
-        }
-        if (current == 'f' && strncmp(ctx->input + ctx->pos, "false", 5) == 0) {
-            return extract_literal_token(ctx, "false", 5, TOKEN_FALSE);
-        }
-        if (current == 'n' && strncmp(ctx->input + ctx->pos, "null", 4) == 0) {
-            return extract_literal_token(ctx, "null", 4, TOKEN_NULL);
-        }
-    }
-
     return invalid_json_token(ctx);
 }
 
-static bool is_whitespace(const char c) {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+static bool has_class(const char c, uint8_t char_class) {
+    return char_classes[(unsigned char)c] & char_class;
 }
 
 static char peek(const JsonTokenizerCtx *ctx, size_t offset) {
@@ -97,6 +205,11 @@ static void advance(JsonTokenizerCtx *ctx) {
         return;
     }
 
+    if (ctx->flags & JSON_TOKENIZER_LAZY_POSITIONS) {
+        ctx->pos++;
+        return;
+    }
+
     char c = ctx->input[ctx->pos];
     if (c == '\n') {
         ctx->line++;
@@ -115,6 +228,58 @@ static void advance(JsonTokenizerCtx *ctx) {
     ctx->pos++;
 }
 
+// Skips count bytes the caller has already checked contain no line breaks.
+static void advance_run(JsonTokenizerCtx *ctx, size_t count) {
+    ctx->pos += count;
+    if (!(ctx->flags & JSON_TOKENIZER_LAZY_POSITIONS)) {
+        ctx->column += count;
+    }
+}
+
+static size_t digit_run(const JsonTokenizerCtx *ctx) {
+    size_t end = ctx->pos;
+    while (end < ctx->input_length && has_class(ctx->input[end], CHAR_DIGIT)) {
+        end++;
+    }
+    return end - ctx->pos;
+}
+
+// Length of the run of string bytes at ctx->pos that need no special
+// handling, i.e. up to the next quote, backslash or control character.
+static size_t string_run(const JsonTokenizerCtx *ctx) {
+    size_t end = ctx->pos;
+
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i control_max = _mm_set1_epi8(0x1f);
+
+    while (ctx->input_length - end >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(ctx->input + end));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                       _mm_cmpeq_epi8(chunk, backslash));
+        // Unsigned chunk <= 0x1f, except the tab the tokenizer tolerates.
+        __m128i control = _mm_andnot_si128(
+            _mm_cmpeq_epi8(chunk, tab),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max));
+
+        unsigned mask =
+            (unsigned)_mm_movemask_epi8(_mm_or_si128(special, control));
+        if (mask) {
+            return end + (size_t)__builtin_ctz(mask) - ctx->pos;
+        }
+        end += 16;
+    }
+#endif
+
+    while (end < ctx->input_length &&
+           !has_class(ctx->input[end], CHAR_STRING_SPECIAL)) {
+        end++;
+    }
+    return end - ctx->pos;
+}
+
 static JsonToken simple_json_token(JsonTokenType type, JsonTokenizerCtx *ctx) {
     JsonToken token = {
         .type = type,
@@ -124,7 +289,7 @@ static JsonToken simple_json_token(JsonTokenType type, JsonTokenizerCtx *ctx) {
         .column = ctx->column,
     };
 
-    advance(ctx);
+    advance_run(ctx, 1);
     return token;
 }
 
@@ -148,17 +313,27 @@ static JsonToken extract_string_token(JsonTokenizerCtx *ctx) {
     if (peek(ctx, 0) != '"') {
         return invalid_json_token(ctx);
     }
-    advance(ctx);
+    advance_run(ctx, 1);
+
+    while (ctx->pos < ctx->input_length) {
+        // Plain string bytes never contain line breaks, so a whole run of
+        // them can be skipped at once. Multi-byte UTF-8 sequences cannot
+        // contain quotes, backslashes or control characters, so each run can
+        // be validated on its own.
+        size_t run = string_run(ctx);
+        if ((ctx->flags & JSON_TOKENIZER_VALIDATE_UTF8) &&
+            !json_utf8_validate(ctx->input + ctx->pos, run)) {
+            return invalid_json_token(ctx);
+        }
+        advance_run(ctx, run);
 
-    while (peek(ctx, 0) != '\0') {
         char c = peek(ctx, 0);
-
-        if (c < 0x20 && c != '\t') {
+        if (ctx->pos >= ctx->input_length || has_class(c, CHAR_CONTROL)) {
             return invalid_json_token(ctx);
         }
 
         if (c == '"') {
-            advance(ctx);
+            advance_run(ctx, 1);
             return (JsonToken){
                 .type = TOKEN_STRING,
                 .start = ctx->input + start_pos,
@@ -168,26 +343,21 @@ static JsonToken extract_string_token(JsonTokenizerCtx *ctx) {
             };
         }
 
-        if (c == '\\') {
-            advance(ctx);
-            char escaped = peek(ctx, 0);
-            static const char valid_escapes[] = "\"\\/bfnrt";
-            if (strchr(valid_escapes, escaped)) {
-                advance(ctx);
-            } else if (escaped == 'u') {
-                advance(ctx);
-                for (size_t i = 0; i < 4; i++) {
-                    if (!isxdigit(peek(ctx, 0))) {
-                        return invalid_json_token(ctx);
-                    }
-                    advance(ctx);
+        // c is a backslash.
+        advance_run(ctx, 1);
+        char escaped = peek(ctx, 0);
+        if (has_class(escaped, CHAR_SIMPLE_ESCAPE)) {
+            advance_run(ctx, 1);
+        } else if (escaped == 'u') {
+            advance_run(ctx, 1);
+            for (size_t i = 0; i < 4; i++) {
+                if (!has_class(peek(ctx, 0), CHAR_HEX_DIGIT)) {
+                    return invalid_json_token(ctx);
                 }
-                // TODO: Validate UTF-8
-            } else {
-                return invalid_json_token(ctx);
+                advance_run(ctx, 1);
             }
         } else {
-            advance(ctx);
+            return invalid_json_token(ctx);
         }
     }
 
@@ -200,49 +370,45 @@ static JsonToken extract_number_token(JsonTokenizerCtx *ctx) {
     size_t start_column = ctx->column;
 
     if (peek(ctx, 0) == '-') {
-        advance(ctx);
+        advance_run(ctx, 1);
     }
 
+    size_t digits;
     if (peek(ctx, 0) == '0') {
-        advance(ctx);
-        if (isdigit(peek(ctx, 0))) {
+        advance_run(ctx, 1);
+        if (has_class(peek(ctx, 0), CHAR_DIGIT)) {
             return invalid_json_token(ctx);
         }
     } else {
-        if (!isdigit(peek(ctx, 0))) {
+        digits = digit_run(ctx);
+        if (digits == 0) {
             return invalid_json_token(ctx);
         }
-        while (isdigit(peek(ctx, 0))) {
-            advance(ctx);
-        }
+        advance_run(ctx, digits);
     }
 
     if (peek(ctx, 0) == '.') {
-        advance(ctx);
-        if (!isdigit(peek(ctx, 0))) {
+        advance_run(ctx, 1);
+        digits = digit_run(ctx);
+        if (digits == 0) {
             return invalid_json_token(ctx);
         }
-        while (isdigit(peek(ctx, 0))) {
-            advance(ctx);
-        }
+        advance_run(ctx, digits);
     }
 
     if (peek(ctx, 0) == 'e' || peek(ctx, 0) == 'E') {
-        advance(ctx);
+        advance_run(ctx, 1);
         if (peek(ctx, 0) == '+' || peek(ctx, 0) == '-') {
-            advance(ctx);
+            advance_run(ctx, 1);
         }
-        if (!isdigit(peek(ctx, 0))) {
+        digits = digit_run(ctx);
+        if (digits == 0) {
             return invalid_json_token(ctx);
         }
-        while (isdigit(peek(ctx, 0))) {
-            advance(ctx);
-        }
+        advance_run(ctx, digits);
     }
 
-    char next = peek(ctx, 0);
-    if (next != '\0' && !isspace(next) && next != ',' && next != ']' &&
-        next != '}') {
+    if (!has_class(peek(ctx, 0), CHAR_DELIMITER)) {
         return invalid_json_token(ctx);
     }
 
@@ -258,26 +424,75 @@ static JsonToken extract_number_token(JsonTokenizerCtx *ctx) {
 static JsonToken extract_literal_token(JsonTokenizerCtx *ctx,
                                        const char *literal, size_t len,
                                        JsonTokenType type) {
+    size_t start_pos = ctx->pos;
+    size_t start_line = ctx->line;
+    size_t start_column = ctx->column;
 
-    if (strncmp(ctx->input + ctx->pos, literal, len) == 0) {
-        for (size_t i = 0; i < len; i++) {
-            advance(ctx);
-        }
+    // All literals are 4 or 5 bytes: compare the first four as one word and
+    // the optional fifth byte separately, never reading past the input.
+    if (ctx->input_length - ctx->pos < len) {
+        return invalid_json_token(ctx);
+    }
+    uint32_t expected;
+    uint32_t actual;
+    memcpy(&expected, literal, sizeof(expected));
+    memcpy(&actual, ctx->input + ctx->pos, sizeof(actual));
+    if (actual != expected ||
+        (len > 4 && ctx->input[ctx->pos + 4] != literal[4])) {
+        return invalid_json_token(ctx);
+    }
+    advance_run(ctx, len);
 
-        char next = peek(ctx, 0);
-        if (next != '\0' && !isspace(next) && next != ',' && next != ']' &&
-            next != '}') {
-            return invalid_json_token(ctx);
-        }
+    if (!has_class(peek(ctx, 0), CHAR_DELIMITER)) {
+        return invalid_json_token(ctx);
+    }
 
-        return (JsonToken){
-            .type = type,
-            .start = ctx->input + ctx->pos - len,
-            .length = len,
-            .line = ctx->line,
-            .column = ctx->column - len,
-        };
+    return (JsonToken){
+        .type = type,
+        .start = ctx->input + start_pos,
+        .length = len,
+        .line = start_line,
+        .column = start_column,
+    };
+}
+
+// Counts line breaks in input[0, length) the way advance() does: "\n", "\r"
+// and "\r\n" each end one line.
+static size_t count_line_breaks(const char *input, size_t length) {
+    size_t breaks = 0;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+
+    // The shifted load looks one byte ahead to pair "\r\n", so stop while a
+    // full block plus that byte is still inside the range.
+    for (; i + 17 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(input + i));
+        __m128i next = _mm_loadu_si128((const __m128i *)(input + i + 1));
+
+        __m128i is_cr = _mm_cmpeq_epi8(chunk, carriage_return);
+        unsigned nl_mask =
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        unsigned cr_mask = (unsigned)_mm_movemask_epi8(is_cr);
+        unsigned crlf_mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(is_cr, _mm_cmpeq_epi8(next, newline)));
+
+        breaks += (size_t)__builtin_popcount(nl_mask) +
+                  (size_t)__builtin_popcount(cr_mask) -
+                  (size_t)__builtin_popcount(crlf_mask);
+    }
+#endif
+
+    for (; i < length; i++) {
+        if (input[i] == '\n') {
+            breaks++;
+        } else if (input[i] == '\r' &&
+                   !(i + 1 < length && input[i + 1] == '\n')) {
+            breaks++;
+        }
     }
 
-    return invalid_json_token(ctx);
+    return breaks;
 }
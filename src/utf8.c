@@ -0,0 +1,219 @@
+#include "../include/utf8.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define UTF8_HAVE_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#define UTF8_SIMD_MIN_LENGTH 16
+
+static bool utf8_validate_scalar(const unsigned char *data, size_t length);
+#ifdef UTF8_HAVE_SSSE3
+static bool utf8_validate_ssse3(const unsigned char *data, size_t length);
+#endif
+
+bool json_utf8_validate(const char *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+
+#ifdef UTF8_HAVE_SSSE3
+    if (length >= UTF8_SIMD_MIN_LENGTH && __builtin_cpu_supports("ssse3")) {
+        return utf8_validate_ssse3(bytes, length);
+    }
+#endif
+
+    return utf8_validate_scalar(bytes, length);
+}
+
+static bool utf8_validate_scalar(const unsigned char *data, size_t length) {
+    size_t i = 0;
+
+    while (i < length) {
+        if (length - i >= 8) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            if (!(word & 0x8080808080808080ull)) {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char lead = data[i];
+        if (lead < 0x80) {
+            i++;
+            continue;
+        }
+
+        // Continuation count and the allowed range of the first continuation
+        // byte, which is where overlongs, surrogates and values above
+        // U+10FFFF are excluded.
+        size_t continuations;
+        unsigned char low = 0x80;
+        unsigned char high = 0xbf;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            continuations = 1;
+        } else if (lead == 0xe0) {
+            continuations = 2;
+            low = 0xa0;
+        } else if (lead == 0xed) {
+            continuations = 2;
+            high = 0x9f;
+        } else if (lead >= 0xe1 && lead <= 0xef) {
+            continuations = 2;
+        } else if (lead == 0xf0) {
+            continuations = 3;
+            low = 0x90;
+        } else if (lead >= 0xf1 && lead <= 0xf3) {
+            continuations = 3;
+        } else if (lead == 0xf4) {
+            continuations = 3;
+            high = 0x8f;
+        } else {
+            return false;
+        }
+
+        if (length - i - 1 < continuations) {
+            return false;
+        }
+        if (data[i + 1] < low || data[i + 1] > high) {
+            return false;
+        }
+        for (size_t k = 2; k <= continuations; k++) {
+            if ((data[i + k] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+
+        i += continuations + 1;
+    }
+
+    return true;
+}
+
+#ifdef UTF8_HAVE_SSSE3
+
+// Error bits of the Keiser-Lemire lookup tables. Each table classifies one
+// nibble (high and low nibble of the previous byte, high nibble of the
+// current byte); a bit that survives the AND of all three marks an error.
+enum {
+    TOO_SHORT = 1 << 0,
+    TOO_LONG = 1 << 1,
+    OVERLONG_3 = 1 << 2,
+    TOO_LARGE = 1 << 3,
+    SURROGATE = 1 << 4,
+    OVERLONG_2 = 1 << 5,
+    TOO_LARGE_1000 = 1 << 6,
+    OVERLONG_4 = 1 << 6,
+    TWO_CONTS = 1 << 7,
+    CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+};
+
+__attribute__((target("ssse3"))) static inline __m128i
+high_nibbles(__m128i bytes) {
+    return _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0f));
+}
+
+__attribute__((target("ssse3"))) static inline __m128i
+check_special_cases(__m128i input, __m128i prev1) {
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2,
+        CARRY, CARRY, CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+            OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    __m128i byte_1_high =
+        _mm_shuffle_epi8(byte_1_high_table, high_nibbles(prev1));
+    __m128i byte_1_low = _mm_shuffle_epi8(
+        byte_1_low_table, _mm_and_si128(prev1, _mm_set1_epi8(0x0f)));
+    __m128i byte_2_high =
+        _mm_shuffle_epi8(byte_2_high_table, high_nibbles(input));
+
+    return _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+}
+
+// Third and fourth bytes of 3- and 4-byte sequences must be continuations;
+// those are exactly the positions where check_special_cases reported
+// TWO_CONTS, so the two must agree.
+__attribute__((target("ssse3"))) static inline __m128i
+check_multibyte_lengths(__m128i input, __m128i prev_input,
+                        __m128i special_cases) {
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+    __m128i is_fourth_byte =
+        _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+    __m128i must_be_continuation =
+        _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte),
+                      _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+// Flags a block whose last bytes start a sequence that needs more input.
+__attribute__((target("ssse3"))) static inline __m128i
+is_incomplete(__m128i input) {
+    const __m128i max_value =
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                      (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    return _mm_subs_epu8(input, max_value);
+}
+
+__attribute__((target("ssse3"))) static bool
+utf8_validate_ssse3(const unsigned char *data, size_t length) {
+    __m128i error = _mm_setzero_si128();
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+
+    size_t i = 0;
+    while (i < length) {
+        __m128i input;
+        if (length - i >= 16) {
+            input = _mm_loadu_si128((const __m128i *)(data + i));
+        } else {
+            // Zero padding is ASCII, so it cannot hide or create an error.
+            unsigned char tail[16] = {0};
+            memcpy(tail, data + i, length - i);
+            input = _mm_loadu_si128((const __m128i *)tail);
+        }
+        i += 16;
+
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prev_incomplete);
+        } else {
+            __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+            __m128i special_cases = check_special_cases(input, prev1);
+            error = _mm_or_si128(
+                error,
+                check_multibyte_lengths(input, prev_input, special_cases));
+            prev_incomplete = is_incomplete(input);
+        }
+        prev_input = input;
+    }
+
+    error = _mm_or_si128(error, prev_incomplete);
+    return _mm_movemask_epi8(
+               _mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+#endif
@@ -0,0 +1,269 @@
+#include "../include/validate.h"
+#include "../include/number.h"
+#include "../include/parser.h"
+#include "../include/tokenizer.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VALIDATE_TOKEN_BATCH 64
+#define VALIDATE_NUMBER_COPY 512
+
+// What the grammar allows next.
+typedef enum {
+    EXPECT_VALUE,
+    EXPECT_VALUE_OR_CLOSE,
+    EXPECT_KEY,
+    EXPECT_KEY_OR_CLOSE,
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_CLOSE,
+} ValidateExpect;
+
+// Hands out the tokens of one value. With lazy positions they are pulled in
+// batches and the tokenizer is wound back afterwards to just past the last
+// one used; with eager line tracking they are read one at a time.
+typedef struct {
+        JsonTokenizerCtx *tokenizer;
+        JsonCompactToken tokens[VALIDATE_TOKEN_BATCH];
+        size_t base;
+        size_t count;
+        size_t index;
+} TokenReader;
+
+static JsonToken read_token(TokenReader *reader);
+static void stop_reading(TokenReader *reader, const JsonToken *last);
+static size_t token_offset(const JsonTokenizerCtx *tokenizer,
+                           const JsonToken *token);
+static const char *check_number(const char *input, size_t input_length,
+                                size_t offset, size_t length,
+                                const JsonAllocator *allocator);
+static bool fail(const JsonTokenizerCtx *tokenizer, size_t offset,
+                 const char *message, JsonSyntaxError *error);
+
+bool json_validate(const char *input, size_t input_length,
+                   JsonSyntaxError *error) {
+    return json_validate_ex(input, input_length, NULL, error);
+}
+
+bool json_validate_ex(const char *input, size_t input_length,
+                      const JsonParseOptions *options, JsonSyntaxError *error) {
+    unsigned tokenizer_flags = JSON_TOKENIZER_LAZY_POSITIONS;
+    if (options && options->validate_utf8) {
+        tokenizer_flags |= JSON_TOKENIZER_VALIDATE_UTF8;
+    }
+    JsonTokenizerCtx tokenizer =
+        json_tokenizer_init_ex(input, input_length, tokenizer_flags);
+
+    JsonToken token = json_tokenizer_next(&tokenizer);
+    if (!json_skip_value(&tokenizer, &token, options, error)) {
+        return false;
+    }
+    token = json_tokenizer_next(&tokenizer);
+    if (token.type != TOKEN_EOF) {
+        return fail(&tokenizer, token_offset(&tokenizer, &token),
+                    token.type == TOKEN_INVALID
+                        ? "Invalid token"
+                        : "Unexpected data after the value",
+                    error);
+    }
+    return true;
+}
+
+bool json_skip_value(JsonTokenizerCtx *tokenizer, const JsonToken *token,
+                     const JsonParseOptions *options, JsonSyntaxError *error) {
+    const JsonAllocator *allocator = options && options->allocator
+                                         ? options->allocator
+                                         : json_default_allocator();
+    size_t max_depth = json_parse_max_depth(options);
+    TokenReader reader = {.tokenizer = tokenizer};
+
+    // Bit i is set when the container at depth i is an object.
+    uint64_t objects[JSON_MAX_DEPTH / 64];
+    size_t depth = 0;
+    ValidateExpect expect = EXPECT_VALUE;
+
+    for (JsonToken current = *token;; current = read_token(&reader)) {
+        size_t offset = token_offset(tokenizer, &current);
+
+        if (current.type == TOKEN_INVALID) {
+            return fail(tokenizer, offset, "Invalid token", error);
+        }
+
+        switch (expect) {
+        case EXPECT_KEY_OR_CLOSE:
+            if (current.type == TOKEN_RIGHT_BRACE) {
+                depth--;
+                break;
+            }
+            // fall through
+        case EXPECT_KEY:
+            if (current.type != TOKEN_STRING) {
+                return fail(tokenizer, offset, "Expected a string key", error);
+            }
+            expect = EXPECT_COLON;
+            continue;
+
+        case EXPECT_COLON:
+            if (current.type != TOKEN_COLON) {
+                return fail(tokenizer, offset, "Expected ':'", error);
+            }
+            expect = EXPECT_VALUE;
+            continue;
+
+        case EXPECT_VALUE_OR_CLOSE:
+            if (current.type == TOKEN_RIGHT_BRACKET) {
+                depth--;
+                break;
+            }
+            // fall through
+        case EXPECT_VALUE:
+            if (current.type == TOKEN_LEFT_BRACE ||
+                current.type == TOKEN_LEFT_BRACKET) {
+                if (depth == max_depth) {
+                    return fail(tokenizer, offset, "Nesting too deep", error);
+                }
+                bool object = current.type == TOKEN_LEFT_BRACE;
+                if (object) {
+                    objects[depth / 64] |= 1ull << (depth % 64);
+                    expect = EXPECT_KEY_OR_CLOSE;
+                } else {
+                    objects[depth / 64] &= ~(1ull << (depth % 64));
+                    expect = EXPECT_VALUE_OR_CLOSE;
+                }
+                depth++;
+                continue;
+            }
+            if (current.type != TOKEN_STRING &&
+                current.type != TOKEN_NUMBER && current.type != TOKEN_TRUE &&
+                current.type != TOKEN_FALSE && current.type != TOKEN_NULL) {
+                return fail(tokenizer, offset,
+                            current.type == TOKEN_EOF
+                                ? "Unexpected end of input"
+                                : "Expected a value",
+                            error);
+            }
+            if (current.type == TOKEN_NUMBER) {
+                const char *message =
+                    check_number(tokenizer->input, tokenizer->input_length,
+                                 offset, current.length, allocator);
+                if (message) {
+                    return fail(tokenizer, offset, message, error);
+                }
+            }
+            break;
+
+        case EXPECT_COMMA_OR_CLOSE: {
+            bool object = (objects[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1;
+            if (current.type == TOKEN_COMMA) {
+                expect = object ? EXPECT_KEY : EXPECT_VALUE;
+                continue;
+            }
+            if (current.type !=
+                (object ? TOKEN_RIGHT_BRACE : TOKEN_RIGHT_BRACKET)) {
+                return fail(tokenizer, offset,
+                            object ? "Expected ',' or '}'"
+                                   : "Expected ',' or ']'",
+                            error);
+            }
+            depth--;
+            break;
+        }
+        }
+
+        // A value just ended.
+        if (depth == 0) {
+            stop_reading(&reader, &current);
+            return true;
+        }
+        expect = EXPECT_COMMA_OR_CLOSE;
+    }
+}
+
+static JsonToken read_token(TokenReader *reader) {
+    JsonTokenizerCtx *tokenizer = reader->tokenizer;
+    if (!(tokenizer->flags & JSON_TOKENIZER_LAZY_POSITIONS)) {
+        return json_tokenizer_next(tokenizer);
+    }
+
+    if (reader->index == reader->count) {
+        reader->base = tokenizer->pos;
+        reader->count = json_tokenizer_next_batch(tokenizer, reader->tokens,
+                                                  VALIDATE_TOKEN_BATCH);
+        reader->index = 0;
+    }
+    if (reader->index == reader->count) {
+        // Too long for a compact token; the tokenizer is left at it.
+        return json_tokenizer_next(tokenizer);
+    }
+    JsonCompactToken compact = reader->tokens[reader->index++];
+    return (JsonToken){
+        .type = compact.type,
+        .start = tokenizer->input + reader->base + compact.offset,
+        .length = compact.length,
+    };
+}
+
+// Tokens batched past the end of the value are given back, so the caller's
+// next read starts right after it.
+static void stop_reading(TokenReader *reader, const JsonToken *last) {
+    if (reader->index < reader->count) {
+        reader->tokenizer->pos =
+            (size_t)(last->start - reader->tokenizer->input) + last->length;
+    }
+}
+
+// Invalid tokens have no start; the tokenizer stopped on them.
+static size_t token_offset(const JsonTokenizerCtx *tokenizer,
+                           const JsonToken *token) {
+    return token->start ? (size_t)(token->start - tokenizer->input)
+                        : tokenizer->pos;
+}
+
+// The parser rejects numbers that strtod reports out of range; the fast path
+// settles almost every token without it. A number is always followed by a
+// delimiter, so strtod reads the input in place and only a number ending the
+// input needs a terminated copy, on the heap when it is long.
+static const char *check_number(const char *input, size_t input_length,
+                                size_t offset, size_t length,
+                                const JsonAllocator *allocator) {
+    const char *number = input + offset;
+    double value;
+    if (json_number_parse_fast(number, length, &value)) {
+        return NULL;
+    }
+
+    char buffer[VALIDATE_NUMBER_COPY];
+    char *copy = NULL;
+    if (offset + length == input_length) {
+        copy = length < sizeof(buffer)
+                   ? buffer
+                   : allocator->alloc(allocator->ctx, length + 1);
+        if (!copy) {
+            return "Out of memory";
+        }
+        memcpy(copy, number, length);
+        copy[length] = '\0';
+        number = copy;
+    }
+    errno = 0;
+    strtod(number, NULL);
+    bool in_range = errno != ERANGE;
+    if (copy && copy != buffer) {
+        allocator->free(allocator->ctx, copy);
+    }
+    return in_range ? NULL : "Number out of range";
+}
+
+static bool fail(const JsonTokenizerCtx *tokenizer, size_t offset,
+                 const char *message, JsonSyntaxError *error) {
+    if (error) {
+        error->offset = offset;
+        error->message = message;
+        json_tokenizer_position(tokenizer, offset, &error->line,
+                                &error->column);
+    }
+    return false;
+}
@@ -1,10 +1,21 @@
+#include "../include/cache.h"
+#include "../include/columnar.h"
+#include "../include/diff.h"
+#include "../include/edit.h"
+#include "../include/file.h"
+#include "../include/hash.h"
 #include "../include/parser.h"
+#include "../include/patch.h"
+#include "../include/schema.h"
+#include "../include/snapshot.h"
+#include "../include/validate.h"
 #include "./Unity/src/unity.h"
 #include "./Unity/src/unity_internals.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 void setUp(void) {}
 void tearDown(void) {}
@@ -13,8 +24,12 @@ static void assert_json_string(JsonValue *value, const char *expected) {
     TEST_ASSERT_NOT_NULL_MESSAGE(value, "JSON value is NULL");
     TEST_ASSERT_EQUAL_MESSAGE(JSON_STRING, value->type,
                               "Value type is not JSON_STRING");
-    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, value->string,
-                                     "String value mismatch");
+    size_t length;
+    const char *string = json_string(value, &length);
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(strlen(expected), length,
+                                     "String length mismatch");
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE(expected, string, length,
+                                         "String value mismatch");
 }
 
 static void assert_json_number(JsonValue *value, double expected) {
@@ -61,22 +76,17 @@ static JsonValue *get_object_value(JsonValue *object, const char *key) {
     TEST_ASSERT_EQUAL_MESSAGE(JSON_OBJECT, object->type,
                               "Value is not an object");
 
-    for (size_t i = 0; i < object->object.size; i++) {
-        if (strcmp(object->object.keys[i], key) == 0) {
-            return object->object.values[i];
-        }
-    }
-
-    TEST_FAIL_MESSAGE("Key not found in object");
-    return NULL;
+    JsonValue *value = json_object_get(&object->object, key);
+    TEST_ASSERT_NOT_NULL_MESSAGE(value, "Key not found in object");
+    return value;
 }
 
-static JsonValue *get_array_value(JsonValue *array, size_t index) {
+static JsonValue get_array_value(JsonValue *array, size_t index) {
     TEST_ASSERT_NOT_NULL_MESSAGE(array, "Array is NULL");
     TEST_ASSERT_EQUAL_MESSAGE(JSON_ARRAY, array->type, "Value is not an array");
-    TEST_ASSERT_TRUE_MESSAGE(index < array->array.size,
+    TEST_ASSERT_TRUE_MESSAGE(index < json_array_size(&array->array),
                              "Array index out of bounds");
-    return array->array.values[index];
+    return json_array_get(&array->array, index);
 }
 
 void test_parse_empty_object(void) {
@@ -97,8 +107,9 @@ void test_parse_object_with_string_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->keys[0], "Key mismatch");
-    assert_json_string(result->values[0], "value");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[0].value, "value");
 
     free_json_value((JsonValue *)result);
 }
@@ -111,8 +122,9 @@ void test_parse_object_with_empty_string_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->keys[0], "Key mismatch");
-    assert_json_string(result->values[0], "");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[0].value, "");
 
     free_json_value((JsonValue *)result);
 }
@@ -125,8 +137,9 @@ void test_parse_object_with_number_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("number", result->keys[0], "Key mismatch");
-    assert_json_number(result->values[0], 123.0);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("number", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_number(&result->members[0].value, 123.0);
 
     free_json_value((JsonValue *)result);
 }
@@ -139,9 +152,9 @@ void test_parse_object_with_negative_number_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("negative", result->keys[0],
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("negative", result->members[0].key,
                                      "Key mismatch");
-    assert_json_number(result->values[0], -456.0);
+    assert_json_number(&result->members[0].value, -456.0);
 
     free_json_value((JsonValue *)result);
 }
@@ -154,9 +167,9 @@ void test_parse_object_with_decimal_number_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("decimal", result->keys[0],
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("decimal", result->members[0].key,
                                      "Key mismatch");
-    assert_json_number(result->values[0], 78.9);
+    assert_json_number(&result->members[0].value, 78.9);
 
     free_json_value((JsonValue *)result);
 }
@@ -169,9 +182,9 @@ void test_parse_object_with_scientific_number_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("scientific", result->keys[0],
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("scientific", result->members[0].key,
                                      "Key mismatch");
-    assert_json_number(result->values[0], 1.2e-3);
+    assert_json_number(&result->members[0].value, 1.2e-3);
 
     free_json_value((JsonValue *)result);
 }
@@ -184,8 +197,9 @@ void test_parse_object_with_true_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("bool", result->keys[0], "Key mismatch");
-    assert_json_bool(result->values[0], true);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("bool", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_bool(&result->members[0].value, true);
 
     free_json_value((JsonValue *)result);
 }
@@ -198,8 +212,9 @@ void test_parse_object_with_false_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("bool", result->keys[0], "Key mismatch");
-    assert_json_bool(result->values[0], false);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("bool", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_bool(&result->members[0].value, false);
 
     free_json_value((JsonValue *)result);
 }
@@ -212,8 +227,9 @@ void test_parse_object_with_null_value(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("null", result->keys[0], "Key mismatch");
-    assert_json_null(result->values[0]);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("null", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_null(&result->members[0].value);
 
     free_json_value((JsonValue *)result);
 }
@@ -226,17 +242,17 @@ void test_parse_object_with_multiple_properties(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(3, result->size,
                                      "Object should have 3 properties");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("str", result->keys[0],
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("str", result->members[0].key,
                                      "First key mismatch");
-    assert_json_string(result->values[0], "value");
+    assert_json_string(&result->members[0].value, "value");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("num", result->keys[1],
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("num", result->members[1].key,
                                      "Second key mismatch");
-    assert_json_number(result->values[1], 123.0);
+    assert_json_number(&result->members[1].value, 123.0);
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("bool", result->keys[2],
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("bool", result->members[2].key,
                                      "Third key mismatch");
-    assert_json_bool(result->values[2], true);
+    assert_json_bool(&result->members[2].value, true);
 
     free_json_value((JsonValue *)result);
 }
@@ -249,13 +265,14 @@ void test_parse_object_with_nested_object(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("outer", result->keys[0], "Key mismatch");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("outer", result->members[0].key,
+                                     "Key mismatch");
 
-    JsonValue *inner = result->values[0];
+    JsonValue *inner = &result->members[0].value;
     assert_json_object_size(inner, 1);
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("inner", inner->object.keys[0],
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("inner", inner->object.members[0].key,
                                      "Inner key mismatch");
-    assert_json_string(inner->object.values[0], "value");
+    assert_json_string(&inner->object.members[0].value, "value");
 
     free_json_value((JsonValue *)result);
 }
@@ -282,8 +299,9 @@ void test_parse_empty_array(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("arr", result->keys[0], "Key mismatch");
-    JsonValue *array = result->values[0];
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("arr", result->members[0].key,
+                                     "Key mismatch");
+    JsonValue *array = &result->members[0].value;
     assert_json_array_size(array, 0);
 
     free_json_value((JsonValue *)result);
@@ -297,10 +315,12 @@ void test_parse_array_with_single_string(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("arr", result->keys[0], "Key mismatch");
-    JsonValue *array = result->values[0];
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("arr", result->members[0].key,
+                                     "Key mismatch");
+    JsonValue *array = &result->members[0].value;
     assert_json_array_size(array, 1);
-    assert_json_string(get_array_value(array, 0), "hello");
+    JsonValue element = get_array_value(array, 0);
+    assert_json_string(&element, "hello");
 
     free_json_value((JsonValue *)result);
 }
@@ -313,12 +333,14 @@ void test_parse_array_with_multiple_numbers(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("arr", result->keys[0], "Key mismatch");
-    JsonValue *array = result->values[0];
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("arr", result->members[0].key,
+                                     "Key mismatch");
+    JsonValue *array = &result->members[0].value;
     assert_json_array_size(array, 3);
-    assert_json_number(get_array_value(array, 0), 1.0);
-    assert_json_number(get_array_value(array, 1), 2.0);
-    assert_json_number(get_array_value(array, 2), 3.0);
+    for (size_t i = 0; i < 3; i++) {
+        JsonValue element = get_array_value(array, i);
+        assert_json_number(&element, (double)(i + 1));
+    }
 
     free_json_value((JsonValue *)result);
 }
@@ -346,8 +368,9 @@ void test_parse_with_whitespace(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->keys[0], "Key mismatch");
-    assert_json_string(result->values[0], "value");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[0].value, "value");
 
     free_json_value((JsonValue *)result);
 }
@@ -360,8 +383,9 @@ void test_parse_with_newlines(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->keys[0], "Key mismatch");
-    assert_json_string(result->values[0], "value");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[0].value, "value");
 
     free_json_value((JsonValue *)result);
 }
@@ -374,8 +398,9 @@ void test_parse_with_tabs(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->keys[0], "Key mismatch");
-    assert_json_string(result->values[0], "value");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[0].value, "value");
 
     free_json_value((JsonValue *)result);
 }
@@ -426,11 +451,8 @@ void test_parse_invalid_trailing_comma_in_object(void) {
     const char *input = "{\"key\":\"value\",}";
     JsonObject *result = json_parse(input, strlen(input));
 
-    // This test might pass due to parser implementation details
-    // The key is that we handle the error gracefully
-    if (result != NULL) {
-        free_json_value((JsonValue *)result);
-    }
+    TEST_ASSERT_NULL_MESSAGE(result,
+                             "Trailing comma in object should return NULL");
 }
 
 void test_parse_invalid_unterminated_array(void) {
@@ -456,6 +478,64 @@ void test_parse_invalid_consecutive_commas_in_array(void) {
                              "Consecutive commas in array should return NULL");
 }
 
+void test_parse_invalid_missing_comma(void) {
+    const char *inputs[] = {"{\"arr\":[1 2]}", "{\"a\":1 \"b\":2}",
+                            "{\"a\":[\"x\" {}]}"};
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+        JsonObject *result = json_parse(inputs[i], strlen(inputs[i]));
+        TEST_ASSERT_NULL_MESSAGE(result, inputs[i]);
+    }
+}
+
+void test_parse_max_depth(void) {
+    // Hostile nesting fails at the default limit instead of exhausting the
+    // stack.
+    size_t depth = 100000;
+    char *input = malloc(depth * 2);
+    memset(input, '[', depth);
+    memset(input + depth, ']', depth);
+    TEST_ASSERT_NULL(json_parse_value(input, depth * 2));
+
+    size_t nested = JSON_DEFAULT_MAX_DEPTH * 2;
+    const char *deep = input + depth - nested;
+    JsonParseOptions options = {.max_depth = nested};
+    JsonValue *result = json_parse_value_ex(deep, nested * 2, &options);
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Nesting within max_depth failed");
+    free_json_value(result);
+
+    // Larger limits are clamped to JSON_MAX_DEPTH, which every recursive
+    // walk over a value can handle.
+    options.max_depth = depth;
+    TEST_ASSERT_EQUAL_size_t(JSON_MAX_DEPTH, json_parse_max_depth(&options));
+    deep = input + depth - (JSON_MAX_DEPTH + 1);
+    TEST_ASSERT_NULL(
+        json_parse_value_ex(deep, (JSON_MAX_DEPTH + 1) * 2, &options));
+    deep = input + depth - JSON_MAX_DEPTH;
+    result = json_parse_value_ex(deep, JSON_MAX_DEPTH * 2, &options);
+    TEST_ASSERT_NOT_NULL(result);
+    JsonValue copy;
+    TEST_ASSERT_TRUE(json_value_copy(&copy, result, NULL));
+    JsonValue clone;
+    TEST_ASSERT_TRUE(json_clone(&clone, result, NULL));
+    TEST_ASSERT_TRUE(json_equal(&copy, &clone));
+    TEST_ASSERT_EQUAL_UINT64(json_hash(result), json_hash(&clone));
+    JsonValue *diff = json_diff(result, &copy, NULL);
+    TEST_ASSERT_EQUAL_size_t(0, diff->array.size);
+    free_json_value(diff);
+    json_value_release(&copy, NULL);
+    json_value_release(&clone, NULL);
+    free_json_value(result);
+    free(input);
+
+    options.max_depth = 2;
+    const char *two = "{\"a\":{\"b\":[]}}";
+    TEST_ASSERT_NULL(json_parse_ex(two, strlen(two), &options));
+    const char *one = "{\"a\":{\"b\":1}}";
+    JsonObject *object = json_parse_ex(one, strlen(one), &options);
+    TEST_ASSERT_NOT_NULL(object);
+    free_json_value((JsonValue *)object);
+}
+
 void test_parse_invalid_extra_data_after_object(void) {
     const char *input = "{\"key\":\"value\"}extra";
     JsonObject *result = json_parse(input, strlen(input));
@@ -481,9 +561,10 @@ void test_parse_memory_allocation_string(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(1, result->size,
                                      "Object should have 1 property");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->keys[0], "Key mismatch");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key", result->members[0].key,
+                                     "Key mismatch");
     assert_json_string(
-        result->values[0],
+        &result->members[0].value,
         "very long string that tests memory allocation for strings");
 
     free_json_value((JsonValue *)result);
@@ -498,20 +579,1259 @@ void test_parse_memory_allocation_large_object(void) {
     TEST_ASSERT_EQUAL_size_t_MESSAGE(3, result->size,
                                      "Object should have 3 properties");
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key1", result->keys[0], "Key mismatch");
-    assert_json_string(result->values[0], "val1");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key1", result->members[0].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[0].value, "val1");
+
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key2", result->members[1].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[1].value, "val2");
+
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("key3", result->members[2].key,
+                                     "Key mismatch");
+    assert_json_string(&result->members[2].value, "val3");
+
+    free_json_value((JsonValue *)result);
+}
+
+void test_parse_stats(void) {
+    const char *input = "{\"a\":[1,{\"b\":\"x\"}],\"c\":true}";
+    JsonParseStats stats;
+    memset(&stats, 0xff, sizeof(stats));
+    JsonParseOptions options = {.stats = &stats};
+    JsonObject *result = json_parse_ex(input, strlen(input), &options);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+    if (!json_stats_enabled()) {
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(0, stats.bytes_consumed,
+                                         "Disabled stats should be zeroed");
+        free_json_value((JsonValue *)result);
+        return;
+    }
+
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(strlen(input), stats.bytes_consumed,
+                                     "Bytes consumed mismatch");
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(4, stats.token_counts[TOKEN_STRING],
+                                     "String token count mismatch");
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(2, stats.token_counts[TOKEN_LEFT_BRACE],
+                                     "Brace token count mismatch");
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(1, stats.token_counts[TOKEN_EOF],
+                                     "EOF token count mismatch");
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(3, stats.max_depth, "Max depth mismatch");
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(4, stats.strings_copied,
+                                     "Copied string count mismatch");
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(0, stats.strings_borrowed,
+                                     "Borrowed string count mismatch");
+    TEST_ASSERT_TRUE_MESSAGE(stats.allocations > 0, "No allocations counted");
+    TEST_ASSERT_TRUE_MESSAGE(stats.bytes_allocated > 0,
+                             "No allocated bytes counted");
+
+    free_json_value((JsonValue *)result);
+}
+
+typedef struct {
+        size_t live;
+        size_t calls;
+} CountingPool;
+
+static void *counting_alloc(void *ctx, size_t size) {
+    CountingPool *pool = ctx;
+    pool->live++;
+    pool->calls++;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t size) {
+    CountingPool *pool = ctx;
+    if (!ptr) {
+        pool->live++;
+    }
+    pool->calls++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *ctx, void *ptr) {
+    CountingPool *pool = ctx;
+    if (ptr) {
+        pool->live--;
+    }
+    free(ptr);
+}
+
+void test_parse_with_custom_allocator(void) {
+    const char *input = "{\"a\":[1,\"two\",{\"b\":null}],\"c\":\"d\"}";
+    CountingPool pool = {0};
+    JsonAllocator allocator = {
+        .alloc = counting_alloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+        .ctx = &pool,
+    };
+    JsonParseOptions options = {.allocator = &allocator};
+    JsonObject *result = json_parse_ex(input, strlen(input), &options);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+    TEST_ASSERT_TRUE_MESSAGE(pool.calls > 0, "Allocator was not used");
+    JsonValue root = {.type = JSON_OBJECT, .object = *result};
+    assert_json_string(get_object_value(&root, "c"), "d");
+
+    free_json_value_ex((JsonValue *)result, &allocator);
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(0, pool.live,
+                                     "Allocations leaked or double freed");
+}
+
+void test_parse_invalid_with_custom_allocator(void) {
+    const char *input = "{\"a\":[1,{\"b\":\"x\"},]}";
+    CountingPool pool = {0};
+    JsonAllocator allocator = {
+        .alloc = counting_alloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+        .ctx = &pool,
+    };
+    JsonParseOptions options = {.allocator = &allocator};
+    JsonObject *result = json_parse_ex(input, strlen(input), &options);
+
+    TEST_ASSERT_NULL_MESSAGE(result, "Invalid input should return NULL");
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(0, pool.live,
+                                     "Failed parse leaked allocations");
+}
+
+void test_parser_reuse_reaches_zero_allocations(void) {
+    const char *input = "{\"id\":42,\"tags\":[\"a\",\"b\",\"c\"],"
+                        "\"nested\":{\"ok\":true,\"ratio\":0.25}}";
+    CountingPool pool = {0};
+    JsonAllocator allocator = {
+        .alloc = counting_alloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+        .ctx = &pool,
+    };
+    JsonParseOptions options = {.allocator = &allocator};
+    JsonParser *parser = json_parser_create(&options);
+    TEST_ASSERT_NOT_NULL_MESSAGE(parser, "Parser creation failed");
+
+    for (int round = 0; round < 3; round++) {
+        size_t calls_before = pool.calls;
+        JsonObject *result = json_parser_parse(parser, input, strlen(input));
+
+        TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(3, result->size,
+                                         "Object should have 3 properties");
+        TEST_ASSERT_EQUAL_STRING_MESSAGE("tags", result->members[1].key,
+                                         "Key mismatch");
+        assert_json_array_size(&result->members[1].value, 3);
+        JsonValue tag = get_array_value(&result->members[1].value, 2);
+        assert_json_string(&tag, "c");
+        if (round > 0) {
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(
+                calls_before, pool.calls,
+                "Steady-state parse should not call the allocator");
+        }
+
+        json_parser_reset(parser);
+    }
+
+    TEST_ASSERT_NULL_MESSAGE(json_parser_parse(parser, "{\"a\":}", 7),
+                             "Invalid input should return NULL");
+
+    json_parser_destroy(parser);
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(0, pool.live,
+                                     "Parser leaked allocations");
+}
+
+void test_parse_validate_utf8_option(void) {
+    const char *input = "{\"key\":\"bad \xc0\xaf byte\"}";
+    JsonParseOptions options = {.validate_utf8 = true};
+
+    JsonObject *unchecked = json_parse(input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(unchecked,
+                                 "UTF-8 is not validated by default");
+    free_json_value((JsonValue *)unchecked);
+
+    TEST_ASSERT_NULL_MESSAGE(json_parse_ex(input, strlen(input), &options),
+                             "Invalid UTF-8 should fail validation");
+}
+
+void test_parse_borrowed_strings(void) {
+    const char *input = "{\"key\":\"value\",\"list\":[\"a\",\"\"]}";
+    JsonParseOptions options = {.borrow_strings = true};
+    JsonObject *result = json_parse_ex(input, strlen(input), &options);
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+    JsonValue *value = &result->members[0].value;
+    TEST_ASSERT_EQUAL_MESSAGE(JSON_STRING, value->type, "Expected string");
+    TEST_ASSERT_TRUE_MESSAGE(value->flags & JSON_VALUE_BORROWED,
+                             "String should be borrowed");
+    TEST_ASSERT_EQUAL_PTR(input + 8, value->string);
+    TEST_ASSERT_EQUAL_size_t(5, value->string_length);
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key2", result->keys[1], "Key mismatch");
-    assert_json_string(result->values[1], "val2");
+    JsonValue empty = get_array_value(&result->members[1].value, 1);
+    TEST_ASSERT_EQUAL_size_t(0, empty.string_length);
 
-    TEST_ASSERT_EQUAL_STRING_MESSAGE("key3", result->keys[2], "Key mismatch");
-    assert_json_string(result->values[2], "val3");
+    free_json_value((JsonValue *)result);
+}
 
+void test_parse_string_longer_than_compact_token(void) {
+    // {"k":"xxx..."} with a value too long for a compact token.
+    size_t length = (size_t)JSON_COMPACT_TOKEN_MAX_LENGTH + 1;
+    size_t input_length = length + 8;
+    char *input = malloc(input_length);
+    TEST_ASSERT_NOT_NULL(input);
+    memcpy(input, "{\"k\":\"", 6);
+    memset(input + 6, 'x', length);
+    memcpy(input + 6 + length, "\"}", 2);
+
+    JsonObject *result = json_parse(input, input_length);
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Long string should parse");
+    JsonValue *value = &result->members[0].value;
+    TEST_ASSERT_EQUAL(JSON_STRING, value->type);
+    TEST_ASSERT_EQUAL_size_t(length, value->string_length);
+    TEST_ASSERT_EQUAL_INT('x', value->string[length - 1]);
     free_json_value((JsonValue *)result);
+
+    TEST_ASSERT_TRUE(json_validate(input, input_length, NULL));
+    free(input);
+}
+
+void test_parser_interns_keys(void) {
+    const char *input = "{\"rows\":[{\"id\":1,\"name\":\"a\"},"
+                        "{\"id\":2,\"name\":\"b\"}],\"id\":0}";
+    JsonParser *parser = json_parser_create(NULL);
+    TEST_ASSERT_NOT_NULL_MESSAGE(parser, "Parser creation failed");
+
+    JsonObject *result = json_parser_parse(parser, input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+
+    JsonValue first = get_array_value(&result->members[0].value, 0);
+    JsonValue second = get_array_value(&result->members[0].value, 1);
+    TEST_ASSERT_TRUE_MESSAGE(first.flags & JSON_VALUE_INTERNED_KEYS,
+                             "Nested object keys should be interned");
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(first.object.members[0].key,
+                                  second.object.members[0].key,
+                                  "Equal keys should share storage");
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(first.object.members[1].key,
+                                  second.object.members[1].key,
+                                  "Equal keys should share storage");
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(first.object.members[0].key,
+                                  result->members[1].key,
+                                  "Keys are shared across nesting levels");
+
+    const char *id = json_parser_intern(parser, "id", 2);
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(id, result->members[1].key,
+                                  "Lookup key should intern to the same key");
+    TEST_ASSERT_EQUAL_UINT32(2, json_key_of(id)->length);
+    TEST_ASSERT_EQUAL_UINT64(json_hash_bytes("id", 2), json_key_of(id)->hash);
+    TEST_ASSERT_EQUAL_STRING("id", id);
+
+    json_parser_destroy(parser);
 }
 
+void test_parser_shares_record_shapes(void) {
+    const char *input = "{\"rows\":[{\"id\":1,\"name\":\"a\"},"
+                        "{\"id\":2,\"name\":\"b\"},"
+                        "{\"name\":\"c\",\"id\":3},"
+                        "{\"name\":\"d\",\"id\":4}]}";
+    JsonParser *parser = json_parser_create(NULL);
+    TEST_ASSERT_NOT_NULL_MESSAGE(parser, "Parser creation failed");
+
+    JsonObject *result = json_parser_parse(parser, input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+    assert_json_array_size(&result->members[0].value, 4);
+
+    JsonValue rows[4];
+    for (size_t i = 0; i < 4; i++) {
+        rows[i] = get_array_value(&result->members[0].value, i);
+    }
+    TEST_ASSERT_NOT_NULL(rows[0].object.shape);
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(rows[0].object.shape, rows[1].object.shape,
+                                  "Same key sequence should share a shape");
+    TEST_ASSERT_TRUE_MESSAGE(rows[1].object.shape != rows[2].object.shape,
+                             "Reordered keys are a different shape");
+    TEST_ASSERT_EQUAL_PTR(rows[2].object.shape, rows[3].object.shape);
+    TEST_ASSERT_EQUAL_STRING("id", rows[3].object.members[1].key);
+    assert_json_number(&rows[3].object.members[1].value, 4);
+
+    // Records of one shape pair their members without comparing keys.
+    TEST_ASSERT_FALSE(json_equal(&rows[0], &rows[1]));
+    TEST_ASSERT_TRUE(json_equal(&rows[2], &rows[2]));
+    JsonValue *diff = json_diff(&rows[0], &rows[1], NULL);
+    TEST_ASSERT_NOT_NULL(diff);
+    TEST_ASSERT_EQUAL_size_t(2, diff->array.size);
+    JsonValue op = json_array_get(&diff->array, 1);
+    assert_json_string(json_object_get(&op.object, "path"), "/name");
+    free_json_value(diff);
+
+    // The shape does not grow a value: arrays already fill the union.
+    TEST_ASSERT_EQUAL_size_t(sizeof(JsonArray), sizeof(JsonObject));
+    TEST_ASSERT_EQUAL_size_t(32, sizeof(JsonValue));
+
+    json_parser_destroy(parser);
+}
+
+void test_json_to_columns(void) {
+    const char *input = "[{\"id\":1,\"price\":2.5,\"ok\":true,\"name\":\"ab\"},"
+                        "{\"skip\":{\"x\":[1,2]},\"price\":null,\"id\":2,"
+                        "\"name\":\"\",\"ok\":false},"
+                        "{\"id\":-3,\"name\":\"xyz\"}]";
+    JsonColumnSpec spec[] = {
+        {"id", JSON_COLUMN_INT64},
+        {"price", JSON_COLUMN_DOUBLE},
+        {"ok", JSON_COLUMN_BOOL},
+        {"name", JSON_COLUMN_STRING},
+    };
+    JsonColumns columns;
+    JsonError error;
+
+    TEST_ASSERT_TRUE_MESSAGE(json_to_columns(input, strlen(input), spec, 4,
+                                             &columns, &error, NULL),
+                             error.message);
+    TEST_ASSERT_EQUAL_size_t(3, columns.row_count);
+
+    JsonColumn *id = &columns.columns[0];
+    TEST_ASSERT_EQUAL_INT64(1, id->int64s[0]);
+    TEST_ASSERT_EQUAL_INT64(-3, id->int64s[2]);
+    TEST_ASSERT_EQUAL_size_t(0, id->null_count);
+
+    JsonColumn *price = &columns.columns[1];
+    TEST_ASSERT_EQUAL_FLOAT(2.5, price->doubles[0]);
+    TEST_ASSERT_FALSE(json_column_bit(price->validity, 1));
+    TEST_ASSERT_FALSE(json_column_bit(price->validity, 2));
+    TEST_ASSERT_EQUAL_size_t(2, price->null_count);
+
+    JsonColumn *ok = &columns.columns[2];
+    TEST_ASSERT_TRUE(json_column_bit(ok->bools, 0));
+    TEST_ASSERT_FALSE(json_column_bit(ok->bools, 1));
+    TEST_ASSERT_TRUE(json_column_bit(ok->validity, 1));
+    TEST_ASSERT_FALSE(json_column_bit(ok->validity, 2));
+
+    JsonColumn *name = &columns.columns[3];
+    TEST_ASSERT_EQUAL_size_t(0, name->offsets[0]);
+    TEST_ASSERT_EQUAL_size_t(2, name->offsets[1]);
+    TEST_ASSERT_EQUAL_size_t(2, name->offsets[2]);
+    TEST_ASSERT_EQUAL_size_t(5, name->offsets[3]);
+    TEST_ASSERT_EQUAL_MEMORY("abxyz", name->data, 5);
+    TEST_ASSERT_TRUE(json_column_bit(name->validity, 1));
+
+    json_free_columns(&columns);
+
+    // Skipped members are not stored but must still be valid JSON.
+    input = "[{\"id\":1,\"x\":[{},[],{\"a\":[1,{\"b\":null}]}]}]";
+    TEST_ASSERT_TRUE_MESSAGE(json_to_columns(input, strlen(input), spec, 4,
+                                             &columns, &error, NULL),
+                             error.message);
+    json_free_columns(&columns);
+    const char *malformed[] = {
+        "[{\"id\":1,\"x\":{1 2 : ]}]", "[{\"id\":1,\"x\":[1 2 3]}]",
+        "[{\"id\":1,\"x\":[1}]}]",    "[{\"id\":1,\"x\":{\"a\" 1}}]",
+        "[{\"id\":1,\"x\":[1,]}]",    "[{\"id\":1,\"x\":{\"a\":1,}}]",
+        "[{\"id\":1,\"x\":[1e400]}]",
+    };
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(*malformed); i++) {
+        TEST_ASSERT_FALSE_MESSAGE(json_to_columns(malformed[i],
+                                                  strlen(malformed[i]), spec,
+                                                  4, &columns, &error, NULL),
+                                  malformed[i]);
+    }
+    TEST_ASSERT_EQUAL_STRING("Number out of range in row 0", error.message);
+}
+
+void test_json_to_columns_type_mismatch(void) {
+    const char *input = "[{\"id\":1},{\"id\":\"two\"}]";
+    JsonColumnSpec spec[] = {{"id", JSON_COLUMN_INT64}};
+    JsonColumns columns;
+    JsonError error;
+
+    TEST_ASSERT_FALSE(json_to_columns(input, strlen(input), spec, 1, &columns,
+                                      &error, NULL));
+    TEST_ASSERT_EQUAL_STRING("id", error.key);
+    TEST_ASSERT_NULL(columns.columns);
+
+    input = "[{\"id\":1.5}]";
+    TEST_ASSERT_FALSE(json_to_columns(input, strlen(input), spec, 1, &columns,
+                                      &error, NULL));
+}
+
+void test_parse_typed_arrays(void) {
+    const char *input = "{\"v\":[0.5,-2,1e3,12345678901234567,1.5e-7],"
+                        "\"b\":[true,false,true],\"m\":[1,true,\"x\"]}";
+    JsonObject *result = json_parse(input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+
+    JsonArray *numbers = &result->members[0].value.array;
+    TEST_ASSERT_EQUAL(JSON_ARRAY_NUMBERS, numbers->kind);
+    const double *data = json_array_numbers(numbers);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_TRUE(data[0] == 0.5 && data[1] == -2 && data[2] == 1000);
+    TEST_ASSERT_TRUE(data[3] == 12345678901234567.0);
+    TEST_ASSERT_TRUE(data[4] == 1.5e-7);
+
+    JsonArray *bools = &result->members[1].value.array;
+    TEST_ASSERT_EQUAL(JSON_ARRAY_BOOLS, bools->kind);
+    TEST_ASSERT_NULL(json_array_numbers(bools));
+    JsonValue element = json_array_get(bools, 1);
+    TEST_ASSERT_EQUAL(JSON_BOOL, element.type);
+    TEST_ASSERT_FALSE(element.boolean);
+    element = json_array_get(bools, 2);
+    TEST_ASSERT_TRUE(element.boolean);
+
+    JsonArray *mixed = &result->members[2].value.array;
+    TEST_ASSERT_EQUAL(JSON_ARRAY_VALUES, mixed->kind);
+    TEST_ASSERT_EQUAL_size_t(3, json_array_size(mixed));
+    element = json_array_get(mixed, 0);
+    assert_json_number(&element, 1);
+    element = json_array_get(mixed, 1);
+    TEST_ASSERT_TRUE(element.type == JSON_BOOL && element.boolean);
+    element = json_array_get(mixed, 2);
+    assert_json_string(&element, "x");
+
+    free_json_value((JsonValue *)result);
+}
+
+void test_number_fast_path_matches_strtod(void) {
+    const char *cases[] = {
+        "0",          "-0",         "1",         "123456789",
+        "0.1",        "3.14159",    "-2.5e-3",   "1e22",
+        "1E+2",       "9007199254740993",         "123456789.12345678",
+        "2.2250738585072014e-308", "1.7976931348623157e308", "0.000001234",
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char input[64];
+        snprintf(input, sizeof(input), "{\"n\":[%s]}", cases[i]);
+        JsonObject *result = json_parse(input, strlen(input));
+        TEST_ASSERT_NOT_NULL_MESSAGE(result, cases[i]);
+
+        double expected = strtod(cases[i], NULL);
+        const double *numbers =
+            json_array_numbers(&result->members[0].value.array);
+        TEST_ASSERT_NOT_NULL(numbers);
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&expected, numbers, sizeof(double),
+                                         cases[i]);
+        free_json_value((JsonValue *)result);
+    }
+}
+
+void test_parse_short_strings_inline(void) {
+    const char *input = "{\"status\":\"ok\",\"empty\":\"\","
+                        "\"max\":\"0123456789012345678901\","
+                        "\"long\":\"01234567890123456789012\"}";
+    JsonObject *result = json_parse(input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+
+    TEST_ASSERT_TRUE(result->members[0].value.flags & JSON_VALUE_INLINE);
+    assert_json_string(&result->members[0].value, "ok");
+    TEST_ASSERT_TRUE(result->members[1].value.flags & JSON_VALUE_INLINE);
+    assert_json_string(&result->members[1].value, "");
+    TEST_ASSERT_TRUE_MESSAGE(result->members[2].value.flags & JSON_VALUE_INLINE,
+                             "A string of JSON_SHORT_STRING_MAX fits inline");
+    assert_json_string(&result->members[2].value, "0123456789012345678901");
+    TEST_ASSERT_FALSE(result->members[3].value.flags & JSON_VALUE_INLINE);
+    assert_json_string(&result->members[3].value, "01234567890123456789012");
+
+    free_json_value((JsonValue *)result);
+}
+
+void test_container_iteration(void) {
+    const char *input = "{\"a\":[1,2,3],\"b\":[{\"x\":1},\"s\"],\"c\":null}";
+    JsonObject *result = json_parse(input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+
+    const char *expected_keys[] = {"a", "b", "c"};
+    for (size_t i = 0; i < result->size; i++) {
+        JsonMember *member = &result->members[i];
+        TEST_ASSERT_EQUAL_STRING(expected_keys[i], member->key);
+        TEST_ASSERT_EQUAL_PTR(member, &result->members[0] + i);
+    }
+
+    JsonArrayIterator it = {&result->members[0].value.array, 0};
+    JsonValue element;
+    double sum = 0;
+    while (json_array_next(&it, &element)) {
+        sum += element.number;
+    }
+    TEST_ASSERT_EQUAL_FLOAT(6, sum);
+
+    JsonArray *mixed = &result->members[1].value.array;
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(&mixed->values[0] + 1, &mixed->values[1],
+                                  "Array elements should be contiguous");
+    JsonValue *x = json_object_get(&mixed->values[0].object, "x");
+    assert_json_number(x, 1);
+    TEST_ASSERT_NULL(json_object_get(result, "missing"));
+
+    free_json_value((JsonValue *)result);
+}
+
+void test_parse_file_borrows_from_mapping(void) {
+    char path[] = "/tmp/jsonic_test_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE_MESSAGE(fd >= 0, "Could not create temporary file");
+    const char *content = "{\"name\": \"mapped\", \"values\": [1, 2.5]}\n";
+    TEST_ASSERT_EQUAL_size_t(strlen(content),
+                             (size_t)write(fd, content, strlen(content)));
+    close(fd);
+
+    JsonFile *file = json_parse_file(path, NULL, 0);
+    TEST_ASSERT_NOT_NULL_MESSAGE(file, "File parse failed");
+    TEST_ASSERT_EQUAL_size_t(2, file->root->size);
+
+    JsonValue *name = &file->root->members[0].value;
+    TEST_ASSERT_TRUE_MESSAGE(name->flags & JSON_VALUE_BORROWED,
+                             "String should point into the file data");
+    TEST_ASSERT_TRUE_MESSAGE(name->string > file->data &&
+                                 name->string < file->data + file->length,
+                             "String should point into the file data");
+    TEST_ASSERT_EQUAL_STRING_LEN("mapped", name->string, name->string_length);
+    JsonValue number = get_array_value(&file->root->members[1].value, 1);
+    assert_json_number(&number, 2.5);
+    json_free_file(file);
+
+    file = json_parse_file(path, NULL, JSON_FILE_COPY_STRINGS);
+    TEST_ASSERT_NOT_NULL_MESSAGE(file, "File parse failed");
+    assert_json_string(&file->root->members[0].value, "mapped");
+    json_free_file(file);
+
+    unlink(path);
+    TEST_ASSERT_NULL_MESSAGE(json_parse_file(path, NULL, 0),
+                             "Missing file should return NULL");
+}
+
+void test_document_snapshot_round_trip(void) {
+    const char *input =
+        "{\"name\":\"catalog\",\"items\":[{\"id\":1},{\"id\":2}],"
+        "\"flags\":[true,false],\"ratios\":[0.5,2],\"none\":null,"
+        "\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4}";
+    JsonObject *document = json_parse(input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(document, "Parse result is NULL");
+
+    char path[] = "/tmp/jsonic_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE_MESSAGE(fd >= 0, "Could not create temporary file");
+    close(fd);
+    TEST_ASSERT_TRUE(
+        json_document_save(document, path, JSON_SNAPSHOT_KEY_INDEX));
+    free_json_value((JsonValue *)document);
+
+    JsonSnapshot *snapshot =
+        json_document_load(path, NULL, JSON_SNAPSHOT_VERIFY);
+    TEST_ASSERT_NOT_NULL_MESSAGE(snapshot, "Snapshot load failed");
+    const JsonSnapshotNode *root = json_snapshot_root(snapshot);
+    TEST_ASSERT_EQUAL(JSON_OBJECT, root->type);
+    TEST_ASSERT_EQUAL_UINT32(10, root->size);
+
+    const char *key;
+    size_t length;
+    const JsonSnapshotNode *name =
+        json_snapshot_member(snapshot, root, 0, &key, &length);
+    TEST_ASSERT_EQUAL_STRING_LEN("name", key, length);
+    TEST_ASSERT_EQUAL_STRING("catalog",
+                             json_snapshot_string(snapshot, name, &length));
+
+    const JsonSnapshotNode *items =
+        json_snapshot_get(snapshot, root, "items", 5);
+    TEST_ASSERT_NOT_NULL(items);
+    const JsonSnapshotNode *item = json_snapshot_element(snapshot, items, 1);
+    const JsonSnapshotNode *id = json_snapshot_get(snapshot, item, "id", 2);
+    TEST_ASSERT_TRUE(id && id->type == JSON_NUMBER && id->number == 2);
+
+    const JsonSnapshotNode *flags =
+        json_snapshot_get(snapshot, root, "flags", 5);
+    TEST_ASSERT_TRUE(json_snapshot_element(snapshot, flags, 0)->boolean);
+    const JsonSnapshotNode *ratios =
+        json_snapshot_get(snapshot, root, "ratios", 6);
+    TEST_ASSERT_TRUE(json_snapshot_element(snapshot, ratios, 0)->number == 0.5);
+    TEST_ASSERT_EQUAL(JSON_NULL,
+                      json_snapshot_get(snapshot, root, "none", 4)->type);
+    TEST_ASSERT_TRUE(json_snapshot_get(snapshot, root, "k3", 2)->number == 3);
+    TEST_ASSERT_NULL(json_snapshot_get(snapshot, root, "k", 1));
+    json_snapshot_close(snapshot);
+
+    // A truncated file must be rejected rather than read out of bounds.
+    TEST_ASSERT_EQUAL_INT(0, truncate(path, 100));
+    TEST_ASSERT_NULL(json_document_load(path, NULL, JSON_SNAPSHOT_VERIFY));
+    unlink(path);
+}
+
+void test_document_cache(void) {
+    const char *first = "{\"id\":1,\"name\":\"first\"}";
+    const char *second = "{\"id\":2,\"name\":\"second\"}";
+    JsonCacheStats stats;
+
+    JsonCache *cache = json_cache_create(SIZE_MAX, NULL);
+    TEST_ASSERT_NOT_NULL(cache);
+    JsonCacheHandle *a = json_cache_parse(cache, first, strlen(first));
+    JsonCacheHandle *b = json_cache_parse(cache, first, strlen(first));
+    TEST_ASSERT_TRUE_MESSAGE(a == b, "Same input should share a document");
+    TEST_ASSERT_TRUE(json_cache_root(a) == json_cache_root(b));
+    json_cache_stats(cache, &stats);
+    TEST_ASSERT_EQUAL(1, stats.hits);
+    TEST_ASSERT_EQUAL(1, stats.misses);
+    TEST_ASSERT_EQUAL(1, stats.entries);
+    size_t document_bytes = stats.bytes;
+    json_cache_release(b);
+
+    // Hits compare against the cache's own copy of the input, so a buffer
+    // reused for other bytes of the same length is not mistaken for it.
+    char buffer[64];
+    strcpy(buffer, first);
+    b = json_cache_parse(cache, buffer, strlen(buffer));
+    TEST_ASSERT_TRUE(a == b);
+    json_cache_release(b);
+    buffer[6] = '7';
+    b = json_cache_parse(cache, buffer, strlen(buffer));
+    TEST_ASSERT_FALSE(a == b);
+    TEST_ASSERT_EQUAL_FLOAT(
+        7, json_object_get(json_cache_root(b), "id")->number);
+    json_cache_release(b);
+
+    // The handle outlives the cache.
+    json_cache_destroy(cache);
+    TEST_ASSERT_EQUAL_FLOAT(
+        1, json_object_get(json_cache_root(a), "id")->number);
+    json_cache_release(a);
+
+    // Room for one document only: the second evicts the first, which stays
+    // readable through its handle.
+    cache = json_cache_create(document_bytes + document_bytes / 2, NULL);
+    a = json_cache_parse(cache, first, strlen(first));
+    b = json_cache_parse(cache, second, strlen(second));
+    TEST_ASSERT_NOT_NULL(b);
+    json_cache_stats(cache, &stats);
+    TEST_ASSERT_EQUAL(1, stats.evictions);
+    TEST_ASSERT_EQUAL(1, stats.entries);
+    size_t length;
+    const JsonValue *name = json_object_get(json_cache_root(a), "name");
+    TEST_ASSERT_EQUAL_STRING_LEN("first", json_string(name, &length), length);
+    json_cache_release(a);
+
+    JsonCacheHandle *c = json_cache_parse(cache, second, strlen(second));
+    TEST_ASSERT_TRUE(b == c);
+    TEST_ASSERT_NULL(json_cache_parse(cache, "{", 1));
+    json_cache_release(b);
+    json_cache_release(c);
+    json_cache_destroy(cache);
+}
+
+void test_edit_document(void) {
+    const char *input = "{\"id\":1,\"tags\":[\"a\",\"b\"],"
+                        "\"scores\":[1,2,3],\"flags\":[true,false]}";
+    JsonObject *result = json_parse(input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+    JsonValue *root = (JsonValue *)result;
+
+    JsonValue value;
+    for (int i = 0; i < 10; i++) {
+        char key[8];
+        snprintf(key, sizeof(key), "k%d", i);
+        value = (JsonValue){.number = i, .type = JSON_NUMBER};
+        TEST_ASSERT_TRUE(json_object_set(root, key, strlen(key), &value, NULL));
+    }
+    TEST_ASSERT_EQUAL(14, result->size);
+    TEST_ASSERT_TRUE(root->flags & JSON_VALUE_GROWABLE);
+    assert_json_number(json_object_get(result, "k9"), 9);
+
+    TEST_ASSERT_TRUE(json_value_init_string(
+        &value, "a string too long to be stored inline", 37, NULL));
+    TEST_ASSERT_TRUE(json_object_set(root, "id", 2, &value, NULL));
+    TEST_ASSERT_EQUAL(14, result->size);
+    assert_json_string(json_object_get(result, "id"),
+                       "a string too long to be stored inline");
+    TEST_ASSERT_TRUE(json_object_remove(root, "tags", 4, NULL));
+    TEST_ASSERT_FALSE(json_object_remove(root, "tags", 4, NULL));
+    TEST_ASSERT_EQUAL_STRING("scores", result->members[1].key);
+
+    JsonValue *scores = json_object_get(result, "scores");
+    value = (JsonValue){.number = 0, .type = JSON_NUMBER};
+    TEST_ASSERT_TRUE(json_array_insert(scores, 0, &value, NULL));
+    TEST_ASSERT_TRUE(json_array_erase(scores, 2, NULL));
+    TEST_ASSERT_EQUAL_MESSAGE(JSON_ARRAY_NUMBERS, scores->array.kind,
+                              "Numbers should stay unboxed");
+    TEST_ASSERT_EQUAL_FLOAT(3, json_array_numbers(&scores->array)[2]);
+    value = (JsonValue){.type = JSON_NULL};
+    TEST_ASSERT_TRUE(json_array_push(scores, &value, NULL));
+    TEST_ASSERT_EQUAL(JSON_ARRAY_VALUES, scores->array.kind);
+    TEST_ASSERT_EQUAL(4, json_array_size(&scores->array));
+    TEST_ASSERT_EQUAL(JSON_NULL, json_array_get(&scores->array, 3).type);
+    TEST_ASSERT_FALSE(json_array_erase(scores, 4, NULL));
+
+    JsonValue *flags = json_object_get(result, "flags");
+    TEST_ASSERT_TRUE(json_array_erase(flags, 0, NULL));
+    TEST_ASSERT_TRUE(json_value_init_string(&value, "x", 1, NULL));
+    TEST_ASSERT_TRUE(json_array_set(flags, 0, &value, NULL));
+    assert_json_string(&flags->array.values[0], "x");
+
+    free_json_value(root);
+}
+
+void test_edit_interned_document(void) {
+    const char *input = "{\"rows\":[{\"id\":1,\"name\":\"a\"},"
+                        "{\"id\":2,\"name\":\"b\"}]}";
+    JsonParser *parser = json_parser_create(NULL);
+    JsonObject *result = json_parser_parse(parser, input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(result, "Parse result is NULL");
+    const JsonAllocator *allocator = json_parser_allocator(parser);
+
+    JsonValue *first = &result->members[0].value.array.values[0];
+    JsonValue *second = &result->members[0].value.array.values[1];
+    TEST_ASSERT_TRUE(json_object_remove(first, "id", 2, allocator));
+    TEST_ASSERT_NULL(first->object.shape);
+    TEST_ASSERT_FALSE(first->flags & JSON_VALUE_INTERNED_KEYS);
+    TEST_ASSERT_EQUAL(1, first->object.size);
+
+    // The sibling sharing the edited object's shape is unaffected.
+    TEST_ASSERT_NOT_NULL(second->object.shape);
+    TEST_ASSERT_EQUAL_STRING("id", second->object.shape[0].key);
+    TEST_ASSERT_EQUAL_STRING("id", second->object.members[0].key);
+
+    json_parser_destroy(parser);
+}
+
+void test_json_patch(void) {
+    const char *ops =
+        "[{\"op\":\"add\",\"path\":\"/user/tags/-\",\"value\":\"new\"},"
+        "{\"op\":\"replace\",\"path\":\"/user/name\",\"value\":\"bo\"},"
+        "{\"op\":\"remove\",\"path\":\"/user/tags/0\"},"
+        "{\"op\":\"copy\",\"from\":\"/user/name\",\"path\":\"/a~1b\"},"
+        "{\"op\":\"move\",\"from\":\"/user/age\",\"path\":\"/age\"},"
+        "{\"op\":\"test\",\"path\":\"/user/tags\",\"value\":[\"y\",\"new\"]},"
+        "{\"op\":\"add\",\"path\":\"/scores/1\",\"value\":5}]";
+    JsonValue *operations = json_parse_value(ops, strlen(ops));
+    TEST_ASSERT_NOT_NULL_MESSAGE(operations, "Patch parse failed");
+    JsonError error;
+    JsonPatch *patch = json_patch_compile(operations, NULL, &error);
+    free_json_value(operations);
+    TEST_ASSERT_NOT_NULL_MESSAGE(patch, error.message);
+
+    // One compiled patch applies to several documents.
+    for (int i = 0; i < 2; i++) {
+        const char *input = "{\"user\":{\"name\":\"al\",\"age\":30,"
+                            "\"tags\":[\"x\",\"y\"]},\"scores\":[1,2]}";
+        JsonObject *result = json_parse(input, strlen(input));
+        TEST_ASSERT_TRUE_MESSAGE(
+            json_patch_apply(patch, (JsonValue *)result, NULL, &error),
+            error.message);
+
+        JsonValue *user = json_object_get(result, "user");
+        assert_json_string(json_object_get(&user->object, "name"), "bo");
+        TEST_ASSERT_NULL(json_object_get(&user->object, "age"));
+        assert_json_number(json_object_get(result, "age"), 30);
+        assert_json_string(json_object_get(result, "a/b"), "bo");
+        JsonValue *scores = json_object_get(result, "scores");
+        TEST_ASSERT_EQUAL(3, json_array_size(&scores->array));
+        TEST_ASSERT_EQUAL_FLOAT(5, json_array_numbers(&scores->array)[1]);
+        free_json_value((JsonValue *)result);
+    }
+    json_patch_free(patch);
+
+    ops = "[{\"op\":\"test\",\"path\":\"/n\",\"value\":2}]";
+    operations = json_parse_value(ops, strlen(ops));
+    patch = json_patch_compile(operations, NULL, &error);
+    free_json_value(operations);
+    JsonObject *result = json_parse("{\"n\":1}", 7);
+    TEST_ASSERT_FALSE(
+        json_patch_apply(patch, (JsonValue *)result, NULL, &error));
+    TEST_ASSERT_EQUAL_STRING("/n", error.key);
+    free_json_value((JsonValue *)result);
+    json_patch_free(patch);
+
+    // A test between two edits must not leave the first edit's parent
+    // cached for the second.
+    ops = "[{\"op\":\"add\",\"path\":\"/a/x2\",\"value\":3},"
+          "{\"op\":\"test\",\"path\":\"/b/y\",\"value\":2},"
+          "{\"op\":\"add\",\"path\":\"/b/z\",\"value\":4}]";
+    operations = json_parse_value(ops, strlen(ops));
+    patch = json_patch_compile(operations, NULL, &error);
+    free_json_value(operations);
+    const char *nested = "{\"a\":{\"x\":1},\"b\":{\"y\":2}}";
+    result = json_parse(nested, strlen(nested));
+    TEST_ASSERT_TRUE_MESSAGE(
+        json_patch_apply(patch, (JsonValue *)result, NULL, &error),
+        error.message);
+    JsonValue *a = json_object_get(result, "a");
+    JsonValue *b = json_object_get(result, "b");
+    TEST_ASSERT_NULL(json_object_get(&a->object, "z"));
+    assert_json_number(json_object_get(&b->object, "z"), 4);
+    assert_json_number(json_object_get(&a->object, "x2"), 3);
+    free_json_value((JsonValue *)result);
+    json_patch_free(patch);
+
+    ops = "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b\"}]";
+    operations = json_parse_value(ops, strlen(ops));
+    TEST_ASSERT_NULL(json_patch_compile(operations, NULL, &error));
+    free_json_value(operations);
+}
+
+void test_json_merge_patch(void) {
+    const char *input =
+        "{\"title\":\"Goodbye!\",\"author\":{\"givenName\":\"John\","
+        "\"familyName\":\"Doe\"},\"tags\":[\"example\",\"sample\"]}";
+    const char *merge =
+        "{\"title\":\"Hello!\",\"phoneNumber\":\"+01-123-456-7890\","
+        "\"author\":{\"familyName\":null},\"tags\":[\"example\"],"
+        "\"meta\":{\"a\":null,\"b\":1}}";
+    JsonObject *result = json_parse(input, strlen(input));
+    JsonObject *patch = json_parse(merge, strlen(merge));
+    TEST_ASSERT_TRUE(json_merge_patch_apply((JsonValue *)result,
+                                            (JsonValue *)patch, NULL));
+
+    assert_json_string(json_object_get(result, "title"), "Hello!");
+    assert_json_string(json_object_get(result, "phoneNumber"),
+                       "+01-123-456-7890");
+    JsonValue *author = json_object_get(result, "author");
+    TEST_ASSERT_EQUAL(1, author->object.size);
+    TEST_ASSERT_NULL(json_object_get(&author->object, "familyName"));
+    TEST_ASSERT_EQUAL(1, json_array_size(&json_object_get(result, "tags")
+                                              ->array));
+    JsonValue *meta = json_object_get(result, "meta");
+    TEST_ASSERT_EQUAL(1, meta->object.size);
+    assert_json_number(json_object_get(&meta->object, "b"), 1);
+
+    free_json_value((JsonValue *)patch);
+    free_json_value((JsonValue *)result);
+}
+
+void test_json_diff(void) {
+    const char *before =
+        "{\"name\":\"a\",\"list\":[1,2,3,4,5],\"gone\":true,"
+        "\"items\":[{\"id\":1},{\"id\":2},{\"id\":3}],\"k~/\":0}";
+    const char *after =
+        "{\"name\":\"b\",\"list\":[1,2,9,3,4,5],\"added\":null,"
+        "\"items\":[{\"id\":1},{\"id\":3,\"x\":1}],\"k~/\":1}";
+    JsonObject *a = json_parse(before, strlen(before));
+    JsonObject *b = json_parse(after, strlen(after));
+
+    JsonValue *diff = json_diff((JsonValue *)a, (JsonValue *)b, NULL);
+    TEST_ASSERT_NOT_NULL_MESSAGE(diff, "Diff failed");
+    TEST_ASSERT_EQUAL(JSON_ARRAY, diff->type);
+    TEST_ASSERT_EQUAL_MESSAGE(7, diff->array.size,
+                              "Diff should be minimal");
+
+    JsonValue op = json_array_get(&diff->array, 2);
+    assert_json_string(json_object_get(&op.object, "op"), "add");
+    assert_json_string(json_object_get(&op.object, "path"), "/list/2");
+    op = json_array_get(&diff->array, 5);
+    assert_json_string(json_object_get(&op.object, "path"), "/items/1/x");
+    op = json_array_get(&diff->array, 6);
+    assert_json_string(json_object_get(&op.object, "path"), "/k~0~1");
+
+    // Applying the diff to a turns it into b.
+    JsonError error;
+    JsonPatch *patch = json_patch_compile(diff, NULL, &error);
+    TEST_ASSERT_NOT_NULL_MESSAGE(patch, error.message);
+    TEST_ASSERT_TRUE_MESSAGE(
+        json_patch_apply(patch, (JsonValue *)a, NULL, &error), error.message);
+    json_patch_free(patch);
+    free_json_value(diff);
+
+    diff = json_diff((JsonValue *)a, (JsonValue *)b, NULL);
+    TEST_ASSERT_EQUAL(0, diff->array.size);
+    free_json_value(diff);
+    free_json_value((JsonValue *)a);
+    free_json_value((JsonValue *)b);
+
+    // Different roots are replaced at the empty path.
+    JsonValue *one = json_parse_value("1", 1);
+    JsonValue *two = json_parse_value("2", 1);
+    diff = json_diff(one, two, NULL);
+    TEST_ASSERT_EQUAL(1, diff->array.size);
+    op = json_array_get(&diff->array, 0);
+    assert_json_string(json_object_get(&op.object, "op"), "replace");
+    assert_json_string(json_object_get(&op.object, "path"), "");
+    free_json_value(diff);
+    free_json_value(one);
+    free_json_value(two);
+}
+
+void test_json_hash_equal(void) {
+    const char *first = "{\"a\":[1,2,3],\"b\":{\"x\":null,\"y\":-0}}";
+    const char *second = "{\"b\":{\"y\":0,\"x\":null},\"a\":[1,2,3]}";
+    const char *third = "{\"a\":[1,3,2],\"b\":{\"x\":null,\"y\":0}}";
+    JsonObject *a = json_parse(first, strlen(first));
+    JsonObject *b = json_parse(second, strlen(second));
+    JsonObject *c = json_parse(third, strlen(third));
+
+    // Member order and -0 do not matter; element order does.
+    TEST_ASSERT_TRUE(json_equal((JsonValue *)a, (JsonValue *)b));
+    TEST_ASSERT_EQUAL_UINT64(json_hash((JsonValue *)a),
+                             json_hash((JsonValue *)b));
+    TEST_ASSERT_FALSE(json_equal((JsonValue *)a, (JsonValue *)c));
+    TEST_ASSERT_NOT_EQUAL(json_hash((JsonValue *)a),
+                          json_hash((JsonValue *)c));
+
+    // A typed number array matches the same numbers boxed.
+    const JsonValue *numbers = json_object_get(a, "a");
+    TEST_ASSERT_EQUAL(JSON_ARRAY_NUMBERS, numbers->array.kind);
+    JsonValue elements[3] = {
+        {.type = JSON_NUMBER, .number = 1},
+        {.type = JSON_NUMBER, .number = 2},
+        {.type = JSON_NUMBER, .number = 3},
+    };
+    JsonValue boxed = {.type = JSON_ARRAY,
+                       .array = {.values = elements, .size = 3}};
+    TEST_ASSERT_TRUE(json_equal(numbers, &boxed));
+    TEST_ASSERT_EQUAL_UINT64(json_hash(numbers), json_hash(&boxed));
+
+    JsonHashCache cache;
+    json_hash_cache_init(&cache, NULL);
+    TEST_ASSERT_TRUE(json_equal_ex((JsonValue *)a, (JsonValue *)b, &cache));
+    TEST_ASSERT_FALSE(json_equal_ex((JsonValue *)a, (JsonValue *)c, &cache));
+    TEST_ASSERT_EQUAL_UINT64(json_hash((JsonValue *)a),
+                             json_hash_ex((JsonValue *)a, &cache));
+    TEST_ASSERT_TRUE(cache.count > 0);
+    json_hash_cache_clear(&cache);
+    TEST_ASSERT_EQUAL(0, cache.count);
+
+    // Duplicate keys count as separate members, in either direction.
+    const char *twice = "{\"a\":1,\"a\":1}";
+    const char *other = "{\"a\":1,\"b\":2}";
+    const char *swapped = "{\"a\":2,\"a\":1}";
+    JsonObject *d = json_parse(twice, strlen(twice));
+    JsonObject *e = json_parse(other, strlen(other));
+    JsonObject *f = json_parse(swapped, strlen(swapped));
+    TEST_ASSERT_FALSE(json_equal((JsonValue *)d, (JsonValue *)e));
+    TEST_ASSERT_FALSE(json_equal((JsonValue *)e, (JsonValue *)d));
+    TEST_ASSERT_FALSE(json_equal_ex((JsonValue *)e, (JsonValue *)d, &cache));
+    TEST_ASSERT_FALSE(json_equal((JsonValue *)d, (JsonValue *)f));
+    const char *reordered = "{\"a\":1,\"a\":2}";
+    JsonObject *g = json_parse(reordered, strlen(reordered));
+    TEST_ASSERT_TRUE(json_equal((JsonValue *)f, (JsonValue *)g));
+    TEST_ASSERT_EQUAL_UINT64(json_hash((JsonValue *)f),
+                             json_hash((JsonValue *)g));
+    free_json_value((JsonValue *)d);
+    free_json_value((JsonValue *)e);
+    free_json_value((JsonValue *)f);
+    free_json_value((JsonValue *)g);
+    json_hash_cache_destroy(&cache);
+
+    free_json_value((JsonValue *)a);
+    free_json_value((JsonValue *)b);
+    free_json_value((JsonValue *)c);
+}
+
+void test_json_clone(void) {
+    const char *input =
+        "{\"shared\":{\"title\":\"a string too long to store inline\","
+        "\"scores\":[1,2,3],\"flags\":[true,false],"
+        "\"rows\":[{\"id\":1},{\"id\":2}],\"empty\":[]}}";
+    JsonObject *document = json_parse(input, strlen(input));
+    TEST_ASSERT_NOT_NULL_MESSAGE(document, "Parse result is NULL");
+    const JsonValue *shared = json_object_get(document, "shared");
+
+    CountingPool pool = {0};
+    JsonAllocator allocator = {
+        .alloc = counting_alloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+        .ctx = &pool,
+    };
+    JsonValue clone;
+    TEST_ASSERT_TRUE(json_clone(&clone, shared, &allocator));
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(1, pool.calls,
+                                     "Clone should be one allocation");
+    TEST_ASSERT_TRUE(json_equal(&clone, shared));
+    TEST_ASSERT_TRUE(clone.flags & JSON_VALUE_CLONE);
+
+    // Editing inside the clone gives the edited container its own storage,
+    // which releasing the clone still frees.
+    JsonValue *rows = json_object_get(&clone.object, "rows");
+    JsonValue *row = &rows->array.values[1];
+    JsonValue name;
+    TEST_ASSERT_TRUE(json_value_init_string(&name, "b", 1, &allocator));
+    TEST_ASSERT_TRUE(json_object_set(row, "name", 4, &name, &allocator));
+    TEST_ASSERT_TRUE(json_object_remove(row, "id", 2, &allocator));
+    TEST_ASSERT_TRUE(json_array_erase(rows, 0, &allocator));
+    TEST_ASSERT_EQUAL(1, rows->array.size);
+    TEST_ASSERT_FALSE(json_equal(&clone, shared));
+    JsonValue *empty = json_object_get(&clone.object, "empty");
+    TEST_ASSERT_TRUE(json_array_push(empty, &name, &allocator));
+
+    // So does moving the clone into another document.
+    JsonValue recipient = {.type = JSON_OBJECT};
+    TEST_ASSERT_TRUE(
+        json_object_set(&recipient, "shared", 6, &clone, &allocator));
+    TEST_ASSERT_TRUE(json_clone(&clone, shared, &allocator));
+    TEST_ASSERT_TRUE(json_object_remove(&clone, "flags", 5, &allocator));
+    TEST_ASSERT_FALSE(clone.flags & JSON_VALUE_CLONE);
+    TEST_ASSERT_TRUE(
+        json_object_set(&recipient, "copy", 4, &clone, &allocator));
+
+    json_value_release(&recipient, &allocator);
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(0, pool.live,
+                                     "Clone leaked or double freed");
+    free_json_value((JsonValue *)document);
+}
+
+void test_json_schema(void) {
+    const char *text =
+        "{\"type\":\"object\",\"required\":[\"id\",\"tags\"],"
+        "\"additionalProperties\":false,\"properties\":{"
+        "\"id\":{\"type\":\"integer\",\"minimum\":1},"
+        "\"name\":{\"type\":\"string\",\"maxLength\":3},"
+        "\"kind\":{\"enum\":[\"a\",\"b\",null]},"
+        "\"tags\":{\"type\":\"array\",\"maxItems\":2,"
+        "\"items\":{\"type\":\"string\"}},"
+        "\"extra\":true}}";
+    JsonValue *source = json_parse_value(text, strlen(text));
+    JsonError error;
+    JsonSchema *schema = json_schema_compile(source, NULL, &error);
+    TEST_ASSERT_NOT_NULL_MESSAGE(schema, error.message);
+
+    const char *valid =
+        "{\"id\":2,\"name\":\"\\u00e9t\\u00e9\",\"kind\":null,"
+        "\"tags\":[\"x\"],\"extra\":{\"any\":[1,{\"deep\":[]}]}}";
+    TEST_ASSERT_TRUE_MESSAGE(
+        json_schema_validate(schema, valid, strlen(valid), &error),
+        error.message);
+
+    const struct {
+            const char *input;
+            const char *key;
+    } invalid[] = {
+        {"{\"id\":2.5,\"tags\":[]}", "id"},
+        {"{\"id\":0,\"tags\":[]}", "id"},
+        {"{\"id\":1,\"name\":\"long\",\"tags\":[]}", "name"},
+        {"{\"id\":1,\"kind\":\"c\",\"tags\":[]}", "kind"},
+        {"{\"id\":1,\"tags\":[\"a\",1]}", "tags"},
+        {"{\"id\":1,\"tags\":[\"a\",\"b\",\"c\"]}", "tags"},
+        {"{\"id\":1}", "tags"},
+        {"{\"id\":1,\"tags\":[],\"other\":1}", NULL},
+        {"{\"id\":1,\"tags\":[],\"extra\":[1,}", "extra"},
+        {"{\"id\":1,\"tags\":[],\"extra\":[1e400]}", "extra"},
+        {"[]", NULL},
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(*invalid); i++) {
+        const char *input = invalid[i].input;
+        TEST_ASSERT_FALSE_MESSAGE(
+            json_schema_validate(schema, input, strlen(input), &error), input);
+        TEST_ASSERT_NOT_NULL(strstr(error.message, "line 1, column"));
+        if (invalid[i].key) {
+            TEST_ASSERT_EQUAL_STRING(invalid[i].key, error.key);
+        } else {
+            TEST_ASSERT_NULL(error.key);
+        }
+    }
+    json_schema_free(schema);
+    free_json_value(source);
+
+    // Numbers are range checked without any other number constraint.
+    const char *numbers =
+        "{\"type\":\"array\",\"items\":{\"type\":\"number\"}}";
+    source = json_parse_value(numbers, strlen(numbers));
+    schema = json_schema_compile(source, NULL, &error);
+    TEST_ASSERT_NOT_NULL_MESSAGE(schema, error.message);
+    TEST_ASSERT_TRUE(json_schema_validate(schema, "[1,1e300]", 9, &error));
+    TEST_ASSERT_FALSE(json_schema_validate(schema, "[1,1e400]", 9, &error));
+    TEST_ASSERT_NOT_NULL(strstr(error.message, "Number out of range"));
+    json_schema_free(schema);
+    free_json_value(source);
+
+    // An empty enum allows nothing, even next to a type.
+    const char *empty = "{\"properties\":{\"a\":{\"enum\":[],"
+                        "\"type\":\"string\"},\"b\":{\"enum\":[]}}}";
+    source = json_parse_value(empty, strlen(empty));
+    schema = json_schema_compile(source, NULL, &error);
+    TEST_ASSERT_NOT_NULL_MESSAGE(schema, error.message);
+    TEST_ASSERT_TRUE(json_schema_validate(schema, "{}", 2, &error));
+    TEST_ASSERT_FALSE(json_schema_validate(schema, "{\"a\":\"x\"}", 9, &error));
+    TEST_ASSERT_EQUAL_STRING("a", error.key);
+    TEST_ASSERT_FALSE(json_schema_validate(schema, "{\"b\":null}", 10, &error));
+    TEST_ASSERT_EQUAL_STRING("b", error.key);
+    json_schema_free(schema);
+    free_json_value(source);
+
+    // Unsupported keywords fail the compile instead of being ignored.
+    const char *pattern = "{\"properties\":{\"a\":{\"pattern\":\"x\"}}}";
+    source = json_parse_value(pattern, strlen(pattern));
+    TEST_ASSERT_NULL(json_schema_compile(source, NULL, &error));
+    TEST_ASSERT_EQUAL_STRING("a", error.key);
+    free_json_value(source);
+}
+
+void test_json_validate(void) {
+    JsonSyntaxError error;
+    const char *valid = "{\"a\":[1,-2.5e3,true,null,\"\\u00e9\\n\"],\"b\":{}}";
+    TEST_ASSERT_TRUE_MESSAGE(json_validate(valid, strlen(valid), &error),
+                             error.message);
+    TEST_ASSERT_TRUE(json_validate(" 42 ", 4, &error));
+
+    const char *invalid = "{\"a\":[1,2],\n  \"b\":[1 2]}";
+    TEST_ASSERT_FALSE(json_validate(invalid, strlen(invalid), &error));
+    TEST_ASSERT_EQUAL_size_t(21, error.offset);
+    TEST_ASSERT_EQUAL_size_t(2, error.line);
+    TEST_ASSERT_EQUAL_size_t(10, error.column);
+    TEST_ASSERT_EQUAL_STRING("Expected ',' or ']'", error.message);
+
+    const char *escape = "[\"ok\",\"bad \\x\"]";
+    TEST_ASSERT_FALSE(json_validate(escape, strlen(escape), &error));
+    TEST_ASSERT_EQUAL_STRING("Invalid token", error.message);
+    TEST_ASSERT_EQUAL_size_t(12, error.offset);
+    TEST_ASSERT_FALSE(json_validate("1 @", 3, &error));
+    TEST_ASSERT_EQUAL_STRING("Invalid token", error.message);
+    TEST_ASSERT_EQUAL_size_t(2, error.offset);
+
+    const char *latin1 = "[\"caf\xe9\"]";
+    TEST_ASSERT_TRUE(json_validate(latin1, strlen(latin1), &error));
+    JsonParseOptions options = {.validate_utf8 = true};
+    TEST_ASSERT_FALSE(json_validate_ex(latin1, strlen(latin1), &options,
+                                       &error));
+
+    // Validation accepts exactly what parsing does.
+    const char *inputs[] = {
+        "", "[", "[]]", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "[1,]",
+        "[,1]", "{,}", "01", "1.", "-", "tru", "\"\\u12\"", "[{}]",
+        "{\"a\":{\"b\":[[],{}]}}", "\"x\" \"y\"", "null",
+        "-1e670", "1234567890e23467890", "[1e400]", "[1e-400,2]", "1e308",
+        "[123456789012345678901234567890]", "2.2250738585072014e-308",
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+        JsonValue *parsed = json_parse_value(inputs[i], strlen(inputs[i]));
+        TEST_ASSERT_EQUAL_MESSAGE(
+            parsed != NULL, json_validate(inputs[i], strlen(inputs[i]), NULL),
+            inputs[i]);
+        free_json_value(parsed);
+    }
+
+    size_t depth = JSON_DEFAULT_MAX_DEPTH + 1;
+    char *deep = malloc(depth * 2);
+    memset(deep, '[', depth);
+    memset(deep + depth, ']', depth);
+    TEST_ASSERT_TRUE(json_validate(deep + 1, (depth - 1) * 2, NULL));
+    TEST_ASSERT_FALSE(json_validate(deep, depth * 2, &error));
+    TEST_ASSERT_EQUAL_STRING("Nesting too deep", error.message);
+    options = (JsonParseOptions){.max_depth = depth};
+    TEST_ASSERT_TRUE(json_validate_ex(deep, depth * 2, &options, NULL));
+    options.max_depth = 2;
+    TEST_ASSERT_FALSE(json_validate_ex("[[[]]]", 6, &options, &error));
+    TEST_ASSERT_EQUAL_size_t(2, error.offset);
+    free(deep);
+
+    // A long number that ends the input is still range checked.
+    char number[601];
+    memset(number, '0', sizeof(number) - 1);
+    number[0] = '1';
+    number[sizeof(number) - 1] = '\0';
+    TEST_ASSERT_NULL(json_parse_value(number, strlen(number)));
+    TEST_ASSERT_FALSE(json_validate(number, strlen(number), &error));
+    TEST_ASSERT_EQUAL_STRING("Number out of range", error.message);
+    number[1] = '.';
+    TEST_ASSERT_TRUE(json_validate(number, strlen(number), NULL));
+}
+
+// Feeds input to parser in pieces of at most piece bytes, each call limited
+// to budget tokens, and returns the document or NULL.
+static JsonValue *push_in_pieces(JsonPushParser *parser, const char *input,
+                                 size_t piece, size_t budget,
+                                 size_t *suspensions) {
+    size_t length = strlen(input);
+    size_t pos = 0;
+    while (pos < length) {
+        size_t size = length - pos < piece ? length - pos : piece;
+        size_t consumed;
+        JsonPushStatus status =
+            json_push_parser_feed(parser, input + pos, size, budget, &consumed);
+        if (status == JSON_PUSH_ERROR) {
+            return NULL;
+        }
+        TEST_ASSERT_TRUE(status == JSON_PUSH_NEED_MORE ||
+                         status == JSON_PUSH_SUSPENDED);
+        TEST_ASSERT_TRUE(status == JSON_PUSH_SUSPENDED || consumed == size);
+        *suspensions += status == JSON_PUSH_SUSPENDED;
+        pos += consumed;
+    }
+    if (json_push_parser_finish(parser) != JSON_PUSH_DONE) {
+        return NULL;
+    }
+    return json_push_parser_take(parser);
+}
+
+void test_json_push_parser(void) {
+    JsonPushParser *parser = json_push_parser_create(NULL);
+    TEST_ASSERT_NOT_NULL(parser);
+
+    const char *document =
+        "{\"id\": 12345, \"name\": \"a \\\"quoted\\\" name, long enough\",\n"
+        " \"scores\": [1.5, -2e3, 0], \"flags\": [true, false, true],\n"
+        " \"items\": [{\"k\": null}, {\"k\": \"\\u00e9\"}, [], {}],\n"
+        " \"nested\": {\"deeper\": {\"deepest\": [[[\"x\"]]]}}}";
+    JsonValue *expected = json_parse_value(document, strlen(document));
+    TEST_ASSERT_NOT_NULL(expected);
+
+    // Every split point, with and without a work budget.
+    for (size_t piece = 1; piece <= 17; piece++) {
+        size_t suspensions = 0;
+        JsonValue *value =
+            push_in_pieces(parser, document, piece, piece % 3, &suspensions);
+        TEST_ASSERT_NOT_NULL(value);
+        TEST_ASSERT_TRUE(json_equal(expected, value));
+        TEST_ASSERT_TRUE(piece % 3 != 0 || suspensions == 0);
+        free_json_value(value);
+    }
+
+    // The whole body at once, four tokens per call.
+    size_t suspensions = 0;
+    JsonValue *value = push_in_pieces(parser, document, strlen(document), 4,
+                                      &suspensions);
+    TEST_ASSERT_TRUE(json_equal(expected, value));
+    TEST_ASSERT_EQUAL_size_t(17, suspensions);
+    free_json_value(value);
+    free_json_value(expected);
+
+    // A scalar at the top level only ends with the input.
+    size_t consumed;
+    TEST_ASSERT_EQUAL(JSON_PUSH_NEED_MORE,
+                      json_push_parser_feed(parser, " 12", 3, 0, &consumed));
+    TEST_ASSERT_EQUAL(JSON_PUSH_NEED_MORE,
+                      json_push_parser_feed(parser, "5e1 ", 4, 0, &consumed));
+    TEST_ASSERT_EQUAL(JSON_PUSH_DONE, json_push_parser_finish(parser));
+    JsonValue *number = json_push_parser_take(parser);
+    TEST_ASSERT_EQUAL_DOUBLE(1250, number->number);
+    free_json_value(number);
+
+    // Errors stick until reset and release the partial document.
+    TEST_ASSERT_EQUAL(JSON_PUSH_ERROR,
+                      json_push_parser_feed(parser, "[1, }", 5, 0, &consumed));
+    TEST_ASSERT_EQUAL(JSON_PUSH_ERROR,
+                      json_push_parser_feed(parser, "]", 1, 0, &consumed));
+    TEST_ASSERT_EQUAL(JSON_PUSH_ERROR, json_push_parser_finish(parser));
+    json_push_parser_reset(parser);
+
+    // Pushing accepts exactly what parsing does, wherever the input is cut.
+    const char *inputs[] = {
+        "", "[", "[]]", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "[1,]",
+        "[,1]", "01", "1.", "-", "tru", "truex", "\"\\u12\"", "\"open",
+        "\"x\" \"y\"", "null", "[1,2,3.5e-2]", "{\"a\":[true,1]}",
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+        JsonValue *parsed = json_parse_value(inputs[i], strlen(inputs[i]));
+        for (size_t piece = 1; piece <= 3; piece++) {
+            size_t suspensions = 0;
+            JsonValue *pushed =
+                push_in_pieces(parser, inputs[i], piece, 0, &suspensions);
+            TEST_ASSERT_EQUAL_MESSAGE(parsed != NULL, pushed != NULL,
+                                      inputs[i]);
+            TEST_ASSERT_TRUE(!parsed || json_equal(parsed, pushed));
+            free_json_value(pushed);
+            json_push_parser_reset(parser);
+        }
+        free_json_value(parsed);
+    }
+
+    size_t depth = JSON_DEFAULT_MAX_DEPTH + 1;
+    char *deep = malloc(depth * 2);
+    memset(deep, '[', depth);
+    memset(deep + depth, ']', depth);
+    TEST_ASSERT_EQUAL(JSON_PUSH_ERROR, json_push_parser_feed(parser, deep,
+                                                             depth * 2, 0,
+                                                             &consumed));
+    free(deep);
+
+    json_push_parser_destroy(parser);
+}
+
+// Hand-built values start zeroed: free_json_value reads flags (see
+// JsonValueFlags) and would otherwise skip or misdirect frees.
 void test_free_json_value_string(void) {
-    JsonValue *value = malloc(sizeof(JsonValue));
+    JsonValue *value = calloc(1, sizeof(JsonValue));
     value->type = JSON_STRING;
     value->string = strdup("test");
 
@@ -519,7 +1839,7 @@ void test_free_json_value_string(void) {
 }
 
 void test_free_json_value_number(void) {
-    JsonValue *value = malloc(sizeof(JsonValue));
+    JsonValue *value = calloc(1, sizeof(JsonValue));
     value->type = JSON_NUMBER;
     value->number = 123.45;
 
@@ -527,7 +1847,7 @@ void test_free_json_value_number(void) {
 }
 
 void test_free_json_value_bool(void) {
-    JsonValue *value = malloc(sizeof(JsonValue));
+    JsonValue *value = calloc(1, sizeof(JsonValue));
     value->type = JSON_BOOL;
     value->boolean = true;
 
@@ -535,7 +1855,7 @@ void test_free_json_value_bool(void) {
 }
 
 void test_free_json_value_null(void) {
-    JsonValue *value = malloc(sizeof(JsonValue));
+    JsonValue *value = calloc(1, sizeof(JsonValue));
     value->type = JSON_NULL;
     value->null = NULL;
 
@@ -543,33 +1863,29 @@ void test_free_json_value_null(void) {
 }
 
 void test_free_json_value_array(void) {
-    JsonValue *value = malloc(sizeof(JsonValue));
+    JsonValue *value = calloc(1, sizeof(JsonValue));
     value->type = JSON_ARRAY;
     value->array.size = 2;
-    value->array.values = malloc(sizeof(JsonValue *) * 2);
+    value->array.values = calloc(2, sizeof(JsonValue));
 
-    value->array.values[0] = malloc(sizeof(JsonValue));
-    value->array.values[0]->type = JSON_NUMBER;
-    value->array.values[0]->number = 1.0;
+    value->array.values[0].type = JSON_NUMBER;
+    value->array.values[0].number = 1.0;
 
-    value->array.values[1] = malloc(sizeof(JsonValue));
-    value->array.values[1]->type = JSON_NUMBER;
-    value->array.values[1]->number = 2.0;
+    value->array.values[1].type = JSON_STRING;
+    value->array.values[1].string = strdup("two");
 
     free_json_value(value);
 }
 
 void test_free_json_value_object(void) {
-    JsonValue *value = malloc(sizeof(JsonValue));
+    JsonValue *value = calloc(1, sizeof(JsonValue));
     value->type = JSON_OBJECT;
     value->object.size = 1;
-    value->object.keys = malloc(sizeof(char *));
-    value->object.values = malloc(sizeof(JsonValue *));
+    value->object.members = calloc(1, sizeof(JsonMember));
 
-    value->object.keys[0] = strdup("key");
-    value->object.values[0] = malloc(sizeof(JsonValue));
-    value->object.values[0]->type = JSON_STRING;
-    value->object.values[0]->string = strdup("value");
+    value->object.members[0].key = strdup("key");
+    value->object.members[0].value.type = JSON_STRING;
+    value->object.members[0].value.string = strdup("value");
 
     free_json_value(value);
 }
@@ -609,12 +1925,43 @@ int main(void) {
     RUN_TEST(test_parse_invalid_unterminated_array);
     RUN_TEST(test_parse_invalid_trailing_comma_in_array);
     RUN_TEST(test_parse_invalid_consecutive_commas_in_array);
+    RUN_TEST(test_parse_invalid_missing_comma);
+    RUN_TEST(test_parse_max_depth);
     RUN_TEST(test_parse_invalid_extra_data_after_object);
     RUN_TEST(test_parse_invalid_unexpected_token_in_array);
 
     RUN_TEST(test_parse_memory_allocation_string);
     RUN_TEST(test_parse_memory_allocation_large_object);
 
+    RUN_TEST(test_parse_stats);
+    RUN_TEST(test_parse_with_custom_allocator);
+    RUN_TEST(test_parse_invalid_with_custom_allocator);
+    RUN_TEST(test_parser_reuse_reaches_zero_allocations);
+    RUN_TEST(test_parse_validate_utf8_option);
+    RUN_TEST(test_parse_borrowed_strings);
+    RUN_TEST(test_parse_string_longer_than_compact_token);
+    RUN_TEST(test_parser_interns_keys);
+    RUN_TEST(test_parser_shares_record_shapes);
+    RUN_TEST(test_parse_typed_arrays);
+    RUN_TEST(test_number_fast_path_matches_strtod);
+    RUN_TEST(test_parse_short_strings_inline);
+    RUN_TEST(test_container_iteration);
+    RUN_TEST(test_parse_file_borrows_from_mapping);
+    RUN_TEST(test_document_snapshot_round_trip);
+    RUN_TEST(test_document_cache);
+    RUN_TEST(test_edit_document);
+    RUN_TEST(test_edit_interned_document);
+    RUN_TEST(test_json_patch);
+    RUN_TEST(test_json_merge_patch);
+    RUN_TEST(test_json_diff);
+    RUN_TEST(test_json_hash_equal);
+    RUN_TEST(test_json_clone);
+    RUN_TEST(test_json_schema);
+    RUN_TEST(test_json_validate);
+    RUN_TEST(test_json_push_parser);
+    RUN_TEST(test_json_to_columns);
+    RUN_TEST(test_json_to_columns_type_mismatch);
+
     RUN_TEST(test_free_json_value_string);
     RUN_TEST(test_free_json_value_number);
     RUN_TEST(test_free_json_value_bool);
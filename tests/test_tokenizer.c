@@ -2,6 +2,7 @@
 #include "./Unity/src/unity.h"
 #include "./Unity/src/unity_internals.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 void setUp(void) {}
@@ -590,6 +591,175 @@ void test_nested_structure_position_tracking(void) {
     }
 }
 
+void test_compact_token_size(void) {
+    TEST_ASSERT_EQUAL_size_t(8, sizeof(JsonCompactToken));
+}
+
+void test_batch_matches_single_token_api(void) {
+    const char *input =
+        "{\"key\": [1, -2.5e3, true, false, null], \"s\": \"x\"}";
+    JsonTokenizerCtx single = json_tokenizer_init(input, strlen(input));
+    JsonTokenizerCtx batch = json_tokenizer_init(input, strlen(input));
+
+    JsonCompactToken tokens[4];
+    size_t base = batch.pos;
+    size_t count = 0;
+    size_t index = 0;
+    JsonToken expected;
+
+    do {
+        if (index == count) {
+            base = batch.pos;
+            count = json_tokenizer_next_batch(&batch, tokens, 4);
+            index = 0;
+            TEST_ASSERT_TRUE_MESSAGE(count > 0, "Batch returned no tokens");
+        }
+
+        expected = json_tokenizer_next(&single);
+        JsonCompactToken actual = tokens[index++];
+        TEST_ASSERT_EQUAL_MESSAGE(expected.type, actual.type,
+                                  "Token type mismatch");
+        TEST_ASSERT_EQUAL_MESSAGE(expected.length, actual.length,
+                                  "Token length mismatch");
+        TEST_ASSERT_EQUAL_PTR(expected.start, input + base + actual.offset);
+    } while (expected.type != TOKEN_EOF);
+
+    TEST_ASSERT_EQUAL_size_t(index, count);
+}
+
+void test_batch_stops_at_invalid_token(void) {
+    const char *input = "[1, @, 2]";
+    JsonTokenizerCtx ctx = json_tokenizer_init(input, strlen(input));
+
+    JsonCompactToken tokens[16];
+    size_t count = json_tokenizer_next_batch(&ctx, tokens, 16);
+
+    TEST_ASSERT_EQUAL_size_t(4, count);
+    TEST_ASSERT_EQUAL_MESSAGE(TOKEN_INVALID, tokens[3].type,
+                              "Batch should end with the invalid token");
+    TEST_ASSERT_EQUAL_size_t(4, tokens[3].offset);
+}
+
+void test_batch_leaves_long_token_to_single_token_api(void) {
+    // A string whose length does not fit the compact token's 28 bits.
+    size_t length = (size_t)JSON_COMPACT_TOKEN_MAX_LENGTH + 3;
+    char *input = malloc(length + 3);
+    TEST_ASSERT_NOT_NULL(input);
+    input[0] = '[';
+    input[1] = '"';
+    memset(input + 2, 'x', length - 2);
+    input[length] = '"';
+    input[length + 1] = ']';
+    input[length + 2] = '\0';
+    JsonTokenizerCtx ctx = json_tokenizer_init_ex(
+        input, length + 2, JSON_TOKENIZER_LAZY_POSITIONS);
+
+    JsonCompactToken tokens[4];
+    TEST_ASSERT_EQUAL_size_t(1, json_tokenizer_next_batch(&ctx, tokens, 4));
+    TEST_ASSERT_EQUAL(TOKEN_LEFT_BRACKET, tokens[0].type);
+    TEST_ASSERT_EQUAL_size_t(0, json_tokenizer_next_batch(&ctx, tokens, 4));
+    TEST_ASSERT_EQUAL_size_t(1, ctx.pos);
+
+    JsonToken token = json_tokenizer_next(&ctx);
+    TEST_ASSERT_EQUAL(TOKEN_STRING, token.type);
+    TEST_ASSERT_EQUAL_PTR(input + 1, token.start);
+    TEST_ASSERT_EQUAL_size_t(length, token.length);
+    TEST_ASSERT_EQUAL_size_t(2, json_tokenizer_next_batch(&ctx, tokens, 4));
+    TEST_ASSERT_EQUAL(TOKEN_RIGHT_BRACKET, tokens[0].type);
+    TEST_ASSERT_EQUAL(TOKEN_EOF, tokens[1].type);
+    free(input);
+}
+
+void test_lazy_positions_match_eager_tracking(void) {
+    const char *input = "{\r\n  \"first\": [1, 2, 3],\n\t\"second\":\r"
+                        "    {\"deep\": \"value with spaces\"},\r\n"
+                        "\n\n  \"third\": true, \"fourth\": null\r\n}";
+    JsonTokenizerCtx eager = json_tokenizer_init(input, strlen(input));
+    JsonTokenizerCtx lazy = json_tokenizer_init_ex(
+        input, strlen(input), JSON_TOKENIZER_LAZY_POSITIONS);
+
+    JsonToken expected;
+    do {
+        expected = json_tokenizer_next(&eager);
+        JsonToken actual = json_tokenizer_next(&lazy);
+
+        TEST_ASSERT_EQUAL_MESSAGE(expected.type, actual.type,
+                                  "Token type mismatch");
+        TEST_ASSERT_EQUAL_size_t(0, actual.line);
+        TEST_ASSERT_EQUAL_size_t(0, actual.column);
+
+        size_t line;
+        size_t column;
+        json_tokenizer_position(&lazy, (size_t)(actual.start - input), &line,
+                                &column);
+        TEST_ASSERT_EQUAL_MESSAGE(expected.line, line, "Line mismatch");
+        TEST_ASSERT_EQUAL_MESSAGE(expected.column, column, "Column mismatch");
+    } while (expected.type != TOKEN_EOF);
+}
+
+void test_lazy_position_of_invalid_token(void) {
+    const char *input = "[1,\n 2,\n   @]";
+    JsonTokenizerCtx ctx = json_tokenizer_init_ex(
+        input, strlen(input), JSON_TOKENIZER_LAZY_POSITIONS);
+
+    JsonToken token;
+    do {
+        token = json_tokenizer_next(&ctx);
+    } while (token.type != TOKEN_INVALID && token.type != TOKEN_EOF);
+
+    size_t line;
+    size_t column;
+    json_tokenizer_position(&ctx, ctx.pos, &line, &column);
+    TEST_ASSERT_EQUAL_MESSAGE(TOKEN_INVALID, token.type, "Expected invalid");
+    TEST_ASSERT_EQUAL_size_t(3, line);
+    TEST_ASSERT_EQUAL_size_t(4, column);
+}
+
+void test_string_with_non_ascii_bytes(void) {
+    const char *input = "\"caf\xc3\xa9 \xe2\x82\xac\"";
+    JsonTokenizerCtx ctx = json_tokenizer_init(input, strlen(input));
+
+    JsonToken token = json_tokenizer_next(&ctx);
+    assert_token(token, TOKEN_STRING, input, 11, 1, 1);
+}
+
+void test_literal_respects_input_length(void) {
+    const char *input = "true";
+    JsonTokenizerCtx ctx = json_tokenizer_init(input, 3);
+
+    JsonToken token = json_tokenizer_next(&ctx);
+    assert_token(token, TOKEN_INVALID, NULL, 0, 1, 1);
+}
+
+void test_utf8_validation_accepts_valid_strings(void) {
+    const char *input = "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 plus "
+                        "enough ascii to cross a vector block\\n\xc3\xa9\"";
+    JsonTokenizerCtx ctx = json_tokenizer_init_ex(input, strlen(input),
+                                                  JSON_TOKENIZER_VALIDATE_UTF8);
+
+    JsonToken token = json_tokenizer_next(&ctx);
+    assert_token(token, TOKEN_STRING, input, strlen(input), 1, 1);
+}
+
+void test_utf8_validation_rejects_invalid_strings(void) {
+    const char *inputs[] = {
+        "\"\xc3\"",                         // truncated sequence
+        "\"\xc0\xaf\"",                     // overlong encoding
+        "\"\xed\xa0\x80\"",                 // UTF-16 surrogate
+        "\"\xf4\x90\x80\x80\"",             // above U+10FFFF
+        "\"long ascii prefix before \x80\"", // stray continuation
+        "\"a\\n\xff\"",                     // invalid byte after escape
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        JsonTokenizerCtx ctx = json_tokenizer_init_ex(
+            inputs[i], strlen(inputs[i]), JSON_TOKENIZER_VALIDATE_UTF8);
+        JsonToken token = json_tokenizer_next(&ctx);
+        TEST_ASSERT_EQUAL_MESSAGE(TOKEN_INVALID, token.type,
+                                  "Invalid UTF-8 should be rejected");
+    }
+}
+
 int main(void) {
     UNITY_BEGIN();
 
@@ -617,6 +787,9 @@ int main(void) {
     RUN_TEST(test_string_with_tab_escape);
     RUN_TEST(test_string_with_unicode_escape_basic);
     RUN_TEST(test_string_with_unicode_escape_lowercase);
+    RUN_TEST(test_string_with_non_ascii_bytes);
+    RUN_TEST(test_utf8_validation_accepts_valid_strings);
+    RUN_TEST(test_utf8_validation_rejects_invalid_strings);
 
     RUN_TEST(test_simple_integer_number);
     RUN_TEST(test_negative_integer_number);
@@ -652,6 +825,7 @@ int main(void) {
     RUN_TEST(test_invalid_unexpected_characters);
     RUN_TEST(test_invalid_incomplete_literal);
     RUN_TEST(test_invalid_literal_with_trailing_chars);
+    RUN_TEST(test_literal_respects_input_length);
 
     RUN_TEST(test_eof_empty_input);
     RUN_TEST(test_eof_after_valid_tokens);
@@ -659,5 +833,13 @@ int main(void) {
 
     RUN_TEST(test_nested_structure_position_tracking);
 
+    RUN_TEST(test_compact_token_size);
+    RUN_TEST(test_batch_matches_single_token_api);
+    RUN_TEST(test_batch_stops_at_invalid_token);
+    RUN_TEST(test_batch_leaves_long_token_to_single_token_api);
+
+    RUN_TEST(test_lazy_positions_match_eager_tracking);
+    RUN_TEST(test_lazy_position_of_invalid_token);
+
     return UNITY_END();
 }